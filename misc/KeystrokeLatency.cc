@@ -0,0 +1,146 @@
+// Measure keystroke round-trip latency through winpty: type a character
+// into cmd, and time how long it takes for the echo to reach CONOUT.  The
+// agent's latency_probe debug flag follows each echo with an in-band report
+// of the agent's share of the round trip, which also marks where the echo
+// ends:
+//
+//     ESC ] 9999 ; winpty-latency ; <input-to-inject> ; <inject-to-echo> BEL
+//
+// The agent inherits the environment, so this program sets the flag itself.
+//
+// Build it against libwinpty from the misc directory:
+//
+//     i686-w64-mingw32-g++ -std=c++11 -I../src/include
+//         KeystrokeLatency.cc -o KeystrokeLatency.exe
+//         -L../build -lwinpty
+//
+// Usage: KeystrokeLatency [keystrokes]
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/include/winpty.h"
+#include "../src/shared/TimeMeasurement.h"
+
+static const char kReportPrefix[] = "\x1B]9999;winpty-latency;";
+
+// Reads CONOUT until the next latency report, and parses it.
+static bool readReport(HANDLE conout, std::string &pending,
+                       long long &inputToInjectUs, long long &injectToEchoUs) {
+    while (true) {
+        const size_t start = pending.find(kReportPrefix);
+        if (start != std::string::npos) {
+            const size_t end = pending.find('\x07', start);
+            if (end != std::string::npos) {
+                const std::string report = pending.substr(
+                    start + strlen(kReportPrefix),
+                    end - start - strlen(kReportPrefix));
+                pending.erase(0, end + 1);
+                return sscanf(report.c_str(), "%lld;%lld",
+                              &inputToInjectUs, &injectToEchoUs) == 2;
+            }
+        }
+        char buf[4096];
+        DWORD amount = 0;
+        if (!ReadFile(conout, buf, sizeof(buf), &amount, nullptr) ||
+                amount == 0) {
+            return false;
+        }
+        pending.append(buf, amount);
+    }
+}
+
+static void printSummary(const char *name, std::vector<double> &values) {
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    printf("%-16s p50 %8.0f us, p90 %8.0f us, p99 %8.0f us, max %8.0f us\n",
+           name, values[n / 2], values[n * 9 / 10], values[n * 99 / 100],
+           values.back());
+}
+
+int main(int argc, char *argv[]) {
+    const int keystrokes = argc >= 2 ? atoi(argv[1]) : 200;
+    if (keystrokes <= 0) {
+        return 0;
+    }
+    SetEnvironmentVariableW(L"WINPTY_DEBUG", L"latency_probe");
+    winpty_config_t *cfg = winpty_config_new(0, nullptr);
+    winpty_t *wp = winpty_open(cfg, nullptr);
+    winpty_config_free(cfg);
+    if (wp == nullptr) {
+        printf("error: winpty_open failed\n");
+        return 1;
+    }
+    HANDLE conin = CreateFileW(winpty_conin_name(wp), GENERIC_WRITE, 0,
+                               nullptr, OPEN_EXISTING, 0, nullptr);
+    HANDLE conout = CreateFileW(winpty_conout_name(wp), GENERIC_READ, 0,
+                                nullptr, OPEN_EXISTING, 0, nullptr);
+    winpty_spawn_config_t *spawnCfg = winpty_spawn_config_new(
+        WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN, nullptr, L"cmd",
+        nullptr, nullptr, nullptr);
+    const BOOL spawned = winpty_spawn(wp, spawnCfg, nullptr, nullptr,
+                                      nullptr, nullptr);
+    winpty_spawn_config_free(spawnCfg);
+    if (conin == INVALID_HANDLE_VALUE || conout == INVALID_HANDLE_VALUE ||
+            !spawned) {
+        printf("error: could not start the child\n");
+        return 1;
+    }
+    // Give cmd time to print its prompt and start reading input.
+    Sleep(1000);
+
+    std::string pending;
+    std::vector<double> roundTrip;
+    std::vector<double> inputToInject;
+    std::vector<double> injectToEcho;
+    for (int i = 0; i < keystrokes; ++i) {
+        // Type a character and time its echo, then erase it with a
+        // backspace, which is echoed too but not timed.
+        long long toInjectUs = 0;
+        long long toEchoUs = 0;
+        DWORD actual = 0;
+        TimeMeasurement tm;
+        WriteFile(conin, "x", 1, &actual, nullptr);
+        if (!readReport(conout, pending, toInjectUs, toEchoUs)) {
+            printf("error: CONOUT closed before a latency report\n");
+            return 1;
+        }
+        roundTrip.push_back(tm.elapsed() * 1000000.0);
+        inputToInject.push_back(static_cast<double>(toInjectUs));
+        injectToEcho.push_back(static_cast<double>(toEchoUs));
+        WriteFile(conin, "\x7F", 1, &actual, nullptr);
+        if (!readReport(conout, pending, toInjectUs, toEchoUs)) {
+            printf("error: CONOUT closed before a latency report\n");
+            return 1;
+        }
+    }
+    printf("%d keystrokes\n", keystrokes);
+    printSummary("round trip", roundTrip);
+    printSummary("input to inject", inputToInject);
+    printSummary("inject to echo", injectToEcho);
+
+    // The agent's histograms include the backspaces.
+    const int ids[] = {
+        WINPTY_STAT_INJECT_TO_ECHO_COUNT,
+        WINPTY_STAT_INJECT_TO_ECHO_P50_US,
+        WINPTY_STAT_INJECT_TO_ECHO_P99_US,
+    };
+    UINT64 values[3] = {};
+    if (winpty_get_stats(wp, ids, values, 3, nullptr)) {
+        printf("agent histogram: %llu echoes, p50 %llu us, p99 %llu us\n",
+               static_cast<unsigned long long>(values[0]),
+               static_cast<unsigned long long>(values[1]),
+               static_cast<unsigned long long>(values[2]));
+    }
+
+    CloseHandle(conin);
+    CloseHandle(conout);
+    winpty_free(wp);
+    return 0;
+}
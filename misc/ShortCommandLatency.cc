@@ -0,0 +1,103 @@
+// Measure how long winpty takes to run a short-lived command, from
+// winpty_open until the agent closes the CONOUT pipe after the child exits.
+// The agent used to notice the child's exit on its next poll tick; it now
+// waits on the process handle.
+//
+// Build it against libwinpty from the misc directory:
+//
+//     i686-w64-mingw32-g++ -std=c++11 -I../src/include
+//         ShortCommandLatency.cc -o ShortCommandLatency.exe
+//         -L../build -lwinpty
+//
+// Usage: ShortCommandLatency [iterations [timeline.json]]
+//
+// With WINPTY_DEBUG=startup_timeline, the second argument saves the first
+// run's startup timeline in the Chrome trace format.  Pass at least two
+// iterations in that case, since the first run is slowed by the save.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/include/winpty.h"
+#include "../src/shared/TimeMeasurement.h"
+
+static bool runOnce(double &elapsed, const wchar_t *timelinePath) {
+    TimeMeasurement tm;
+    winpty_config_t *cfg = winpty_config_new(0, nullptr);
+    winpty_t *wp = winpty_open(cfg, nullptr);
+    winpty_config_free(cfg);
+    if (wp == nullptr) {
+        printf("error: winpty_open failed\n");
+        return false;
+    }
+    // Save the timeline before spawning, while the agent is sure to be
+    // running.  The round trip adds to this run's time.
+    if (timelinePath != nullptr &&
+            !winpty_save_startup_timeline(wp, timelinePath, nullptr)) {
+        printf("warning: could not save the startup timeline\n");
+    }
+    HANDLE conout = CreateFileW(winpty_conout_name(wp), GENERIC_READ, 0,
+                                nullptr, OPEN_EXISTING, 0, nullptr);
+    winpty_spawn_config_t *spawnCfg = winpty_spawn_config_new(
+        WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN, nullptr, L"cmd /c exit 0",
+        nullptr, nullptr, nullptr);
+    const BOOL spawned = winpty_spawn(wp, spawnCfg, nullptr, nullptr,
+                                      nullptr, nullptr);
+    winpty_spawn_config_free(spawnCfg);
+    if (conout == INVALID_HANDLE_VALUE || !spawned) {
+        printf("error: could not start the child\n");
+        if (conout != INVALID_HANDLE_VALUE) {
+            CloseHandle(conout);
+        }
+        winpty_free(wp);
+        return false;
+    }
+    // Drain CONOUT until the agent closes it.
+    char buf[4096];
+    DWORD amount = 0;
+    while (ReadFile(conout, buf, sizeof(buf), &amount, nullptr) &&
+            amount > 0) {
+    }
+    elapsed = tm.elapsed();
+    CloseHandle(conout);
+    winpty_free(wp);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc >= 2 ? atoi(argv[1]) : 50;
+    std::wstring timelinePath;
+    if (argc >= 3) {
+        timelinePath.assign(argv[2], argv[2] + strlen(argv[2]));
+    }
+    std::vector<double> times;
+    for (int i = 0; i < iterations; ++i) {
+        double elapsed = 0.0;
+        const bool saveTimeline = i == 0 && !timelinePath.empty();
+        if (!runOnce(elapsed,
+                     saveTimeline ? timelinePath.c_str() : nullptr)) {
+            return 1;
+        }
+        times.push_back(elapsed);
+    }
+    if (times.empty()) {
+        return 0;
+    }
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    printf("%d runs: mean %.1f ms, median %.1f ms, max %.1f ms\n",
+           static_cast<int>(times.size()),
+           total / times.size() * 1000.0,
+           times[times.size() / 2] * 1000.0,
+           times.back() * 1000.0);
+    return 0;
+}
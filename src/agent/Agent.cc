@@ -38,6 +38,7 @@
 #include "../shared/Buffer.h"
 #include "../shared/DebugClient.h"
 #include "../shared/GenRandom.h"
+#include "../shared/StartupTimeline.h"
 #include "../shared/StringBuilder.h"
 #include "../shared/StringUtil.h"
 #include "../shared/WindowsVersion.h"
@@ -52,6 +53,10 @@
 
 namespace {
 
+// How often queued input is retried while the console input buffer is at the
+// input queue limit.
+const DWORD kInjectIntervalMs = 10;
+
 static BOOL WINAPI consoleCtrlHandler(DWORD dwCtrlType)
 {
     if (dwCtrlType == CTRL_C_EVENT) {
@@ -116,9 +121,10 @@ static void detectNewWindows10Console(
     console.setNewW10(isNewW10);
 }
 
-static inline WriteBuffer newPacket() {
+static inline WriteBuffer newPacket(uint32_t requestId) {
     WriteBuffer packet;
     packet.putRawValue<uint64_t>(0); // Reserve space for size.
+    packet.putRawValue<uint32_t>(requestId);
     return packet;
 }
 
@@ -141,44 +147,85 @@ static int64_t int64FromHandle(HANDLE h) {
     return static_cast<int64_t>(reinterpret_cast<intptr_t>(h));
 }
 
+// Returns the type of the complete packet at the start of the given bytes,
+// or -1 if the bytes don't contain a complete packet.
+static int packetType(const char *data, size_t size)
+{
+    uint64_t packetSize = 0;
+    if (size < sizeof(packetSize)) {
+        return -1;
+    }
+    memcpy(&packetSize, data, sizeof(packetSize));
+    if (packetSize < sizeof(packetSize) || packetSize > size) {
+        return -1;
+    }
+    try {
+        ReadBuffer buffer(data, packetSize);
+        buffer.getRawValue<uint64_t>();
+        buffer.getRawValue<uint32_t>();
+        return buffer.getInt32();
+    } catch (const ReadBuffer::DecodeError&) {
+        return -1;
+    }
+}
+
 } // anonymous namespace
 
 Agent::Agent(LPCWSTR controlPipeName,
              uint64_t agentFlags,
              int mouseMode,
              int initialCols,
-             int initialRows) :
+             int initialRows,
+             int inputQueueLimit,
+             int escapeTimeoutMs) :
     m_useConerr((agentFlags & WINPTY_FLAG_CONERR) != 0),
     m_plainMode((agentFlags & WINPTY_FLAG_PLAIN_OUTPUT) != 0),
+    m_outputColor(!m_plainMode ||
+                  (agentFlags & WINPTY_FLAG_COLOR_ESCAPES) != 0),
+    m_sharedMemoryConout(
+        (agentFlags & WINPTY_FLAG_CONOUT_SHARED_MEMORY) != 0),
+    m_bracketedPaste((agentFlags & WINPTY_FLAG_BRACKETED_PASTE) != 0),
     m_mouseMode(mouseMode)
 {
     trace("Agent::Agent entered");
+    StartupTimeline &timeline = processStartupTimeline();
+    StartupTimelineScope agentScope(timeline, "Agent::Agent");
 
     ASSERT(initialCols >= 1 && initialRows >= 1);
     initialCols = std::min(initialCols, MAX_CONSOLE_WIDTH);
     initialRows = std::min(initialRows, MAX_CONSOLE_HEIGHT);
 
-    const bool outputColor =
-        !m_plainMode || (agentFlags & WINPTY_FLAG_COLOR_ESCAPES);
     const Coord initialSize(initialCols, initialRows);
 
-    auto primaryBuffer = openPrimaryBuffer();
-    if (m_useConerr) {
-        m_errorBuffer = Win32ConsoleBuffer::createErrorBuffer();
+    std::unique_ptr<Win32ConsoleBuffer> primaryBuffer;
+    {
+        StartupTimelineScope scope(timeline, "open console buffers");
+        primaryBuffer = openPrimaryBuffer();
+        if (m_useConerr) {
+            m_errorBuffer = Win32ConsoleBuffer::createErrorBuffer();
+        }
     }
 
-    detectNewWindows10Console(m_console, *primaryBuffer);
+    {
+        StartupTimelineScope scope(timeline, "detectNewWindows10Console");
+        detectNewWindows10Console(m_console, *primaryBuffer);
+    }
 
-    m_controlPipe = &connectToControlPipe(controlPipeName);
-    m_coninPipe = &createDataServerPipe(false, L"conin");
-    m_conoutPipe = &createDataServerPipe(true, L"conout");
-    if (m_useConerr) {
-        m_conerrPipe = &createDataServerPipe(true, L"conerr");
+    {
+        StartupTimelineScope scope(timeline, "connect and create pipes");
+        m_controlPipe = &connectToControlPipe(controlPipeName);
+        m_coninPipe = &createDataServerPipe(false, L"conin");
+        m_conoutPipe = &createConoutPipe();
+        if (m_useConerr) {
+            m_conerrPipe = &createDataServerPipe(true, L"conerr");
+        }
     }
 
     // Send an initial response packet to winpty.dll containing pipe names.
     {
-        auto setupPacket = newPacket();
+        StartupTimelineScope scope(timeline, "send pipe names");
+        auto setupPacket = newPacket(kAgentMsgNoRequestId);
+        setupPacket.putInt32(kWireFormatVersion);
         setupPacket.putWString(m_coninPipe->name());
         setupPacket.putWString(m_conoutPipe->name());
         if (m_useConerr) {
@@ -187,30 +234,39 @@ Agent::Agent(LPCWSTR controlPipeName,
         writePacket(setupPacket);
     }
 
-    std::unique_ptr<Terminal> primaryTerminal;
-    primaryTerminal.reset(new Terminal(*m_conoutPipe,
-                                       m_plainMode,
-                                       outputColor));
-    m_primaryScraper.reset(new Scraper(m_console,
-                                       *primaryBuffer,
-                                       std::move(primaryTerminal),
-                                       initialSize));
-    if (m_useConerr) {
-        std::unique_ptr<Terminal> errorTerminal;
-        errorTerminal.reset(new Terminal(*m_conerrPipe,
-                                         m_plainMode,
-                                         outputColor));
-        m_errorScraper.reset(new Scraper(m_console,
-                                         *m_errorBuffer,
-                                         std::move(errorTerminal),
-                                         initialSize));
+    {
+        StartupTimelineScope scope(timeline, "create scrapers");
+        std::unique_ptr<Terminal> primaryTerminal;
+        primaryTerminal.reset(new Terminal(*m_conoutPipe,
+                                           m_plainMode,
+                                           m_outputColor));
+        m_primaryScraper.reset(new Scraper(m_console,
+                                           *primaryBuffer,
+                                           std::move(primaryTerminal),
+                                           initialSize));
+        if (m_useConerr) {
+            std::unique_ptr<Terminal> errorTerminal;
+            errorTerminal.reset(new Terminal(*m_conerrPipe,
+                                             m_plainMode,
+                                             m_outputColor));
+            m_errorScraper.reset(new Scraper(m_console,
+                                             *m_errorBuffer,
+                                             std::move(errorTerminal),
+                                             initialSize));
+        }
     }
 
     m_console.setTitle(m_currentTitle);
 
-    const HANDLE conin = GetStdHandle(STD_INPUT_HANDLE);
-    m_consoleInput.reset(
-        new ConsoleInput(conin, m_mouseMode, *this, m_console));
+    {
+        StartupTimelineScope scope(timeline, "create ConsoleInput");
+        const HANDLE conin = GetStdHandle(STD_INPUT_HANDLE);
+        m_consoleInput.reset(
+            new ConsoleInput(conin, m_mouseMode, inputQueueLimit,
+                             escapeTimeoutMs,
+                             (agentFlags & WINPTY_FLAG_LONE_ESC_IS_KEY) != 0,
+                             *this, m_console));
+    }
 
     // Setup Ctrl-C handling.  First restore default handling of Ctrl-C.  This
     // attribute is inherited by child processes.  Then register a custom
@@ -219,7 +275,14 @@ Agent::Agent(LPCWSTR controlPipeName,
     SetConsoleCtrlHandler(NULL, FALSE);
     SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
 
+    // Scraping and input-mode polling share the 25ms poll interval.  The
+    // title changes rarely, so check it less often, and only flush an
+    // incomplete escape sequence when one is buffered.
     setPollInterval(25);
+    m_titleTimer = createTimer();
+    startTimer(m_titleTimer, 100, 100, 25);
+    m_escapeTimer = createTimer();
+    m_injectTimer = createTimer();
 }
 
 Agent::~Agent()
@@ -227,6 +290,7 @@ Agent::~Agent()
     trace("Agent::~Agent entered");
     agentShutdown();
     if (m_childProcess != NULL) {
+        removeWaitHandle(m_childProcess);
         CloseHandle(m_childProcess);
     }
 }
@@ -259,6 +323,8 @@ NamedPipe &Agent::createDataServerPipe(bool write, const wchar_t *kind)
             << kind << L'-'
             << GenRandom().uniqueName()).str_moved();
     NamedPipe &pipe = createNamedPipe();
+    // Keep several reads or writes in flight for bulk output and pastes.
+    pipe.setIoDepth(4);
     pipe.openServerPipe(
         name.c_str(),
         write ? NamedPipe::OpenMode::Writing
@@ -271,6 +337,24 @@ NamedPipe &Agent::createDataServerPipe(bool write, const wchar_t *kind)
     return pipe;
 }
 
+// Returns the CONOUT output channel: a server pipe, or with
+// WINPTY_FLAG_CONOUT_SHARED_MEMORY, a shared-memory ring.  The ring is usable
+// immediately; libwinpty opens it before winpty_open returns.
+NamedPipe &Agent::createConoutPipe()
+{
+    if (!m_sharedMemoryConout) {
+        return createDataServerPipe(true, L"conout");
+    }
+    const uint32_t kRingCapacity = 1024 * 1024;
+    const auto name =
+        (WStringBuilder(128)
+            << L"Local\\winpty-conout-"
+            << GenRandom().uniqueName()).str_moved();
+    NamedPipe &pipe = createNamedPipe();
+    pipe.openSharedMemoryRing(name.c_str(), kRingCapacity);
+    return pipe;
+}
+
 void Agent::onPipeIo(NamedPipe &namedPipe)
 {
     if (&namedPipe == m_conoutPipe || &namedPipe == m_conerrPipe) {
@@ -304,17 +388,31 @@ void Agent::pollControlPipe()
             }
             break;
         }
-        std::vector<char> packetData;
-        packetData.resize(packetSize);
-        const auto amt2 = m_controlPipe->read(packetData.data(), packetSize);
-        ASSERT(amt2 == packetSize);
+        // A client dragging a window can send SetSize packets faster than
+        // we can resize the console.  If another SetSize packet is already
+        // queued behind this one, skip this one, but still owe its reply.
+        if (packetType(m_controlPipe->peekData(), packetSize) ==
+                    AgentMsg::SetSize &&
+                packetType(m_controlPipe->peekData() + packetSize,
+                           m_controlPipe->bytesAvailable() - packetSize) ==
+                    AgentMsg::SetSize) {
+            uint32_t requestId = 0;
+            memcpy(&requestId, m_controlPipe->peekData() + sizeof(packetSize),
+                   sizeof(requestId));
+            m_skippedSetSizeIds.push_back(requestId);
+            m_controlPipe->consume(packetSize);
+            continue;
+        }
+        // Decode the packet in place, then discard it.
         try {
-            ReadBuffer buffer(std::move(packetData));
+            ReadBuffer buffer(m_controlPipe->peekData(), packetSize);
             buffer.getRawValue<uint64_t>(); // Discard the size.
+            m_requestId = buffer.getRawValue<uint32_t>();
             handlePacket(buffer);
         } catch (const ReadBuffer::DecodeError&) {
             ASSERT(false && "Decode error");
         }
+        m_controlPipe->consume(packetSize);
     }
 }
 
@@ -326,16 +424,26 @@ void Agent::handlePacket(ReadBuffer &packet)
         handleStartProcessPacket(packet);
         break;
     case AgentMsg::SetSize:
-        // TODO: I think it might make sense to collapse consecutive SetSize
-        // messages.  i.e. The terminal process can probably generate SetSize
-        // messages faster than they can be processed, and some GUIs might
-        // generate a flood of them, so if we can read multiple SetSize packets
-        // at once, we can ignore the early ones.
         handleSetSizePacket(packet);
         break;
     case AgentMsg::GetConsoleProcessList:
         handleGetConsoleProcessListPacket(packet);
         break;
+    case AgentMsg::ReattachConout:
+        handleReattachConoutPacket(packet);
+        break;
+    case AgentMsg::GetScreenSnapshot:
+        handleGetScreenSnapshotPacket(packet);
+        break;
+    case AgentMsg::GetStartupTimeline:
+        handleGetStartupTimelinePacket(packet);
+        break;
+    case AgentMsg::Batch:
+        handleBatchPacket(packet);
+        break;
+    case AgentMsg::GetStats:
+        handleGetStatsPacket(packet);
+        break;
     default:
         trace("Unrecognized message, id:%d", type);
     }
@@ -348,6 +456,65 @@ void Agent::writePacket(WriteBuffer &packet)
     m_controlPipe->write(bytes.data(), bytes.size());
 }
 
+// Starts the reply to the request being handled.  Within a batch, the reply
+// is built in place at the end of the batch's reply.
+WriteBuffer Agent::newReply()
+{
+    if (!m_inBatch) {
+        return newPacket(m_requestId);
+    }
+    ASSERT(!m_batchReplyOpen);
+    m_batchReplyOpen = true;
+    m_batchReplyPos = m_batchReply.beginBytes();
+    return std::move(m_batchReply);
+}
+
+void Agent::writeReply(WriteBuffer &reply)
+{
+    if (!m_inBatch) {
+        writePacket(reply);
+        return;
+    }
+    ASSERT(m_batchReplyOpen);
+    reply.endBytes(m_batchReplyPos);
+    m_batchReply = std::move(reply);
+    m_batchReplyOpen = false;
+    ++m_batchReplyCount;
+}
+
+// A Batch packet holds a count and that many sub-requests, each a Bytes
+// field containing an ordinary packet body (a type and its fields).  The
+// sub-requests are decoded in place and dispatched through handlePacket.
+// The single reply holds the count and each sub-reply as a Bytes field.
+void Agent::handleBatchPacket(ReadBuffer &packet)
+{
+    if (m_inBatch) {
+        trace("Ignoring a nested Batch request");
+        return;
+    }
+    const int count = packet.getInt32();
+    m_batchReply = newPacket(m_requestId);
+    m_batchReply.putInt32(count);
+    m_batchReplyCount = 0;
+    m_inBatch = true;
+    for (int i = 0; i < count; ++i) {
+        size_t size = 0;
+        const char *const data = packet.getBytes(size);
+        ReadBuffer request(data, size);
+        handlePacket(request);
+        ASSERT(!m_batchReplyOpen);
+        if (m_batchReplyCount == i) {
+            // An unrecognized request has an empty reply.
+            m_batchReply.putBytes(nullptr, 0);
+            ++m_batchReplyCount;
+        }
+    }
+    m_inBatch = false;
+    packet.assertEof();
+    writePacket(m_batchReply);
+    m_batchReply = WriteBuffer();
+}
+
 void Agent::handleStartProcessPacket(ReadBuffer &packet)
 {
     ASSERT(m_childProcess == nullptr);
@@ -356,26 +523,43 @@ void Agent::handleStartProcessPacket(ReadBuffer &packet)
     const uint64_t spawnFlags = packet.getInt64();
     const bool wantProcessHandle = packet.getInt32() != 0;
     const bool wantThreadHandle = packet.getInt32() != 0;
-    const auto program = packet.getWString();
-    const auto cmdline = packet.getWString();
-    const auto cwd = packet.getWString();
-    const auto env = packet.getWString();
-    const auto desktop = packet.getWString();
+    const WireString16 strings[] = {
+        packet.getWStringView(),    // program
+        packet.getWStringView(),    // cmdline
+        packet.getWStringView(),    // cwd
+        packet.getWStringView(),    // env
+        packet.getWStringView(),    // desktop
+    };
     packet.assertEof();
 
-    auto cmdlineV = vectorWithNulFromString(cmdline);
-    auto desktopV = vectorWithNulFromString(desktop);
-    auto envV = vectorFromString(env);
+    // CreateProcess needs NUL-terminated (and for the command line, mutable)
+    // strings, so copy all of them into one buffer.  An empty string means
+    // the argument is omitted.
+    size_t totalChars = 0;
+    for (const auto &str : strings) {
+        totalChars += str.size() + 1;
+    }
+    std::vector<wchar_t> stringBuf(totalChars);
+    wchar_t *args[5] = {};
+    wchar_t *pos = stringBuf.data();
+    for (size_t i = 0; i < 5; ++i) {
+        if (!strings[i].empty()) {
+            args[i] = pos;
+            strings[i].copyTo(pos);
+        }
+        pos += strings[i].size();
+        *pos++ = L'\0';
+    }
 
-    LPCWSTR programArg = program.empty() ? nullptr : program.c_str();
-    LPWSTR cmdlineArg = cmdline.empty() ? nullptr : cmdlineV.data();
-    LPCWSTR cwdArg = cwd.empty() ? nullptr : cwd.c_str();
-    LPWSTR envArg = env.empty() ? nullptr : envV.data();
+    LPCWSTR programArg = args[0];
+    LPWSTR cmdlineArg = args[1];
+    LPCWSTR cwdArg = args[2];
+    LPWSTR envArg = args[3];
 
     STARTUPINFOW sui = {};
     PROCESS_INFORMATION pi = {};
     sui.cb = sizeof(sui);
-    sui.lpDesktop = desktop.empty() ? nullptr : desktopV.data();
+    sui.lpDesktop = args[4];
     BOOL inheritHandles = FALSE;
     if (m_useConerr) {
         inheritHandles = TRUE;
@@ -396,7 +580,7 @@ void Agent::handleStartProcessPacket(ReadBuffer &packet)
           (success ? "success" : "fail"),
           static_cast<unsigned int>(pi.dwProcessId));
 
-    auto reply = newPacket();
+    auto reply = newReply();
     if (success) {
         int64_t replyProcess = 0;
         int64_t replyThread = 0;
@@ -410,6 +594,11 @@ void Agent::handleStartProcessPacket(ReadBuffer &packet)
         m_childProcess = pi.hProcess;
         m_autoShutdown = (spawnFlags & WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN) != 0;
         m_exitAfterShutdown = (spawnFlags & WINPTY_SPAWN_FLAG_EXIT_AFTER_SHUTDOWN) != 0;
+        if (m_autoShutdown) {
+            // Wake up as soon as the child exits rather than waiting for the
+            // next poll tick.
+            addWaitHandle(m_childProcess);
+        }
         reply.putInt32(static_cast<int32_t>(StartProcessResult::ProcessCreated));
         reply.putInt64(replyProcess);
         reply.putInt64(replyThread);
@@ -417,7 +606,7 @@ void Agent::handleStartProcessPacket(ReadBuffer &packet)
         reply.putInt32(static_cast<int32_t>(StartProcessResult::CreateProcessFailed));
         reply.putInt32(lastError);
     }
-    writePacket(reply);
+    writeReply(reply);
 }
 
 void Agent::handleSetSizePacket(ReadBuffer &packet)
@@ -426,8 +615,19 @@ void Agent::handleSetSizePacket(ReadBuffer &packet)
     const int rows = packet.getInt32();
     packet.assertEof();
     resizeWindow(cols, rows);
-    auto reply = newPacket();
-    writePacket(reply);
+    // Acknowledge the SetSize packets that pollControlPipe skipped, too.
+    // They all preceded this one, so the replies stay in order.
+    if (!m_skippedSetSizeIds.empty()) {
+        trace("Coalesced %d SetSize packet(s)",
+              static_cast<int>(m_skippedSetSizeIds.size()));
+    }
+    for (const uint32_t requestId : m_skippedSetSizeIds) {
+        auto reply = newPacket(requestId);
+        writePacket(reply);
+    }
+    m_skippedSetSizeIds.clear();
+    auto reply = newReply();
+    writeReply(reply);
 }
 
 void Agent::handleGetConsoleProcessListPacket(ReadBuffer &packet)
@@ -449,26 +649,185 @@ void Agent::handleGetConsoleProcessListPacket(ReadBuffer &packet)
         trace("GetConsoleProcessList failed");
     }
 
-    auto reply = newPacket();
+    auto reply = newReply();
     reply.putInt32(processCount);
     for (DWORD i = 0; i < processCount; i++) {
         reply.putInt32(processList[i]);
     }
-    writePacket(reply);
+    writeReply(reply);
+}
+
+// Replace the CONOUT pipe with a new, unconnected server pipe, and queue a
+// replay of the scrollback history and the current screen onto it.  The old
+// client (if any) is disconnected.  The queued output is sent once the new
+// client connects.
+void Agent::handleReattachConoutPacket(ReadBuffer &packet)
+{
+    packet.assertEof();
+
+    trace("Reattaching CONOUT pipe");
+    destroyNamedPipe(*m_conoutPipe);
+    m_conoutPipe = &createConoutPipe();
+
+    std::unique_ptr<Terminal> terminal;
+    terminal.reset(new Terminal(*m_conoutPipe, m_plainMode, m_outputColor));
+    m_primaryScraper->reattachTerminal(std::move(terminal));
+
+    // The new Terminal starts with mouse mode and bracketed paste disabled;
+    // onPollTimeout will reenable them if needed.  Resend the title, too.
+    std::string command = std::string("\x1b]0;") +
+            utf8FromWide(m_currentTitle) + "\x07";
+    m_conoutPipe->write(command.c_str());
+
+    auto reply = newReply();
+    reply.putWString(m_conoutPipe->name());
+    writeReply(reply);
+}
+
+void Agent::handleGetScreenSnapshotPacket(ReadBuffer &packet)
+{
+    packet.assertEof();
+
+    // Reuse the last scrape if it happened within the current poll interval.
+    // Otherwise, scrape now, which also sends any new output to CONOUT.
+    const DWORD kMaxSnapshotAgeMs = 25;
+    if (!m_closingOutputPipes &&
+            !m_primaryScraper->hasRecentSnapshotData(kMaxSnapshotAgeMs)) {
+        scrapeBuffers();
+    }
+
+    m_snapshotBuffer.clear();
+    m_primaryScraper->writeSnapshot(m_snapshotBuffer);
+    auto reply = newReply();
+    reply.putBytes(m_snapshotBuffer.data(), m_snapshotBuffer.size());
+    writeReply(reply);
+}
+
+// The reply is empty unless the startup_timeline debug flag is set.
+void Agent::handleGetStartupTimelinePacket(ReadBuffer &packet)
+{
+    packet.assertEof();
+    const auto &events = processStartupTimeline().events();
+    auto reply = newReply();
+    reply.putInt32(static_cast<int32_t>(events.size()));
+    for (const auto &event : events) {
+        reply.putBytes(event.name.data(), event.name.size());
+        reply.putInt32(static_cast<int32_t>(event.pid));
+        reply.putInt32(static_cast<int32_t>(event.tid));
+        reply.putInt64(event.start);
+        reply.putInt64(event.end);
+    }
+    writeReply(reply);
+}
+
+// The reply is a list of (WINPTY_STAT_xxx, value) pairs.
+void Agent::handleGetStatsPacket(ReadBuffer &packet)
+{
+    packet.assertEof();
+    const ConsoleInput::Stats &input = m_consoleInput->stats();
+    const LatencyHistogram &toInject = input.inputToInject;
+    const LatencyHistogram &toEcho = input.injectToEcho;
+    const std::pair<int, uint64_t> stats[] = {
+        { WINPTY_STAT_MOUSE_EVENTS, input.mouseEvents },
+        { WINPTY_STAT_MOUSE_EVENTS_COALESCED, input.mouseEventsCoalesced },
+        { WINPTY_STAT_INPUT_TO_INJECT_COUNT, toInject.count() },
+        { WINPTY_STAT_INPUT_TO_INJECT_P50_US, toInject.percentile(50) },
+        { WINPTY_STAT_INPUT_TO_INJECT_P90_US, toInject.percentile(90) },
+        { WINPTY_STAT_INPUT_TO_INJECT_P99_US, toInject.percentile(99) },
+        { WINPTY_STAT_INPUT_TO_INJECT_MAX_US, toInject.max() },
+        { WINPTY_STAT_INJECT_TO_ECHO_COUNT, toEcho.count() },
+        { WINPTY_STAT_INJECT_TO_ECHO_P50_US, toEcho.percentile(50) },
+        { WINPTY_STAT_INJECT_TO_ECHO_P90_US, toEcho.percentile(90) },
+        { WINPTY_STAT_INJECT_TO_ECHO_P99_US, toEcho.percentile(99) },
+        { WINPTY_STAT_INJECT_TO_ECHO_MAX_US, toEcho.max() },
+    };
+    auto reply = newReply();
+    reply.putInt32(static_cast<int32_t>(sizeof(stats) / sizeof(stats[0])));
+    for (const auto &stat : stats) {
+        reply.putInt32(stat.first);
+        reply.putInt64(static_cast<int64_t>(stat.second));
+    }
+    writeReply(reply);
 }
 
 void Agent::pollConinPipe()
 {
-    const std::string newData = m_coninPipe->readAllToString();
+    if (m_consoleInput->isInputQueueFull()) {
+        // Leave the input in the pipe.  Once the pipe's read buffer fills,
+        // the NamedPipe stops reading, and the client's writes back up.
+        // The inject timer resumes polling as the queue drains.  A Ctrl-C
+        // still gets through, ahead of the input in front of it.
+        m_coninPipe->consume(m_consoleInput->extractCtrlC(
+            m_coninPipe->peekData(), m_coninPipe->bytesAvailable()));
+        armInjectTimer();
+        return;
+    }
+    const char *const newData = m_coninPipe->peekData();
+    const size_t newSize = m_coninPipe->bytesAvailable();
     if (hasDebugFlag("input_separated_bytes")) {
         // This debug flag is intended to help with testing incomplete escape
         // sequences and multibyte UTF-8 encodings.  (I wonder if the normal
         // code path ought to advance a state machine one byte at a time.)
-        for (size_t i = 0; i < newData.size(); ++i) {
-            m_consoleInput->writeInput(newData.substr(i, 1));
+        for (size_t i = 0; i < newSize; ++i) {
+            m_consoleInput->writeInput(&newData[i], 1);
         }
     } else {
-        m_consoleInput->writeInput(newData);
+        m_consoleInput->writeInput(newData, newSize);
+    }
+    m_coninPipe->consume(newSize);
+    armEscapeTimer();
+    armInjectTimer();
+}
+
+void Agent::armEscapeTimer()
+{
+    const int delay = m_consoleInput->escapeFlushDelayMs();
+    if (delay >= 0) {
+        startTimer(m_escapeTimer, delay);
+    } else {
+        stopTimer(m_escapeTimer);
+    }
+}
+
+// With an input queue limit, queued input is written a chunk at a time as
+// the console program reads its input.
+void Agent::armInjectTimer()
+{
+    if (m_consoleInput->hasQueuedInput()) {
+        startTimer(m_injectTimer, kInjectIntervalMs);
+    } else {
+        stopTimer(m_injectTimer);
+    }
+}
+
+void Agent::onTimer(int id)
+{
+    if (id == m_titleTimer) {
+        if (!m_closingOutputPipes) {
+            syncConsoleTitle();
+        }
+    } else if (id == m_escapeTimer) {
+        // Give the ConsoleInput object a chance to flush input from an
+        // incomplete escape sequence (e.g. pressing ESC).
+        m_consoleInput->flushIncompleteEscapeCode();
+        armEscapeTimer();
+        armInjectTimer();
+    } else if (id == m_injectTimer) {
+        m_consoleInput->injectQueuedInput();
+        if (!m_consoleInput->isInputQueueFull() &&
+                m_coninPipe->bytesAvailable() > 0) {
+            pollConinPipe();
+        } else {
+            armInjectTimer();
+        }
+    }
+}
+
+void Agent::onWaitHandleSignaled(HANDLE handle)
+{
+    if (handle == m_childProcess) {
+        // Do the final scrape and start closing the output pipes now.
+        onPollTimeout();
     }
 }
 
@@ -477,16 +836,13 @@ void Agent::onPollTimeout()
     m_consoleInput->updateInputFlags();
     const bool enableMouseMode = m_consoleInput->shouldActivateTerminalMouse();
 
-    // Give the ConsoleInput object a chance to flush input from an incomplete
-    // escape sequence (e.g. pressing ESC).
-    m_consoleInput->flushIncompleteEscapeCode();
-
     const bool shouldScrapeContent = !m_closingOutputPipes;
 
     // Check if the child process has exited.
     if (m_autoShutdown &&
             m_childProcess != nullptr &&
             WaitForSingleObject(m_childProcess, 0) == WAIT_OBJECT_0) {
+        removeWaitHandle(m_childProcess);
         CloseHandle(m_childProcess);
         m_childProcess = nullptr;
 
@@ -499,14 +855,19 @@ void Agent::onPollTimeout()
     // Scrape for output *after* the above exit-check to ensure that we collect
     // the child process's final output.
     if (shouldScrapeContent) {
-        syncConsoleTitle();
+        if (m_closingOutputPipes) {
+            // This is the last scrape, so catch the final title too.
+            syncConsoleTitle();
+        }
         scrapeBuffers();
     }
 
-    // We must ensure that we disable mouse mode before closing the CONOUT
-    // pipe, so update the mouse mode here.
+    // We must ensure that we disable mouse mode and bracketed paste before
+    // closing the CONOUT pipe, so update the terminal modes here.
     m_primaryScraper->terminal().enableMouseMode(
         enableMouseMode && !m_closingOutputPipes);
+    m_primaryScraper->terminal().enableBracketedPaste(
+        m_bracketedPaste && !m_closingOutputPipes);
 
     autoClosePipesForShutdown();
 }
@@ -589,12 +950,43 @@ void Agent::resizeWindow(int cols, int rows)
 
 void Agent::scrapeBuffers()
 {
-    Win32Console::FreezeGuard guard(m_console, m_console.frozen());
-    ConsoleScreenBufferInfo info;
-    m_primaryScraper->scrapeBuffer(*openPrimaryBuffer(), info);
-    m_consoleInput->setMouseWindowRect(info.windowRect());
+    // Stop sending output to a client that isn't keeping up.  The final
+    // scrape before the pipes close always sends everything.
+    m_primaryScraper->updateOutputBackpressure(
+        m_closingOutputPipes ? 0 : m_conoutPipe->bytesToSend());
     if (m_errorScraper) {
-        m_errorScraper->scrapeBuffer(*m_errorBuffer, info);
+        m_errorScraper->updateOutputBackpressure(
+            m_closingOutputPipes ? 0 : m_conerrPipe->bytesToSend());
+    }
+
+    const size_t conoutBefore = m_conoutPipe->bytesToSend();
+    {
+        Win32Console::FreezeGuard guard(m_console, m_console.frozen());
+        ConsoleScreenBufferInfo info;
+        m_primaryScraper->scrapeBuffer(*openPrimaryBuffer(), info);
+        m_consoleInput->setMouseWindowRect(info.windowRect());
+        if (m_errorScraper) {
+            m_errorScraper->scrapeBuffer(*m_errorBuffer, info);
+        }
+    }
+
+    // Output after an injection completes an inject-to-echo sample.  With
+    // the latency_probe debug flag, the sample follows the output in-band,
+    // as an OSC sequence that terminals ignore, so a test harness typing
+    // into the console can read the agent's share of each round trip.
+    int64_t inputToInjectUs = 0;
+    int64_t injectToEchoUs = 0;
+    if (m_conoutPipe->bytesToSend() > conoutBefore &&
+            m_consoleInput->noteOutputSent(inputToInjectUs, injectToEchoUs)) {
+        static bool latencyProbe = hasDebugFlag("latency_probe");
+        if (latencyProbe && !m_closingOutputPipes) {
+            const auto report = (StringBuilder(64)
+                << "\x1B]9999;winpty-latency;"
+                << static_cast<long long>(inputToInjectUs) << ';'
+                << static_cast<long long>(injectToEchoUs)
+                << '\x07').str_moved();
+            m_conoutPipe->write(report.c_str());
+        }
     }
 }
 
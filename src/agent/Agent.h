@@ -26,6 +26,10 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "../shared/AgentMsg.h"
+#include "../shared/Buffer.h"
 
 #include "DsrSender.h"
 #include "EventLoop.h"
@@ -33,9 +37,7 @@
 
 class ConsoleInput;
 class NamedPipe;
-class ReadBuffer;
 class Scraper;
-class WriteBuffer;
 class Win32ConsoleBuffer;
 
 class Agent : public EventLoop, public DsrSender
@@ -45,26 +47,38 @@ public:
           uint64_t agentFlags,
           int mouseMode,
           int initialCols,
-          int initialRows);
+          int initialRows,
+          int inputQueueLimit,
+          int escapeTimeoutMs);
     virtual ~Agent();
     void sendDsr() override;
 
 private:
     NamedPipe &connectToControlPipe(LPCWSTR pipeName);
     NamedPipe &createDataServerPipe(bool write, const wchar_t *kind);
+    NamedPipe &createConoutPipe();
 
 private:
     void pollControlPipe();
     void handlePacket(ReadBuffer &packet);
     void writePacket(WriteBuffer &packet);
+    WriteBuffer newReply();
+    void writeReply(WriteBuffer &reply);
+    void handleBatchPacket(ReadBuffer &packet);
     void handleStartProcessPacket(ReadBuffer &packet);
     void handleSetSizePacket(ReadBuffer &packet);
     void handleGetConsoleProcessListPacket(ReadBuffer &packet);
+    void handleReattachConoutPacket(ReadBuffer &packet);
+    void handleGetScreenSnapshotPacket(ReadBuffer &packet);
+    void handleGetStartupTimelinePacket(ReadBuffer &packet);
+    void handleGetStatsPacket(ReadBuffer &packet);
     void pollConinPipe();
 
 protected:
     virtual void onPollTimeout() override;
     virtual void onPipeIo(NamedPipe &namedPipe) override;
+    virtual void onTimer(int id) override;
+    virtual void onWaitHandleSignaled(HANDLE handle) override;
 
 private:
     void autoClosePipesForShutdown();
@@ -72,10 +86,15 @@ private:
     void resizeWindow(int cols, int rows);
     void scrapeBuffers();
     void syncConsoleTitle();
+    void armEscapeTimer();
+    void armInjectTimer();
 
 private:
     const bool m_useConerr;
     const bool m_plainMode;
+    const bool m_outputColor;
+    const bool m_sharedMemoryConout;
+    const bool m_bracketedPaste;
     const int m_mouseMode;
     Win32Console m_console;
     std::unique_ptr<Scraper> m_primaryScraper;
@@ -87,9 +106,25 @@ private:
     NamedPipe *m_conerrPipe = nullptr;
     bool m_autoShutdown = false;
     bool m_exitAfterShutdown = false;
+    // The ID of the request being handled, copied into its reply.
+    uint32_t m_requestId = kAgentMsgNoRequestId;
+    std::vector<uint32_t> m_skippedSetSizeIds;
+    // While a Batch packet is handled, each sub-request's reply is appended
+    // to m_batchReply as a Bytes field instead of being written to the pipe.
+    // newReply lends the buffer to the handler, and writeReply takes it
+    // back, so the replies aren't copied.
+    bool m_inBatch = false;
+    WriteBuffer m_batchReply;
+    size_t m_batchReplyPos = 0;
+    bool m_batchReplyOpen = false;
+    int m_batchReplyCount = 0;
     bool m_closingOutputPipes = false;
     std::unique_ptr<ConsoleInput> m_consoleInput;
     HANDLE m_childProcess = nullptr;
+    int m_titleTimer = -1;
+    int m_escapeTimer = -1;
+    int m_injectTimer = -1;
+    std::vector<char> m_snapshotBuffer;
 
     // If the title is initialized to the empty string, then cmd.exe will
     // sometimes print this error:
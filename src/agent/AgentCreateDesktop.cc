@@ -20,6 +20,7 @@
 
 #include "AgentCreateDesktop.h"
 
+#include "../shared/AgentMsg.h"
 #include "../shared/BackgroundDesktop.h"
 #include "../shared/Buffer.h"
 #include "../shared/DebugClient.h"
@@ -33,6 +34,7 @@ namespace {
 static inline WriteBuffer newPacket() {
     WriteBuffer packet;
     packet.putRawValue<uint64_t>(0); // Reserve space for size.
+    packet.putRawValue<uint32_t>(kAgentMsgNoRequestId);
     return packet;
 }
 
@@ -54,6 +56,7 @@ CreateDesktopLoop::CreateDesktopLoop(LPCWSTR controlPipeName) :
         m_pipe(createNamedPipe()) {
     m_pipe.connectToServer(controlPipeName, NamedPipe::OpenMode::Duplex);
     auto packet = newPacket();
+    packet.putInt32(kWireFormatVersion);
     packet.putWString(m_desktop.desktopName());
     writePacket(packet);
 }
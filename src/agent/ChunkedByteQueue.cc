@@ -0,0 +1,108 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "ChunkedByteQueue.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../shared/WinptyAssert.h"
+
+void ChunkedByteQueue::append(const void *data, size_t size)
+{
+    const char *src = reinterpret_cast<const char*>(data);
+    m_size += size;
+    while (size > 0) {
+        if (m_blocks.empty() || m_blocks.back().end == kBlockSize) {
+            m_blocks.emplace_back();
+            if (m_spare) {
+                m_blocks.back().data = std::move(m_spare);
+            }
+        }
+        Block &block = m_blocks.back();
+        const size_t amount = std::min<size_t>(size, kBlockSize - block.end);
+        memcpy(&block.data[block.end], src, amount);
+        block.end += amount;
+        src += amount;
+        size -= amount;
+    }
+}
+
+void ChunkedByteQueue::consume(size_t size)
+{
+    ASSERT(size <= m_size && "consumed more bytes than were queued");
+    m_size -= size;
+    while (size > 0) {
+        Block &block = m_blocks.front();
+        const size_t amount = std::min(size, block.end - block.begin);
+        block.begin += amount;
+        size -= amount;
+        if (block.begin == block.end) {
+            if (m_blocks.size() == 1) {
+                // Reuse the last block in place.
+                block.begin = block.end = 0;
+            } else {
+                m_spare = std::move(block.data);
+                m_blocks.pop_front();
+            }
+        }
+    }
+}
+
+void ChunkedByteQueue::clear()
+{
+    m_blocks.clear();
+    m_size = 0;
+}
+
+const char *ChunkedByteQueue::frontData() const
+{
+    return m_blocks.empty()
+        ? nullptr
+        : &m_blocks.front().data[m_blocks.front().begin];
+}
+
+size_t ChunkedByteQueue::frontSize() const
+{
+    return m_blocks.empty()
+        ? 0
+        : m_blocks.front().end - m_blocks.front().begin;
+}
+
+// Only the front block has consumed bytes at its start, and only the back
+// block has room at its end, so the queue is one run of kBlockSize-byte
+// blocks starting at the front block's begin.  That locates the block for an
+// offset directly, without walking the blocks in front of it.
+const char *ChunkedByteQueue::dataAt(size_t offset, size_t &sizeOut) const
+{
+    ASSERT(offset <= m_size);
+    if (offset == m_size) {
+        sizeOut = 0;
+        return nullptr;
+    }
+    const size_t pos = m_blocks.front().begin + offset;
+    const Block &block = m_blocks[pos / kBlockSize];
+    const size_t index = pos % kBlockSize;
+    ASSERT(index >= block.begin && index < block.end);
+    sizeOut = block.end - index;
+    return &block.data[index];
+}
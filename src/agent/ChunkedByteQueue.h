@@ -0,0 +1,69 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_CHUNKED_BYTE_QUEUE_H
+#define AGENT_CHUNKED_BYTE_QUEUE_H
+
+#include <stddef.h>
+
+#include <deque>
+#include <memory>
+
+// A FIFO byte queue stored as a chain of fixed-size blocks.  Appending never
+// moves bytes that are already queued, and consuming bytes from the front
+// never moves the rest, so the cost of both is proportional to the bytes
+// involved rather than to the size of the backlog.  A pointer returned by
+// frontData() stays valid until those bytes are consumed, which lets an
+// overlapped WriteFile read straight out of the queue.
+class ChunkedByteQueue {
+public:
+    enum { kBlockSize = 64 * 1024 };
+
+    void append(const void *data, size_t size);
+    void consume(size_t size);
+    void clear();
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // The longest contiguous run of bytes at the front of the queue.
+    const char *frontData() const;
+    size_t frontSize() const;
+
+    // The longest contiguous run of bytes starting `offset` bytes into the
+    // queue, e.g. just past the bytes of writes that are already in flight.
+    // Returns nullptr and 0 when offset == size().
+    const char *dataAt(size_t offset, size_t &sizeOut) const;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data { new char[kBlockSize] };
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::deque<Block> m_blocks;
+    // Keep one drained block around, so a queue that is repeatedly filled and
+    // emptied doesn't allocate.
+    std::unique_ptr<char[]> m_spare;
+    size_t m_size = 0;
+};
+
+#endif // AGENT_CHUNKED_BYTE_QUEUE_H
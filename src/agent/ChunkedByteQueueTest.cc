@@ -0,0 +1,162 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Correctness tests for ChunkedByteQueue, and a benchmark that drains a
+// backlog in pipe-sized writes, compared with the std::string queue that
+// NamedPipe used previously.  Build with ChunkedByteQueue.cc and
+// -DWINPTY_AGENT_ASSERT.
+
+#include "ChunkedByteQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+static const size_t kWriteSize = 64 * 1024;
+
+static std::string drain(ChunkedByteQueue &queue, size_t maxWrite) {
+    std::string ret;
+    while (!queue.empty()) {
+        const size_t amount = std::min(queue.frontSize(), maxWrite);
+        CHECK(amount > 0);
+        ret.append(queue.frontData(), amount);
+        queue.consume(amount);
+    }
+    return ret;
+}
+
+static void testRandomized() {
+    ChunkedByteQueue queue;
+    std::string expected;
+    std::string actual;
+    srand(1);
+    for (int i = 0; i < 2000; ++i) {
+        const size_t appendSize = rand() % 100000;
+        std::string data(appendSize, '\0');
+        for (auto &ch : data) {
+            ch = static_cast<char>(rand());
+        }
+        queue.append(data.data(), data.size());
+        expected += data;
+        // Take a pointer into the queue, append more, and check that the
+        // bytes didn't move.  (This is what a pending WriteFile relies on.)
+        const char *front = queue.frontData();
+        const size_t frontSize = queue.frontSize();
+        const std::string before(front, front + frontSize);
+        queue.append("xyz", 3);
+        expected += "xyz";
+        CHECK(frontSize == 0 || queue.frontData() == front);
+        CHECK(std::string(front, front + frontSize) == before);
+        size_t toConsume = rand() % (queue.size() + 1);
+        while (toConsume > 0) {
+            const size_t amount = std::min(toConsume, queue.frontSize());
+            actual.append(queue.frontData(), amount);
+            queue.consume(amount);
+            toConsume -= amount;
+        }
+        CHECK(queue.size() == expected.size() - actual.size());
+        // Walk the rest of the queue from a random offset with dataAt, the
+        // way OutputWorker skips the bytes of writes in flight.
+        size_t offset = rand() % (queue.size() + 1);
+        std::string tail;
+        while (offset < queue.size()) {
+            size_t available = 0;
+            const char *const data = queue.dataAt(offset, available);
+            CHECK(data != nullptr && available > 0);
+            tail.append(data, available);
+            offset += available;
+        }
+        CHECK(tail == expected.substr(expected.size() - tail.size()));
+        size_t available = 1;
+        CHECK(queue.dataAt(queue.size(), available) == nullptr &&
+              available == 0);
+    }
+    actual += drain(queue, kWriteSize);
+    CHECK(actual == expected);
+    CHECK(queue.empty() && queue.frontSize() == 0);
+    queue.append("abc", 3);
+    CHECK(drain(queue, 2) == "abc");
+}
+
+static double nowSeconds() {
+    return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+// The old NamedPipe output path: copy the front to a staging buffer, then
+// erase it from the string.
+static double benchStringQueue(const std::string &chunk, size_t backlog) {
+    std::vector<char> staging(kWriteSize);
+    const double start = nowSeconds();
+    std::string queue;
+    while (queue.size() < backlog) {
+        queue.append(chunk);
+    }
+    while (!queue.empty()) {
+        const size_t amount = std::min(queue.size(), kWriteSize);
+        std::copy(&queue[0], &queue[amount], staging.data());
+        queue.erase(0, amount);
+    }
+    return nowSeconds() - start;
+}
+
+static double benchChunkedQueue(const std::string &chunk, size_t backlog) {
+    const double start = nowSeconds();
+    ChunkedByteQueue queue;
+    while (queue.size() < backlog) {
+        queue.append(chunk.data(), chunk.size());
+    }
+    volatile char sink = 0;
+    while (!queue.empty()) {
+        const size_t amount = std::min(queue.frontSize(), kWriteSize);
+        sink = queue.frontData()[amount - 1];
+        queue.consume(amount);
+    }
+    (void)sink;
+    return nowSeconds() - start;
+}
+
+static void benchmark() {
+    // A typical Terminal write: a line or two of text and escape sequences.
+    const std::string chunk(200, 'x');
+    const size_t backlogs[] = { 1 << 20, 4 << 20, 16 << 20, 64 << 20 };
+    printf("%10s %14s %14s\n", "backlog", "string MB/s", "chunked MB/s");
+    for (size_t backlog : backlogs) {
+        const double mb = backlog / (1024.0 * 1024.0);
+        const double stringTime = benchStringQueue(chunk, backlog);
+        const double chunkedTime = benchChunkedQueue(chunk, backlog);
+        printf("%8.0fMB %14.1f %14.1f\n", mb,
+               mb / std::max(stringTime, 1e-6),
+               mb / std::max(chunkedTime, 1e-6));
+    }
+}
+
+int main() {
+    testRandomized();
+    benchmark();
+    return unitTestResult();
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_COMPACTING_BYTE_BUFFER_H
+#define AGENT_COMPACTING_BYTE_BUFFER_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "../shared/WinptyAssert.h"
+
+// A FIFO byte buffer whose unread bytes are always contiguous.  Consuming
+// bytes only advances the read offset, so a partial escape sequence or UTF-8
+// character left at the front stays where it is.  The unread bytes are moved
+// to the front of the storage only when an append would otherwise run off
+// the end, and the storage is kept when the buffer drains, so a buffer that
+// is repeatedly filled and emptied doesn't allocate.
+class CompactingByteBuffer {
+public:
+    size_t size() const { return m_end - m_begin; }
+    bool empty() const { return m_begin == m_end; }
+    const char *data() const { return m_storage.get() + m_begin; }
+    char *data() { return m_storage.get() + m_begin; }
+    char operator[](size_t i) const { return m_storage[m_begin + i]; }
+
+    void append(const char *data, size_t size) {
+        if (size > m_capacity - m_end) {
+            makeRoom(size);
+        }
+        memcpy(m_storage.get() + m_end, data, size);
+        m_end += size;
+    }
+
+    void consume(size_t size) {
+        ASSERT(size <= this->size());
+        m_begin += size;
+        if (m_begin == m_end) {
+            m_begin = 0;
+            m_end = 0;
+        }
+    }
+
+    void clear() {
+        m_begin = 0;
+        m_end = 0;
+    }
+
+private:
+    void makeRoom(size_t size) {
+        const size_t used = this->size();
+        if (used + size <= m_capacity) {
+            memmove(m_storage.get(), data(), used);
+        } else {
+            const size_t capacity =
+                std::max<size_t>(std::max<size_t>(m_capacity * 2, 4096),
+                                 used + size);
+            std::unique_ptr<char[]> storage(new char[capacity]);
+            if (used > 0) {
+                memcpy(storage.get(), data(), used);
+            }
+            m_storage = std::move(storage);
+            m_capacity = capacity;
+        }
+        m_begin = 0;
+        m_end = used;
+    }
+
+    std::unique_ptr<char[]> m_storage;
+    size_t m_capacity = 0;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+};
+
+#endif // AGENT_COMPACTING_BYTE_BUFFER_H
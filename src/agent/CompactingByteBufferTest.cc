@@ -0,0 +1,142 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Correctness tests for CompactingByteBuffer, and a benchmark of the input
+// pattern, where each write is decoded except for a short incomplete tail,
+// compared with the std::string queue that ConsoleInput used previously.
+// Build with -DWINPTY_AGENT_ASSERT.
+
+#include "CompactingByteBuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "../shared/UnitTest.h"
+
+static bool sameBytes(const CompactingByteBuffer &buffer,
+                      const std::string &model) {
+    return buffer.size() == model.size() &&
+        (model.empty() || memcmp(buffer.data(), model.data(),
+                                 model.size()) == 0);
+}
+
+static void testBasics() {
+    CompactingByteBuffer buffer;
+    CHECK(buffer.empty() && buffer.size() == 0);
+    buffer.append("abc\x1B[", 5);
+    CHECK(buffer.size() == 5 && buffer[3] == '\x1B');
+    buffer.consume(3);
+    // The partial sequence stays in place until more input is appended.
+    const char *const tail = buffer.data();
+    CHECK(buffer.size() == 2 && memcmp(tail, "\x1B[", 2) == 0);
+    buffer.append("A", 1);
+    CHECK(buffer.size() == 3 && memcmp(buffer.data(), "\x1B[A", 3) == 0);
+    buffer.consume(3);
+    CHECK(buffer.empty());
+    buffer.append("x", 1);
+    buffer.clear();
+    CHECK(buffer.empty());
+}
+
+// Compare against a std::string model with random appends and consumes,
+// including appends larger than the current storage.
+static void testRandomized() {
+    srand(1);
+    CompactingByteBuffer buffer;
+    std::string model;
+    std::string chunk;
+    unsigned char next = 0;
+    for (int iter = 0; iter < 20000; ++iter) {
+        if (rand() % 2 == 0) {
+            const size_t size = rand() % 3 == 0 ?
+                rand() % 20000 : rand() % 64;
+            chunk.resize(size);
+            for (size_t i = 0; i < size; ++i) {
+                chunk[i] = static_cast<char>(next++);
+            }
+            buffer.append(chunk.data(), chunk.size());
+            model.append(chunk);
+        } else if (!model.empty()) {
+            const size_t size = rand() % (model.size() + 1);
+            buffer.consume(size);
+            model.erase(0, size);
+        }
+        CHECK(sameBytes(buffer, model));
+    }
+}
+
+static double nowSeconds() {
+    return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+// Each write is decoded except for a three-byte tail.
+static const size_t kTailSize = 3;
+
+static double benchStringQueue(const std::string &chunk, int writes) {
+    const double start = nowSeconds();
+    std::string queue;
+    size_t total = 0;
+    for (int i = 0; i < writes; ++i) {
+        queue.append(chunk);
+        total += queue[0];
+        queue.erase(0, queue.size() - kTailSize);
+    }
+    const double ret = nowSeconds() - start;
+    CHECK(total != 1);
+    return ret;
+}
+
+static double benchCompactingBuffer(const std::string &chunk, int writes) {
+    const double start = nowSeconds();
+    CompactingByteBuffer buffer;
+    size_t total = 0;
+    for (int i = 0; i < writes; ++i) {
+        buffer.append(chunk.data(), chunk.size());
+        total += buffer[0];
+        buffer.consume(buffer.size() - kTailSize);
+    }
+    const double ret = nowSeconds() - start;
+    CHECK(total != 1);
+    return ret;
+}
+
+static void benchmark() {
+    printf("%10s %14s %14s\n", "write size", "string ns/op", "buffer ns/op");
+    const size_t sizes[] = { 8, 64, 4096 };
+    for (size_t size : sizes) {
+        const std::string chunk(size, 'x');
+        const int writes = static_cast<int>(64 * 1024 * 1024 / size);
+        const double stringTime = benchStringQueue(chunk, writes);
+        const double bufferTime = benchCompactingBuffer(chunk, writes);
+        printf("%10u %14.1f %14.1f\n", static_cast<unsigned>(size),
+               stringTime / writes * 1e9, bufferTime / writes * 1e9);
+    }
+}
+
+int main() {
+    testBasics();
+    testRandomized();
+    benchmark();
+    return unitTestResult();
+}
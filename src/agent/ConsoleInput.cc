@@ -34,8 +34,9 @@
 
 #include "ConsoleInputReencoding.h"
 #include "DebugShowInput.h"
-#include "DefaultInputMap.h"
+#include "DefaultInputTables.h"
 #include "DsrSender.h"
+#include "InputMap.h"
 #include "UnicodeEncoding.h"
 #include "Win32Console.h"
 
@@ -64,7 +65,25 @@ std::string MouseRecord::toString() const {
     return sb.str_moved();
 }
 
-const unsigned int kIncompleteEscapeTimeoutMs = 1000u;
+// Inside a bracketed paste, the only sequence to wait for is the end marker.
+// The escape timeout is meant for keypresses, so a paste split by a slow
+// connection gets longer.
+const DWORD kPasteTimeoutMs = 1000u;
+
+// A QueryPerformanceCounter timestamp in microseconds, for the latency
+// statistics.
+int64_t nowMicroseconds() {
+    static const int64_t freq = [] {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        return static_cast<int64_t>(value.QuadPart);
+    }();
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    // Split the conversion so the multiplication can't overflow.
+    const int64_t ticks = now.QuadPart;
+    return ticks / freq * 1000000 + ticks % freq * 1000000 / freq;
+}
 
 #define CHECK(cond)                                 \
         do {                                        \
@@ -102,25 +121,11 @@ const unsigned int kIncompleteEscapeTimeoutMs = 1000u;
             }                                       \
         } while(0)
 
-// Match the Device Status Report console input:  ESC [ nn ; mm R
-// Returns:
+// The mouse matchers decode the fields of a sequence that InputDfa has
+// already recognized.  Returns:
 // 0   no match
 // >0  match, returns length of match
 // -1  incomplete match
-static int matchDsr(const char *input, int inputSize)
-{
-    int32_t dummy = 0;
-    const char *pch = input;
-    const char *stop = input + inputSize;
-    CHECK(*pch == '\x1B');  ADVANCE();
-    CHECK(*pch == '[');     ADVANCE();
-    SCAN_INT(dummy, 8);
-    CHECK(*pch == ';');     ADVANCE();
-    SCAN_INT(dummy, 8);
-    CHECK(*pch == 'R');
-    return pch - input + 1;
-}
-
 static int matchMouseDefault(const char *input, int inputSize,
                              MouseRecord &out)
 {
@@ -172,37 +177,37 @@ static int matchMouse1015(const char *input, int inputSize, MouseRecord &out)
     return pch - input + 1;
 }
 
-// Match a mouse input escape sequence of any kind.
-// 0   no match
-// >0  match, returns length of match
-// -1  incomplete match
-static int matchMouseRecord(const char *input, int inputSize, MouseRecord &out)
-{
-    memset(&out, 0, sizeof(out));
-    int ret;
-    if ((ret = matchMouse1006(input, inputSize, out)) != 0) { return ret; }
-    if ((ret = matchMouse1015(input, inputSize, out)) != 0) { return ret; }
-    if ((ret = matchMouseDefault(input, inputSize, out)) != 0) { return ret; }
-    return 0;
-}
-
 #undef CHECK
 #undef ADVANCE
 #undef SCAN_INT
 
 } // anonymous namespace
 
-ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
-                           Win32Console &console) :
+ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, int inputQueueLimit,
+                           int escapeTimeoutMs, bool loneEscIsKey,
+                           DsrSender &dsrSender, Win32Console &console) :
     m_console(console),
     m_conin(conin),
     m_mouseMode(mouseMode),
-    m_dsrSender(dsrSender)
+    m_dsrSender(dsrSender),
+    m_escapeTimeoutMs(std::max(escapeTimeoutMs, 0)),
+    m_loneEscIsKey(loneEscIsKey),
+    m_inputQueueLimit(std::max(inputQueueLimit, 0))
 {
-    addDefaultEntriesToInputMap(m_inputMap);
+    // The default input map and its DFA are generated at build time.
     if (hasDebugFlag("dump_input_map")) {
-        m_inputMap.dumpInputMap();
+        InputMap(kDefaultInputMap).dumpInputMap();
+    }
+    m_inputDfa.load(kDefaultInputDfa);
+    trace("Input DFA: %d states, %d byte classes, %d bytes",
+          static_cast<int>(m_inputDfa.stateCount()),
+          m_inputDfa.byteClassCount(),
+          static_cast<int>(m_inputDfa.tableBytes()));
+    for (int ch = 0; ch < 256; ++ch) {
+        m_plainText.setSpecialByte(ch, m_inputDfa.startsSequence(ch));
     }
+    // Inside a bracketed paste, only the end marker is special.
+    m_pasteText.setSpecialByte('\x1B', true);
 
     // Configure Quick Edit mode according to the mouse mode.  Enable
     // InsertMode for two reasons:
@@ -234,9 +239,9 @@ ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
     updateInputFlags(true);
 }
 
-void ConsoleInput::writeInput(const std::string &input)
+void ConsoleInput::writeInput(const char *input, size_t size)
 {
-    if (input.size() == 0) {
+    if (size == 0) {
         return;
     }
 
@@ -244,7 +249,7 @@ void ConsoleInput::writeInput(const std::string &input)
         static bool debugInput = hasDebugFlag("input");
         if (debugInput) {
             std::string dumpString;
-            for (size_t i = 0; i < input.size(); ++i) {
+            for (size_t i = 0; i < size; ++i) {
                 const char ch = input[i];
                 const char ctrl = decodeUnixCtrlChar(ch);
                 if (ctrl != '\0') {
@@ -255,7 +260,7 @@ void ConsoleInput::writeInput(const std::string &input)
                 }
             }
             dumpString += " (";
-            for (size_t i = 0; i < input.size(); ++i) {
+            for (size_t i = 0; i < size; ++i) {
                 if (i > 0) {
                     dumpString += ' ';
                 }
@@ -269,8 +274,30 @@ void ConsoleInput::writeInput(const std::string &input)
         }
     }
 
-    m_byteQueue.append(input);
-    doWrite(false);
+    const int64_t now = nowMicroseconds();
+    if (m_byteQueue.empty()) {
+        m_byteQueueArrivalUs = now;
+    }
+    const size_t queuedBefore = m_byteQueue.size() + size;
+    // An ESC that arrives by itself is almost certainly the Escape key.  With
+    // WINPTY_FLAG_LONE_ESC_IS_KEY, it's decoded now rather than after the
+    // escape timeout.
+    const bool loneEsc = m_loneEscIsKey && !m_inBracketedPaste &&
+        m_byteQueue.empty() && size == 1 && input[0] == '\x1B';
+    if (m_byteQueue.empty()) {
+        // Usually nothing is left over from the last write, so decode the
+        // caller's buffer in place and queue only an incomplete tail.
+        const size_t used = doWrite(input, size, loneEsc);
+        m_byteQueue.append(input + used, size - used);
+    } else {
+        m_byteQueue.append(input, size);
+        m_byteQueue.consume(
+            doWrite(m_byteQueue.data(), m_byteQueue.size(), loneEsc));
+    }
+    if (!m_byteQueue.empty() && m_byteQueue.size() < queuedBefore) {
+        // The leftover bytes are an incomplete sequence from this write.
+        m_byteQueueArrivalUs = now;
+    }
     if (!m_byteQueue.empty() && !m_dsrSent) {
         trace("send DSR");
         m_dsrSender.sendDsr();
@@ -279,15 +306,144 @@ void ConsoleInput::writeInput(const std::string &input)
     m_lastWriteTick = GetTickCount();
 }
 
+// While the injection queue is full, the agent leaves input in the CONIN
+// pipe, so a Ctrl-C typed during a large paste would wait behind the rest of
+// the paste.  In processed mode, this sends each Ctrl-C in the pending input
+// at once and removes it.  The input is split the way doWrite will decode
+// it, starting after the incomplete sequence held in m_byteQueue, so only a
+// 0x03 that doWrite would turn into Ctrl-C is taken.  A 0x03 that is part of
+// a sequence (e.g. ESC ^C, Alt+Ctrl+C) or of a bracketed paste is left
+// alone, as is everything after a sequence that is still incomplete.  The
+// kept bytes are moved to the end of the span, and the return value is the
+// number of bytes at the front to discard.
+size_t ConsoleInput::extractCtrlC(char *input, size_t size)
+{
+    if (size == 0 || memchr(input, '\x03', size) == nullptr ||
+            !(inputConsoleMode() & ENABLE_PROCESSED_INPUT)) {
+        return 0;
+    }
+    // Scan the queued bytes and the input as one stream.
+    const size_t queued = m_byteQueue.size();
+    const size_t total = queued + size;
+    std::string joined;
+    const char *stream = input;
+    if (queued > 0) {
+        joined.reserve(total);
+        joined.append(m_byteQueue.data(), queued);
+        joined.append(input, size);
+        stream = joined.data();
+    }
+    bool inPaste = m_inBracketedPaste;
+    size_t kept = 0;
+    size_t idx = 0;
+    while (idx < total) {
+        size_t len = 1;
+        if (!inPaste && stream[idx] == '\x03') {
+            if (idx >= queued) {
+                generateCtrlC();
+                idx += 1;
+                continue;
+            }
+        } else {
+            len = pendingInputLength(&stream[idx], total - idx, inPaste);
+            if (len == 0) {
+                // The rest is an incomplete sequence.
+                len = total - idx;
+            }
+        }
+        // Keep this part's bytes that are in the input.
+        for (size_t i = std::max(idx, queued); i < idx + len; ++i) {
+            input[kept++] = stream[i];
+        }
+        idx += len;
+    }
+    const size_t removed = size - kept;
+    memmove(&input[removed], input, kept);
+    return removed;
+}
+
+// Returns the length of the next part of the input that doWrite would
+// decode as a unit, or 0 if the input ends before the part does.  A paste
+// marker updates inPaste.  This follows scanInput and scanPaste but decodes
+// nothing.
+size_t ConsoleInput::pendingInputLength(const char *input,
+                                        size_t inputSize,
+                                        bool &inPaste) const
+{
+    if (inPaste) {
+        // The paste body runs through the end marker.
+        static const char kPasteEnd[] = "\x1B[201~";
+        const size_t kPasteEndLen = sizeof(kPasteEnd) - 1;
+        const char *end = std::search(input, input + inputSize,
+                                      kPasteEnd, kPasteEnd + kPasteEndLen);
+        if (end == input + inputSize) {
+            return 0;
+        }
+        inPaste = false;
+        return end - input + kPasteEndLen;
+    }
+    const int size = static_cast<int>(inputSize);
+    const InputDfa::Match match = m_inputDfa.match(input, size, false);
+    switch (match.kind) {
+        case InputDfa::Incomplete:
+            return 0;
+        case InputDfa::PasteBegin:
+            inPaste = true;
+            return match.len;
+        case InputDfa::None:
+            break;
+        default:
+            return match.len;
+    }
+    if (input[0] == '\x1B' && size >= 2 && input[1] != '\x1B') {
+        const int len = utf8CharLength(input[1]);
+        if (len > 0) {
+            return 1 + len > size ? 0 : 1 + len;
+        }
+    }
+    const int len = utf8CharLength(input[0]);
+    if (len == 0) {
+        return 1;
+    }
+    return len > size ? 0 : len;
+}
+
+void ConsoleInput::generateCtrlC()
+{
+    trace("Ctrl-C");
+    const BOOL ret = GenerateConsoleCtrlEvent(CTRL_C_EVENT, 0);
+    trace("GenerateConsoleCtrlEvent: %d", ret);
+}
+
 void ConsoleInput::flushIncompleteEscapeCode()
 {
     if (!m_byteQueue.empty() &&
-            (GetTickCount() - m_lastWriteTick) > kIncompleteEscapeTimeoutMs) {
-        doWrite(true);
+            (GetTickCount() - m_lastWriteTick) > flushTimeoutMs()) {
+        doWrite(m_byteQueue.data(), m_byteQueue.size(), true);
         m_byteQueue.clear();
     }
 }
 
+// Returns the number of milliseconds until flushIncompleteEscapeCode will
+// flush the buffered input, or -1 if no input is buffered.
+int ConsoleInput::escapeFlushDelayMs()
+{
+    if (m_byteQueue.empty()) {
+        return -1;
+    }
+    const DWORD timeout = flushTimeoutMs();
+    const DWORD elapsed = GetTickCount() - m_lastWriteTick;
+    if (elapsed > timeout) {
+        return 0;
+    }
+    return timeout + 1 - elapsed;
+}
+
+DWORD ConsoleInput::flushTimeoutMs() const
+{
+    return m_inBracketedPaste ? kPasteTimeoutMs : m_escapeTimeoutMs;
+}
+
 void ConsoleInput::updateInputFlags(bool forceTrace)
 {
     const DWORD mode = inputConsoleMode();
@@ -331,31 +487,168 @@ bool ConsoleInput::shouldActivateTerminalMouse()
     }
 }
 
-void ConsoleInput::doWrite(bool isEof)
+// Decodes as much of the input as possible and returns the number of bytes
+// used.  The rest is the start of an incomplete sequence.
+size_t ConsoleInput::doWrite(const char *data, size_t size, bool isEof)
 {
-    const char *data = m_byteQueue.c_str();
-    std::vector<INPUT_RECORD> records;
+    std::vector<INPUT_RECORD> &records = m_records;
+    // The bulk path skips the per-keypress tracing and the escape-input
+    // reencoding, so it's only used when neither is needed.
+    static bool debugInput = hasDebugFlag("input");
+    const bool usePlainText =
+        !(debugInput && isTracingEnabled()) && !m_escapeInputEnabled;
     size_t idx = 0;
-    while (idx < m_byteQueue.size()) {
-        int charSize = scanInput(records, &data[idx], m_byteQueue.size() - idx, isEof);
+    while (idx < size) {
+        if (m_inBracketedPaste) {
+            const size_t pasteLen = scanPaste(
+                records, &data[idx], size - idx, isEof);
+            if (pasteLen == 0) {
+                break;
+            }
+            idx += pasteLen;
+            continue;
+        }
+        if (usePlainText) {
+            const size_t plainLen = appendPlainText(
+                records, &data[idx], size - idx);
+            if (plainLen > 0) {
+                idx += plainLen;
+                continue;
+            }
+        }
+        int charSize = scanInput(records, &data[idx], size - idx, isEof);
         if (charSize == -1)
             break;
         idx += charSize;
     }
-    m_byteQueue.erase(0, idx);
     flushInputRecords(records);
+    return idx;
 }
 
+// Without an input queue limit, the records are written to the console at
+// once.  Otherwise, they go through the injection queue.
 void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
 {
     if (records.size() == 0) {
         return;
     }
+    if (m_inputQueueLimit == 0) {
+        writeConsoleInput(records.data(), records.size());
+        noteInjected(m_byteQueueArrivalUs);
+    } else {
+        m_injectMarks.push_back(
+            std::make_pair(m_recordsQueued, m_byteQueueArrivalUs));
+        m_recordsQueued += records.size();
+        m_injectQueue.insert(m_injectQueue.end(),
+                             records.begin(), records.end());
+        injectQueuedInput();
+    }
+    records.clear();
+}
+
+void ConsoleInput::writeConsoleInput(const INPUT_RECORD *records,
+                                     size_t count)
+{
     DWORD actual = 0;
-    if (!WriteConsoleInputW(m_conin, records.data(), records.size(), &actual)) {
+    if (!WriteConsoleInputW(m_conin, records, count, &actual)) {
         trace("WriteConsoleInputW failed");
     }
-    records.clear();
+}
+
+// Writes as much of the injection queue as fits under the limit on unread
+// console input events.  The agent calls this periodically while input is
+// queued.
+void ConsoleInput::injectQueuedInput()
+{
+    if (!hasQueuedInput()) {
+        return;
+    }
+    DWORD unread = 0;
+    if (!GetNumberOfConsoleInputEvents(m_conin, &unread)) {
+        trace("GetNumberOfConsoleInputEvents failed");
+        unread = 0;
+    }
+    if (unread >= m_inputQueueLimit) {
+        return;
+    }
+    const size_t queued = m_injectQueue.size() - m_injectQueueStart;
+    size_t count = std::min<size_t>(queued, m_inputQueueLimit - unread);
+    // Keep a character's surrogate pair in one write.
+    while (count < queued) {
+        const INPUT_RECORD &last =
+            m_injectQueue[m_injectQueueStart + count - 1];
+        const wchar_t ch = last.Event.KeyEvent.uChar.UnicodeChar;
+        if (last.EventType != KEY_EVENT || ch < 0xD800 || ch > 0xDBFF) {
+            break;
+        }
+        ++count;
+    }
+    writeConsoleInput(&m_injectQueue[m_injectQueueStart], count);
+    m_injectQueueStart += count;
+    m_recordsInjected += count;
+    retireInjectMarks();
+    if (m_injectQueueStart == m_injectQueue.size()) {
+        m_injectQueue.clear();
+        m_injectQueueStart = 0;
+    } else if (m_injectQueueStart >= m_injectQueue.size() / 2) {
+        // Compact the queue once half of it has been written.
+        m_injectQueue.erase(m_injectQueue.begin(),
+                            m_injectQueue.begin() + m_injectQueueStart);
+        m_injectQueueStart = 0;
+    }
+}
+
+// Writes the whole injection queue, regardless of the limit, for input that
+// must not overtake it.
+void ConsoleInput::drainInputQueue()
+{
+    if (hasQueuedInput()) {
+        const size_t count = m_injectQueue.size() - m_injectQueueStart;
+        writeConsoleInput(&m_injectQueue[m_injectQueueStart], count);
+        m_injectQueue.clear();
+        m_injectQueueStart = 0;
+        m_recordsInjected += count;
+        retireInjectMarks();
+    }
+}
+
+// Records a sample for each queued batch whose first record has been
+// written.
+void ConsoleInput::retireInjectMarks()
+{
+    while (!m_injectMarks.empty() &&
+            m_injectMarks.front().first < m_recordsInjected) {
+        noteInjected(m_injectMarks.front().second);
+        m_injectMarks.pop_front();
+    }
+}
+
+void ConsoleInput::noteInjected(int64_t arrivalUs)
+{
+    const int64_t now = nowMicroseconds();
+    m_stats.inputToInject.add(now - arrivalUs);
+    if (!m_echoPending) {
+        m_echoPending = true;
+        m_echoArrivalUs = arrivalUs;
+        m_echoInjectUs = now;
+    }
+}
+
+// The agent calls this after a scrape that sent output.  The first output
+// after an injection is taken to be its echo.  Returns false if no
+// injection was waiting for one; otherwise, the latencies of the earliest
+// unechoed batch are stored in the out parameters.
+bool ConsoleInput::noteOutputSent(int64_t &inputToInjectUs,
+                                  int64_t &injectToEchoUs)
+{
+    if (!m_echoPending) {
+        return false;
+    }
+    m_echoPending = false;
+    inputToInjectUs = m_echoInjectUs - m_echoArrivalUs;
+    injectToEchoUs = nowMicroseconds() - m_echoInjectUs;
+    m_stats.injectToEcho.add(injectToEchoUs);
+    return true;
 }
 
 // This behavior isn't strictly correct, because the keypresses (probably?)
@@ -394,56 +687,57 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
     // In unprocessed mode, there's an entry for Ctrl-C in the SimpleEncoding
     // table in DefaultInputMap.
     //
+    // The Ctrl-C event isn't held in the injection queue.  It goes ahead of
+    // any input still waiting there (e.g. the rest of a large paste).
+    //
     // [1] https://github.com/rprichard/winpty/issues/116
     if (input[0] == '\x03' && (inputConsoleMode() & ENABLE_PROCESSED_INPUT)) {
         flushInputRecords(records);
-        trace("Ctrl-C");
-        const BOOL ret = GenerateConsoleCtrlEvent(CTRL_C_EVENT, 0);
-        trace("GenerateConsoleCtrlEvent: %d", ret);
+        generateCtrlC();
         return 1;
     }
 
-    if (input[0] == '\x1B') {
-        // Attempt to match the Device Status Report (DSR) reply.
-        int dsrLen = matchDsr(input, inputSize);
-        if (dsrLen > 0) {
+    // Match a Device Status Report (DSR) reply, mouse input, or a key
+    // in the input map.
+    const InputDfa::Match match = m_inputDfa.match(input, inputSize, isEof);
+    switch (match.kind) {
+        case InputDfa::Incomplete:
+            // Incomplete match -- need more characters (or wait for a
+            // timeout to signify flushed input).
+            trace("Incomplete escape sequence");
+            return -1;
+        case InputDfa::Dsr:
             trace("Received a DSR reply");
             m_dsrSent = false;
-            return dsrLen;
-        } else if (!isEof && dsrLen == -1) {
-            // Incomplete DSR match.
-            trace("Incomplete DSR match");
-            return -1;
-        }
-
-        int mouseLen = scanMouseInput(records, input, inputSize);
-        if (mouseLen > 0 || (!isEof && mouseLen == -1)) {
-            return mouseLen;
-        }
-    }
-
-    // Search the input map.
-    InputMap::Key match;
-    bool incomplete;
-    int matchLen = m_inputMap.lookupKey(input, inputSize, match, incomplete);
-    if (!isEof && incomplete) {
-        // Incomplete match -- need more characters (or wait for a
-        // timeout to signify flushed input).
-        trace("Incomplete escape sequence");
-        return -1;
-    } else if (matchLen > 0) {
-        uint32_t winCodePointDn = match.unicodeChar;
-        if ((match.keyState & LEFT_CTRL_PRESSED) && (match.keyState & LEFT_ALT_PRESSED)) {
-            winCodePointDn = '\0';
-        }
-        uint32_t winCodePointUp = winCodePointDn;
-        if (match.keyState & LEFT_ALT_PRESSED) {
-            winCodePointUp = '\0';
+            return match.len;
+        case InputDfa::PasteBegin:
+            trace("Bracketed paste started");
+            m_inBracketedPaste = true;
+            if (m_escapeInputEnabled) {
+                reencodeBracketedPasteMarker(records, true);
+            }
+            return match.len;
+        case InputDfa::MouseDefault:
+        case InputDfa::Mouse1006:
+        case InputDfa::Mouse1015:
+            return scanMouseInput(records, match.kind, input, match.len);
+        case InputDfa::Key: {
+            const InputMap::Key &key = match.key;
+            uint32_t winCodePointDn = key.unicodeChar;
+            if ((key.keyState & LEFT_CTRL_PRESSED) && (key.keyState & LEFT_ALT_PRESSED)) {
+                winCodePointDn = '\0';
+            }
+            uint32_t winCodePointUp = winCodePointDn;
+            if (key.keyState & LEFT_ALT_PRESSED) {
+                winCodePointUp = '\0';
+            }
+            appendKeyPress(records, key.virtualKey,
+                           winCodePointDn, winCodePointUp, key.keyState,
+                           key.unicodeChar, key.keyState);
+            return match.len;
         }
-        appendKeyPress(records, match.virtualKey,
-                       winCodePointDn, winCodePointUp, match.keyState,
-                       match.unicodeChar, match.keyState);
-        return matchLen;
+        case InputDfa::None:
+            break;
     }
 
     // Recognize Alt-<character>.
@@ -486,14 +780,25 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
 }
 
 int ConsoleInput::scanMouseInput(std::vector<INPUT_RECORD> &records,
+                                 InputDfa::Kind kind,
                                  const char *input,
-                                 int inputSize)
+                                 int len)
 {
     MouseRecord record;
-    const int len = matchMouseRecord(input, inputSize, record);
-    if (len <= 0) {
-        return len;
+    memset(&record, 0, sizeof(record));
+    int parsedLen = 0;
+    switch (kind) {
+        case InputDfa::Mouse1006:
+            parsedLen = matchMouse1006(input, len, record);
+            break;
+        case InputDfa::Mouse1015:
+            parsedLen = matchMouse1015(input, len, record);
+            break;
+        default:
+            parsedLen = matchMouseDefault(input, len, record);
+            break;
     }
+    ASSERT(parsedLen == len);
 
     if (isTracingEnabled()) {
         static bool debugInput = hasDebugFlag("input");
@@ -592,12 +897,209 @@ int ConsoleInput::scanMouseInput(std::vector<INPUT_RECORD> &records,
             }
         }
 
+        // With any-motion tracking, a mouse drag can send motion reports
+        // much faster than a program handles them.  A run of motion events
+        // with the same buttons and modifiers is reduced to its final
+        // position.  The run only spans the records of this write, so the
+        // position is never delayed.  Clicks, releases, and wheel events
+        // (and their double-click bookkeeping above) are never coalesced.
+        ++m_stats.mouseEvents;
+        if (mer.dwEventFlags == MOUSE_MOVED && !records.empty()) {
+            INPUT_RECORD &last = records.back();
+            const MOUSE_EVENT_RECORD &lastMer = last.Event.MouseEvent;
+            if (last.EventType == MOUSE_EVENT &&
+                    lastMer.dwEventFlags == MOUSE_MOVED &&
+                    lastMer.dwButtonState == mer.dwButtonState &&
+                    lastMer.dwControlKeyState == mer.dwControlKeyState) {
+                last.Event.MouseEvent.dwMousePosition = mer.dwMousePosition;
+                ++m_stats.mouseEventsCoalesced;
+                return len;
+            }
+        }
         records.push_back(newRecord);
     }
 
     return len;
 }
 
+// Decodes the body of a bracketed paste as literal text, through the ESC [ 2
+// 0 1 ~ that ends it.  Control characters and escape sequences in the body
+// are typed as characters.  Returns the number of bytes consumed, which is
+// short of inputSize if the input ends with an incomplete character or with
+// what may be the start of the end marker.
+size_t ConsoleInput::scanPaste(std::vector<INPUT_RECORD> &records,
+                               const char *input,
+                               size_t inputSize,
+                               bool isEof)
+{
+    static const char kPasteEnd[] = "\x1B[201~";
+    const size_t kPasteEndLen = sizeof(kPasteEnd) - 1;
+    if (m_plainTextBuffer.size() < inputSize) {
+        m_plainTextBuffer.resize(inputSize);
+    }
+    size_t idx = 0;
+    while (idx < inputSize) {
+        size_t textLen = 0;
+        idx += m_pasteText.decode(&input[idx], inputSize - idx,
+                                  m_plainTextBuffer.data(), textLen);
+        appendPasteText(records, m_plainTextBuffer.data(), textLen);
+        if (idx == inputSize) {
+            break;
+        }
+        if (input[idx] == '\x1B') {
+            const size_t avail = std::min(inputSize - idx, kPasteEndLen);
+            if (memcmp(&input[idx], kPasteEnd, avail) == 0) {
+                if (avail == kPasteEndLen) {
+                    trace("Bracketed paste ended");
+                    m_inBracketedPaste = false;
+                    if (m_escapeInputEnabled) {
+                        reencodeBracketedPasteMarker(records, false);
+                    }
+                    return idx + kPasteEndLen;
+                }
+                if (!isEof) {
+                    break;
+                }
+            }
+            const uint16_t esc = 0x1B;
+            appendPasteText(records, &esc, 1);
+            ++idx;
+            continue;
+        }
+        const int len = utf8CharLength(input[idx]);
+        if (len > 0 && static_cast<size_t>(len) > inputSize - idx) {
+            // Incomplete character.
+            break;
+        }
+        static bool debugInput = isTracingEnabled() && hasDebugFlag("input");
+        if (debugInput) {
+            trace("Discarding invalid input byte in paste: %02X",
+                static_cast<unsigned char>(input[idx]));
+        }
+        ++idx;
+    }
+    return idx;
+}
+
+void ConsoleInput::appendPasteText(std::vector<INPUT_RECORD> &records,
+                                   const uint16_t *text,
+                                   size_t textLen)
+{
+    if (textLen == 0) {
+        return;
+    }
+    if (m_escapeInputEnabled) {
+        reencodeBracketedPasteText(records, text, textLen);
+    } else {
+        appendTextKeyPresses(records, text, textLen);
+    }
+}
+
+// Converts a run of ordinary text (see PlainTextDecoder) into key presses
+// in bulk.  Returns the number of input bytes consumed.
+size_t ConsoleInput::appendPlainText(std::vector<INPUT_RECORD> &records,
+                                     const char *input,
+                                     size_t inputSize)
+{
+    if (m_plainTextBuffer.size() < inputSize) {
+        m_plainTextBuffer.resize(inputSize);
+    }
+    size_t textLen = 0;
+    const size_t consumed = m_plainText.decode(
+        input, inputSize, m_plainTextBuffer.data(), textLen);
+    if (consumed > 0) {
+        appendTextKeyPresses(records, m_plainTextBuffer.data(), textLen);
+    }
+    return consumed;
+}
+
+// The records are the same ones appendUtf8Char would generate, but VkKeyScan
+// and MapVirtualKey results are cached for the current keyboard layout.  The
+// text has only complete surrogate pairs.
+void ConsoleInput::appendTextKeyPresses(std::vector<INPUT_RECORD> &records,
+                                        const uint16_t *text,
+                                        size_t textLen)
+{
+    const HKL layout = GetKeyboardLayout(0);
+    if (layout != m_keyScanLayout) {
+        m_keyScanLayout = layout;
+        std::fill(&m_asciiKeyScan[0], &m_asciiKeyScan[128], kUnknownKeyScan);
+        m_keyScanCache.clear();
+        std::fill(&m_scanCodes[0], &m_scanCodes[256], kUnknownScanCode);
+    }
+
+    records.reserve(records.size() + textLen * 2);
+    INPUT_RECORD ir = {};
+    ir.EventType = KEY_EVENT;
+    ir.Event.KeyEvent.wRepeatCount = 1;
+    for (size_t i = 0; i < textLen; ++i) {
+        const uint16_t unit = text[i];
+        if (unit >= 0xD800 && unit <= 0xDBFF) {
+            // A character outside the BMP has no virtual key, and its
+            // surrogates are sent down, down, up, up.
+            ir.Event.KeyEvent.wVirtualKeyCode = 0;
+            ir.Event.KeyEvent.wVirtualScanCode = scanCodeForVirtualKey(0);
+            ir.Event.KeyEvent.dwControlKeyState = 0;
+            for (int keyDown = 1; keyDown >= 0; --keyDown) {
+                ir.Event.KeyEvent.bKeyDown = keyDown;
+                ir.Event.KeyEvent.uChar.UnicodeChar = text[i];
+                records.push_back(ir);
+                ir.Event.KeyEvent.uChar.UnicodeChar = text[i + 1];
+                records.push_back(ir);
+            }
+            ++i;
+            continue;
+        }
+        const short charScan = keyScanForChar(unit);
+        uint16_t virtualKey = 0;
+        uint16_t keyState = 0;
+        if (charScan != -1) {
+            virtualKey = charScan & 0xFF;
+            if (charScan & 0x100) { keyState |= SHIFT_PRESSED; }
+            if (charScan & 0x200) { keyState |= LEFT_CTRL_PRESSED; }
+            if (charScan & 0x400) { keyState |= RIGHT_ALT_PRESSED; }
+        }
+        if (keyState != 0) {
+            // Shifted and AltGr characters need modifier key events.
+            appendKeyPress(records, virtualKey, unit, unit, keyState, unit, 0);
+            continue;
+        }
+        ir.Event.KeyEvent.wVirtualKeyCode = virtualKey;
+        ir.Event.KeyEvent.wVirtualScanCode = scanCodeForVirtualKey(virtualKey);
+        ir.Event.KeyEvent.uChar.UnicodeChar = unit;
+        ir.Event.KeyEvent.dwControlKeyState = 0;
+        ir.Event.KeyEvent.bKeyDown = TRUE;
+        records.push_back(ir);
+        ir.Event.KeyEvent.bKeyDown = FALSE;
+        records.push_back(ir);
+    }
+}
+
+short ConsoleInput::keyScanForChar(uint16_t ch)
+{
+    if (ch < 128) {
+        short &cached = m_asciiKeyScan[ch];
+        if (cached == kUnknownKeyScan) {
+            cached = VkKeyScan(ch);
+        }
+        return cached;
+    }
+    auto it = m_keyScanCache.find(ch);
+    if (it == m_keyScanCache.end()) {
+        it = m_keyScanCache.insert(std::make_pair(ch, VkKeyScan(ch))).first;
+    }
+    return it->second;
+}
+
+uint16_t ConsoleInput::scanCodeForVirtualKey(uint16_t virtualKey)
+{
+    uint16_t &cached = m_scanCodes[virtualKey & 0xFF];
+    if (cached == kUnknownScanCode) {
+        cached = MapVirtualKey(virtualKey, MAPVK_VK_TO_VSC);
+    }
+    return cached;
+}
+
 void ConsoleInput::appendUtf8Char(std::vector<INPUT_RECORD> &records,
                                   const char *charBuffer,
                                   const int charLen,
@@ -690,6 +1192,7 @@ void ConsoleInput::appendKeyPress(std::vector<INPUT_RECORD> &records,
                 virtualKey == VK_END) &&
             !ctrl && !leftAlt && !rightAlt && !shift) {
         flushInputRecords(records);
+        drainInputQueue();
         if (hasDebugInput) {
             trace("sending keypress to console HWND");
         }
@@ -24,12 +24,17 @@
 #include <windows.h>
 #include <stdint.h>
 
+#include <deque>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "CompactingByteBuffer.h"
 #include "Coord.h"
-#include "InputMap.h"
+#include "InputDfa.h"
+#include "LatencyHistogram.h"
+#include "PlainTextDecoder.h"
 #include "SmallRect.h"
 
 class Win32Console;
@@ -38,24 +43,73 @@ class DsrSender;
 class ConsoleInput
 {
 public:
-    ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
-                 Win32Console &console);
-    void writeInput(const std::string &input);
+    ConsoleInput(HANDLE conin, int mouseMode, int inputQueueLimit,
+                 int escapeTimeoutMs, bool loneEscIsKey,
+                 DsrSender &dsrSender, Win32Console &console);
+    void writeInput(const char *input, size_t size);
+    size_t extractCtrlC(char *input, size_t size);
     void flushIncompleteEscapeCode();
+    int escapeFlushDelayMs();
+    void injectQueuedInput();
+    bool hasQueuedInput() const {
+        return m_injectQueueStart < m_injectQueue.size();
+    }
+    bool isInputQueueFull() const {
+        return m_inputQueueLimit != 0 &&
+            m_injectQueue.size() - m_injectQueueStart >= m_inputQueueLimit;
+    }
+
+    // Cumulative counts for winpty_get_stats.
+    struct Stats {
+        uint64_t mouseEvents = 0;
+        uint64_t mouseEventsCoalesced = 0;
+        // Microseconds from input arriving on CONIN until its records are
+        // written to the console, and from then until the next scrape that
+        // sends output (normally the echo).
+        LatencyHistogram inputToInject;
+        LatencyHistogram injectToEcho;
+    };
+    const Stats &stats() const { return m_stats; }
+    bool noteOutputSent(int64_t &inputToInjectUs, int64_t &injectToEchoUs);
     void setMouseWindowRect(SmallRect val) { m_mouseWindowRect = val; }
     void updateInputFlags(bool forceTrace=false);
     bool shouldActivateTerminalMouse();
 
 private:
-    void doWrite(bool isEof);
+    size_t doWrite(const char *data, size_t size, bool isEof);
+    DWORD flushTimeoutMs() const;
+    size_t pendingInputLength(const char *input,
+                              size_t inputSize,
+                              bool &inPaste) const;
+    void generateCtrlC();
     void flushInputRecords(std::vector<INPUT_RECORD> &records);
+    void writeConsoleInput(const INPUT_RECORD *records, size_t count);
+    void drainInputQueue();
+    void retireInjectMarks();
+    void noteInjected(int64_t arrivalUs);
     int scanInput(std::vector<INPUT_RECORD> &records,
                   const char *input,
                   int inputSize,
                   bool isEof);
     int scanMouseInput(std::vector<INPUT_RECORD> &records,
+                       InputDfa::Kind kind,
                        const char *input,
-                       int inputSize);
+                       int len);
+    size_t scanPaste(std::vector<INPUT_RECORD> &records,
+                     const char *input,
+                     size_t inputSize,
+                     bool isEof);
+    void appendPasteText(std::vector<INPUT_RECORD> &records,
+                         const uint16_t *text,
+                         size_t textLen);
+    size_t appendPlainText(std::vector<INPUT_RECORD> &records,
+                           const char *input,
+                           size_t inputSize);
+    void appendTextKeyPresses(std::vector<INPUT_RECORD> &records,
+                              const uint16_t *text,
+                              size_t textLen);
+    short keyScanForChar(uint16_t ch);
+    uint16_t scanCodeForVirtualKey(uint16_t virtualKey);
     void appendUtf8Char(std::vector<INPUT_RECORD> &records,
                         const char *charBuffer,
                         int charLen,
@@ -89,8 +143,39 @@ private:
     int m_mouseMode = 0;
     DsrSender &m_dsrSender;
     bool m_dsrSent = false;
-    std::string m_byteQueue;
-    InputMap m_inputMap;
+    // Bytes of an incomplete sequence, waiting for the rest of it.
+    CompactingByteBuffer m_byteQueue;
+    // Reused by doWrite, so decoding doesn't allocate on every write.
+    std::vector<INPUT_RECORD> m_records;
+    DWORD m_escapeTimeoutMs = 0;
+    bool m_loneEscIsKey = false;
+    // Records waiting for room in the console input buffer.  Records before
+    // m_injectQueueStart have been written already.
+    size_t m_inputQueueLimit = 0;
+    std::vector<INPUT_RECORD> m_injectQueue;
+    size_t m_injectQueueStart = 0;
+    // Latency bookkeeping.  m_byteQueueArrivalUs is when the oldest byte in
+    // m_byteQueue arrived.  Each batch in the injection queue has a mark
+    // with the sequence number of its first record and its arrival time.
+    int64_t m_byteQueueArrivalUs = 0;
+    std::deque<std::pair<uint64_t, int64_t>> m_injectMarks;
+    uint64_t m_recordsQueued = 0;
+    uint64_t m_recordsInjected = 0;
+    bool m_echoPending = false;
+    int64_t m_echoArrivalUs = 0;
+    int64_t m_echoInjectUs = 0;
+    InputDfa m_inputDfa;
+    PlainTextDecoder m_plainText;
+    PlainTextDecoder m_pasteText;
+    std::vector<uint16_t> m_plainTextBuffer;
+    bool m_inBracketedPaste = false;
+    // Caches of VkKeyScan and MapVirtualKey for m_keyScanLayout.
+    enum : short { kUnknownKeyScan = 0x7FFF };
+    enum : uint16_t { kUnknownScanCode = 0xFFFF };
+    HKL m_keyScanLayout = nullptr;
+    short m_asciiKeyScan[128];
+    std::unordered_map<uint16_t, short> m_keyScanCache;
+    uint16_t m_scanCodes[256];
     DWORD m_lastWriteTick = 0;
     DWORD m_mouseButtonState = 0;
     struct DoubleClickDetection {
@@ -104,6 +189,7 @@ private:
     bool m_quickEditEnabled = false;
     bool m_escapeInputEnabled = false;
     SmallRect m_mouseWindowRect;
+    Stats m_stats;
 };
 
 #endif // CONSOLEINPUT_H
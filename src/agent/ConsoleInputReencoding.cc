@@ -119,3 +119,22 @@ void reencodeEscapedKeyPress(
         ConsoleInput::appendCPInputRecords(out, TRUE, 0, codePoint, 0);
     }
 }
+
+// A bracketed paste is passed to a console in VT input mode as the terminal
+// sent it: the markers around the literal text.
+void reencodeBracketedPasteMarker(
+        std::vector<INPUT_RECORD> &out,
+        bool begin) {
+    for (const char *pch = begin ? "\x1b[200~" : "\x1b[201~"; *pch; ++pch) {
+        outch(out, *pch);
+    }
+}
+
+void reencodeBracketedPasteText(
+        std::vector<INPUT_RECORD> &out,
+        const uint16_t *text,
+        size_t textLen) {
+    for (size_t i = 0; i < textLen; ++i) {
+        outch(out, text[i]);
+    }
+}
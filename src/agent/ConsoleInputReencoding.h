@@ -33,4 +33,13 @@ void reencodeEscapedKeyPress(
     uint32_t codePoint,
     uint16_t keyState);
 
+void reencodeBracketedPasteMarker(
+    std::vector<INPUT_RECORD> &records,
+    bool begin);
+
+void reencodeBracketedPasteText(
+    std::vector<INPUT_RECORD> &records,
+    const uint16_t *text,
+    size_t textLen);
+
 #endif // AGENT_CONSOLE_INPUT_REENCODING_H
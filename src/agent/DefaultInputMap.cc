@@ -20,7 +20,6 @@
 
 #include "DefaultInputMap.h"
 
-#include <windows.h>
 #include <string.h>
 
 #include <algorithm>
@@ -28,6 +27,7 @@
 #include "../shared/StringBuilder.h"
 #include "../shared/WinptyAssert.h"
 #include "InputMap.h"
+#include "VirtualKeys.h"
 
 #define ESC "\x1B"
 #define DIM(x) (sizeof(x) / sizeof((x)[0]))
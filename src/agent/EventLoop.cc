@@ -37,10 +37,18 @@ EventLoop::~EventLoop() {
 void EventLoop::run()
 {
     std::vector<HANDLE> waitHandles;
-    DWORD lastTime = GetTickCount();
     while (!m_exiting) {
         bool didSomething = false;
 
+        // Delete the pipes that were destroyed since the last pass.  A
+        // handler may destroy a pipe while the loop below is walking the
+        // list, so they aren't deleted right away.
+        for (NamedPipe *pipe : m_destroyedPipes) {
+            m_pipes.erase(std::find(m_pipes.begin(), m_pipes.end(), pipe));
+            delete pipe;
+        }
+        m_destroyedPipes.clear();
+
         // Attempt to make progress with the pipes.
         waitHandles.clear();
         for (size_t i = 0; i < m_pipes.size(); ++i) {
@@ -50,23 +58,43 @@ void EventLoop::run()
             }
         }
 
-        // Call the timeout if enough time has elapsed.
-        if (m_pollInterval > 0) {
-            int elapsed = GetTickCount() - lastTime;
-            if (elapsed >= m_pollInterval) {
+        // Dispatch registered handles that have become signaled.  Take a
+        // copy, because a handler may add or remove handles.
+        if (!m_waitHandles.empty()) {
+            const std::vector<HANDLE> handles = m_waitHandles;
+            for (HANDLE handle : handles) {
+                if (m_exiting) {
+                    break;
+                }
+                if (std::find(m_waitHandles.begin(), m_waitHandles.end(),
+                              handle) != m_waitHandles.end() &&
+                        WaitForSingleObject(handle, 0) == WAIT_OBJECT_0) {
+                    removeWaitHandle(handle);
+                    onWaitHandleSignaled(handle);
+                    didSomething = true;
+                }
+            }
+            waitHandles.insert(waitHandles.end(),
+                               m_waitHandles.begin(), m_waitHandles.end());
+        }
+
+        // Run every timer that is due.
+        int timerId = -1;
+        while (!m_exiting && m_timers.popDue(GetTickCount(), timerId)) {
+            if (timerId == m_pollTimer) {
                 onPollTimeout();
-                lastTime = GetTickCount();
-                didSomething = true;
+            } else {
+                onTimer(timerId);
             }
+            didSomething = true;
         }
 
         if (didSomething)
             continue;
 
-        // If there's nothing to do, wait.
-        DWORD timeout = INFINITE;
-        if (m_pollInterval > 0)
-            timeout = std::max(0, (int)(lastTime + m_pollInterval - GetTickCount()));
+        // If there's nothing to do, wait until the next timer deadline or
+        // until a pipe or registered handle is signaled.
+        const DWORD timeout = m_timers.timeUntilNext(GetTickCount());
         if (waitHandles.size() == 0) {
             ASSERT(timeout != INFINITE);
             if (timeout > 0)
@@ -88,12 +116,64 @@ NamedPipe &EventLoop::createNamedPipe()
     return *ret;
 }
 
+// Close the pipe and stop servicing it.  The object is deleted later, but
+// the caller must not use it again.
+void EventLoop::destroyNamedPipe(NamedPipe &pipe)
+{
+    ASSERT(std::find(m_pipes.begin(), m_pipes.end(), &pipe) != m_pipes.end());
+    ASSERT(std::find(m_destroyedPipes.begin(), m_destroyedPipes.end(),
+                     &pipe) == m_destroyedPipes.end());
+    pipe.closePipe();
+    m_destroyedPipes.push_back(&pipe);
+}
+
+// The poll interval is a periodic timer that calls onPollTimeout.
 void EventLoop::setPollInterval(int ms)
 {
-    m_pollInterval = ms;
+    if (m_pollTimer == -1) {
+        m_pollTimer = m_timers.createTimer();
+    }
+    if (ms > 0) {
+        startTimer(m_pollTimer, ms, ms);
+    } else {
+        stopTimer(m_pollTimer);
+    }
+}
+
+void EventLoop::addWaitHandle(HANDLE handle)
+{
+    ASSERT(handle != nullptr);
+    ASSERT(std::find(m_waitHandles.begin(), m_waitHandles.end(), handle) ==
+           m_waitHandles.end());
+    // The pipes need some of WaitForMultipleObjects' 64 slots too.
+    ASSERT(m_waitHandles.size() < 32);
+    m_waitHandles.push_back(handle);
+}
+
+void EventLoop::removeWaitHandle(HANDLE handle)
+{
+    m_waitHandles.erase(
+        std::remove(m_waitHandles.begin(), m_waitHandles.end(), handle),
+        m_waitHandles.end());
 }
 
 void EventLoop::shutdown()
 {
     m_exiting = true;
 }
+
+int EventLoop::createTimer()
+{
+    return m_timers.createTimer();
+}
+
+void EventLoop::startTimer(int id, DWORD delayMs, DWORD periodMs,
+                           DWORD slackMs)
+{
+    m_timers.start(id, GetTickCount(), delayMs, periodMs, slackMs);
+}
+
+void EventLoop::stopTimer(int id)
+{
+    m_timers.stop(id);
+}
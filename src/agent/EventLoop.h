@@ -21,8 +21,12 @@
 #ifndef EVENTLOOP_H
 #define EVENTLOOP_H
 
+#include <windows.h>
+
 #include <vector>
 
+#include "TimerQueue.h"
+
 class NamedPipe;
 
 class EventLoop
@@ -33,15 +37,36 @@ public:
 
 protected:
     NamedPipe &createNamedPipe();
+    void destroyNamedPipe(NamedPipe &pipe);
     void setPollInterval(int ms);
     void shutdown();
     virtual void onPollTimeout()                    {}
     virtual void onPipeIo(NamedPipe &namedPipe)     {}
 
+    // Timers run at their own frequencies, independent of the poll
+    // interval.  See TimerQueue for the meaning of the arguments.
+    int createTimer();
+    void startTimer(int id, DWORD delayMs, DWORD periodMs=0, DWORD slackMs=0);
+    void stopTimer(int id);
+    bool isTimerActive(int id) { return m_timers.isActive(id); }
+    virtual void onTimer(int id)                    {}
+
+    // Wait on an arbitrary kernel object (e.g. a process handle).  When the
+    // handle becomes signaled, the loop unregisters it and calls
+    // onWaitHandleSignaled.  The caller must unregister the handle before
+    // closing it.
+    void addWaitHandle(HANDLE handle);
+    void removeWaitHandle(HANDLE handle);
+    virtual void onWaitHandleSignaled(HANDLE handle) {}
+
 private:
     bool m_exiting = false;
     std::vector<NamedPipe*> m_pipes;
-    int m_pollInterval = 0;
+    // Closed pipes waiting to be deleted between passes over m_pipes.
+    std::vector<NamedPipe*> m_destroyedPipes;
+    std::vector<HANDLE> m_waitHandles;
+    TimerQueue m_timers;
+    int m_pollTimer = -1;
 };
 
 #endif // EVENTLOOP_H
@@ -0,0 +1,153 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Generates DefaultInputTables.h, which holds the default input map, frozen,
+// and the input DFA compiled from it, as static data.  The build runs this
+// program, so the agent doesn't spend its startup expanding the escape
+// sequence tables and compiling the DFA.  It's built with the host
+// compiler, which may not target Windows (e.g. when cross-compiling with
+// MinGW), so it doesn't use windows.h or the agent's debug tracing.
+//
+// Usage: GenInputTables <output-header>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "DefaultInputMap.h"
+#include "InputDfa.h"
+#include "InputMap.h"
+
+void agentShutdown() {}
+void agentAssertFail(const char *file, int line, const char *cond) {
+    fprintf(stderr, "Assertion failed: %s, %s:%d\n", cond, file, line);
+    abort();
+}
+
+namespace {
+
+// Writes `count` values formatted by `fmt` as the body of an array
+// initializer, several to a line.
+template <typename T, typename F>
+void writeArray(FILE *out, const char *type, const char *name,
+                const T *values, size_t count, int perLine, F fmt) {
+    fprintf(out, "static const %s %s[] = {", type, name);
+    for (size_t i = 0; i < count; ++i) {
+        fputs(i % perLine == 0 ? "\n   " : "", out);
+        fputc(' ', out);
+        fmt(values[i]);
+        fputc(',', out);
+    }
+    fputs("\n};\n\n", out);
+}
+
+void writeKeys(FILE *out, const char *name,
+               const InputMap::Key *keys, size_t count) {
+    writeArray(out, "InputMap::Key", name, keys, count, 3,
+        [&](const InputMap::Key &k) {
+            fprintf(out, "{ 0x%x, 0x%x, 0x%x }",
+                    k.virtualKey, static_cast<unsigned int>(k.unicodeChar),
+                    k.keyState);
+        });
+}
+
+void writeUInt16s(FILE *out, const char *name,
+                  const uint16_t *values, size_t count) {
+    writeArray(out, "uint16_t", name, values, count, 12,
+        [&](uint16_t v) { fprintf(out, "%u", v); });
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <output-header>\n", argv[0]);
+        return 1;
+    }
+
+    InputMap inputMap;
+    addDefaultEntriesToInputMap(inputMap);
+    inputMap.freeze();
+    InputDfa dfa;
+    dfa.compile(inputMap);
+    const InputMap::FrozenTables &map = inputMap.frozenTables();
+    const InputDfa::Tables &t = dfa.tables();
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL) {
+        fprintf(stderr, "error: could not open %s\n", argv[1]);
+        return 1;
+    }
+    fputs("// Generated by GenInputTables from DefaultInputMap.cc.  "
+          "Do not edit.\n"
+          "// Include it after InputDfa.h.\n\n", out);
+
+    writeArray(out, "InputMap::FrozenNode", "kDefaultInputMapNodes",
+               map.nodes, map.nodeCount, 4,
+        [&](const InputMap::FrozenNode &n) {
+            fprintf(out, "{ %u, %u, %u, %u }",
+                    n.firstChild, n.childCount, n.keyIndex, n.wideIndex);
+        });
+    writeArray(out, "unsigned char", "kDefaultInputMapBytes",
+               map.bytes, map.nodeCount, 12,
+        [&](unsigned char ch) { fprintf(out, "0x%02x", ch); });
+    writeKeys(out, "kDefaultInputMapKeys", map.keys, map.keyCount);
+    writeUInt16s(out, "kDefaultInputMapWide", map.wide, map.wideCount);
+    fprintf(out,
+        "static const InputMap::FrozenTables kDefaultInputMap = {\n"
+        "    kDefaultInputMapNodes, %u,\n"
+        "    kDefaultInputMapBytes,\n"
+        "    kDefaultInputMapKeys, %u,\n"
+        "    kDefaultInputMapWide, %u,\n"
+        "};\n\n",
+        static_cast<unsigned int>(map.nodeCount),
+        static_cast<unsigned int>(map.keyCount),
+        static_cast<unsigned int>(map.wideCount));
+
+    writeArray(out, "unsigned char", "kDefaultInputDfaByteClass",
+               t.byteClass, 256, 12,
+        [&](unsigned char c) { fprintf(out, "%u", c); });
+    writeUInt16s(out, "kDefaultInputDfaNext", t.next, t.nextCount);
+    writeArray(out, "InputDfa::StateInfo", "kDefaultInputDfaStates",
+               t.states, t.stateCount, 4,
+        [&](const InputDfa::StateInfo &s) {
+            fprintf(out, "{ %u, 0x%02x, 0x%02x }", s.key, s.accept, s.live);
+        });
+    writeKeys(out, "kDefaultInputDfaKeys", t.keys, t.keyCount);
+    fprintf(out,
+        "static const InputDfa::Tables kDefaultInputDfa = {\n"
+        "    kDefaultInputDfaByteClass,\n"
+        "    %d, %d, %d, %u,\n"
+        "    kDefaultInputDfaNext, %u,\n"
+        "    kDefaultInputDfaStates, %u,\n"
+        "    kDefaultInputDfaKeys, %u,\n"
+        "};\n",
+        t.classCount, t.firstMatchState, t.firstFinalState, t.finalCodeBase,
+        static_cast<unsigned int>(t.nextCount),
+        static_cast<unsigned int>(t.stateCount),
+        static_cast<unsigned int>(t.keyCount));
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "error: could not write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
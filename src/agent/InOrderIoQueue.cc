@@ -0,0 +1,85 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "InOrderIoQueue.h"
+
+#include "../shared/WinptyAssert.h"
+
+InOrderIoQueue::InOrderIoQueue(size_t depth) : m_slots(depth)
+{
+    ASSERT(depth >= 1);
+}
+
+size_t InOrderIoQueue::slotAt(size_t i) const
+{
+    ASSERT(i < m_count);
+    return (m_head + i) % m_slots.size();
+}
+
+size_t InOrderIoQueue::nextSlot() const
+{
+    ASSERT(!full());
+    return (m_head + m_count) % m_slots.size();
+}
+
+size_t InOrderIoQueue::issue()
+{
+    const size_t slot = nextSlot();
+    m_slots[slot] = SlotState();
+    ++m_count;
+    return slot;
+}
+
+void InOrderIoQueue::complete(size_t slot, uint32_t result)
+{
+    ASSERT(slot < m_slots.size());
+    ASSERT(!m_slots[slot].complete && "I/O slot completed twice");
+    m_slots[slot].complete = true;
+    m_slots[slot].result = result;
+}
+
+bool InOrderIoQueue::isComplete(size_t slot) const
+{
+    ASSERT(slot < m_slots.size());
+    return m_slots[slot].complete;
+}
+
+bool InOrderIoQueue::retire(size_t &slotOut, uint32_t &resultOut)
+{
+    if (m_count == 0 || !m_slots[m_head].complete) {
+        return false;
+    }
+    slotOut = m_head;
+    resultOut = m_slots[m_head].result;
+    m_slots[m_head] = SlotState();
+    m_head = (m_head + 1) % m_slots.size();
+    --m_count;
+    return true;
+}
+
+void InOrderIoQueue::clear()
+{
+    for (auto &state : m_slots) {
+        state = SlotState();
+    }
+    m_head = 0;
+    m_count = 0;
+}
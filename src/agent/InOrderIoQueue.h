@@ -0,0 +1,77 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_IN_ORDER_IO_QUEUE_H
+#define AGENT_IN_ORDER_IO_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Bookkeeping for up to `depth` outstanding I/O operations on one stream.
+// Operations are issued into slots in a fixed ring, may finish in any order,
+// and are retired strictly in the order they were issued, so the bytes they
+// carry are delivered in stream order.  The caller owns whatever goes with
+// each slot (e.g. an OVERLAPPED and a buffer), indexed by slot number.
+//
+// This class doesn't depend on windows.h, so it can be tested anywhere.
+class InOrderIoQueue {
+public:
+    explicit InOrderIoQueue(size_t depth);
+
+    size_t depth() const { return m_slots.size(); }
+    size_t inFlight() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    bool full() const { return m_count == m_slots.size(); }
+
+    // Returns the slot of the i'th oldest outstanding operation.
+    size_t slotAt(size_t i) const;
+
+    // The slot that the next issue() call will return.
+    size_t nextSlot() const;
+
+    // Reserves the next slot for a new operation and returns it.
+    size_t issue();
+
+    // Records that the operation in `slot` finished with `result` (e.g. a
+    // byte count).
+    void complete(size_t slot, uint32_t result);
+    bool isComplete(size_t slot) const;
+
+    // If the oldest outstanding operation has finished, removes it, returns
+    // its slot and result, and returns true.  Otherwise, returns false.
+    bool retire(size_t &slotOut, uint32_t &resultOut);
+
+    // Forgets every outstanding operation (e.g. after cancelling them).
+    void clear();
+
+private:
+    struct SlotState {
+        bool complete = false;
+        uint32_t result = 0;
+    };
+    std::vector<SlotState> m_slots;
+    size_t m_head = 0;
+    size_t m_count = 0;
+};
+
+#endif // AGENT_IN_ORDER_IO_QUEUE_H
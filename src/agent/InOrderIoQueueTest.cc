@@ -0,0 +1,187 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests for InOrderIoQueue.  A simulated overlapped pipe finishes operations
+// in random order, and the output side mirrors NamedPipe::OutputWorker by
+// writing straight out of a ChunkedByteQueue.  Build with InOrderIoQueue.cc,
+// ChunkedByteQueue.cc, and -DWINPTY_AGENT_ASSERT.
+
+#include "InOrderIoQueue.h"
+#include "ChunkedByteQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+static void testBasics() {
+    InOrderIoQueue queue(3);
+    size_t slot = 0;
+    uint32_t result = 0;
+    CHECK(queue.empty() && !queue.retire(slot, result));
+    const size_t a = queue.issue();
+    const size_t b = queue.issue();
+    const size_t c = queue.issue();
+    CHECK(queue.full() && queue.inFlight() == 3);
+    CHECK(queue.slotAt(0) == a && queue.slotAt(2) == c);
+    queue.complete(c, 30);
+    queue.complete(b, 20);
+    CHECK(!queue.retire(slot, result));
+    queue.complete(a, 10);
+    CHECK(queue.retire(slot, result) && slot == a && result == 10);
+    // The freed slot is reused at the back of the ring.
+    CHECK(queue.nextSlot() == a);
+    CHECK(queue.issue() == a);
+    CHECK(queue.retire(slot, result) && slot == b && result == 20);
+    CHECK(queue.retire(slot, result) && slot == c && result == 30);
+    CHECK(!queue.retire(slot, result) && queue.inFlight() == 1);
+    queue.clear();
+    CHECK(queue.empty());
+}
+
+// Each slot's write, as the simulated pipe sees it.
+struct SimulatedWrite {
+    const char *buffer;
+    size_t size;
+};
+
+// Streams `total` bytes through a ChunkedByteQueue with `depth` writes in
+// flight.  The "pipe" copies each write's buffer at a random later time and
+// finishes writes out of order, so it checks that buffers stay valid while
+// in flight and that consumption happens in stream order.
+static void testOutputStream(size_t depth, size_t total, unsigned int seed) {
+    srand(seed);
+    const size_t kIoSize = 64 * 1024;
+    std::string source(total, '\0');
+    for (size_t i = 0; i < total; ++i) {
+        source[i] = static_cast<char>(rand());
+    }
+    ChunkedByteQueue out;
+    InOrderIoQueue queue(depth);
+    std::vector<SimulatedWrite> writes(depth);
+    std::vector<std::string> captured(depth);
+    std::string received;
+    size_t appended = 0;
+    size_t bytesInFlight = 0;
+    size_t maxInFlight = 0;
+
+    while (received.size() < total) {
+        // The Terminal appends output at arbitrary times.
+        if (appended < total && rand() % 2 == 0) {
+            const size_t amount =
+                std::min<size_t>(1 + rand() % 200000, total - appended);
+            out.append(&source[appended], amount);
+            appended += amount;
+        }
+        // Issue as many writes as the depth allows.
+        while (!queue.full()) {
+            size_t available = 0;
+            const char *data = out.dataAt(bytesInFlight, available);
+            if (available == 0) {
+                break;
+            }
+            const size_t slot = queue.issue();
+            writes[slot].buffer = data;
+            writes[slot].size = std::min(available, kIoSize);
+            captured[slot].clear();
+            bytesInFlight += writes[slot].size;
+        }
+        maxInFlight = std::max(maxInFlight, queue.inFlight());
+        // Finish one random outstanding write.
+        if (!queue.empty()) {
+            const size_t slot = queue.slotAt(rand() % queue.inFlight());
+            if (!queue.isComplete(slot)) {
+                captured[slot].assign(writes[slot].buffer, writes[slot].size);
+                queue.complete(slot, writes[slot].size);
+            }
+        }
+        // Retire in order, as IoWorker::retireCompletedIo does.
+        size_t slot = 0;
+        uint32_t actual = 0;
+        while (queue.retire(slot, actual)) {
+            CHECK(actual == writes[slot].size);
+            received += captured[slot];
+            out.consume(actual);
+            bytesInFlight -= actual;
+        }
+    }
+    CHECK(received == source);
+    CHECK(out.empty() && bytesInFlight == 0);
+    CHECK(maxInFlight == depth);
+}
+
+// Reads complete out of order, but the bytes must be appended in the order
+// the reads were issued.
+static void testInputStream(size_t depth, unsigned int seed) {
+    srand(seed);
+    InOrderIoQueue queue(depth);
+    std::vector<std::string> buffers(depth);
+    std::string pipeData;
+    for (int i = 0; i < 100000; ++i) {
+        pipeData.push_back(static_cast<char>(rand()));
+    }
+    size_t pipePos = 0;
+    std::string received;
+    while (received.size() < pipeData.size()) {
+        while (!queue.full()) {
+            queue.issue();
+        }
+        // The pipe satisfies pending reads in issue order, but the event
+        // loop may notice their completion in any order.
+        for (size_t i = 0; i < queue.inFlight(); ++i) {
+            const size_t slot = queue.slotAt(i);
+            if (!queue.isComplete(slot) && rand() % 3 == 0) {
+                // Complete every earlier read first, as the pipe would.
+                for (size_t j = 0; j <= i; ++j) {
+                    const size_t earlier = queue.slotAt(j);
+                    if (!queue.isComplete(earlier)) {
+                        const size_t amount = std::min<size_t>(
+                            1 + rand() % 5000, pipeData.size() - pipePos);
+                        buffers[earlier] = pipeData.substr(pipePos, amount);
+                        pipePos += amount;
+                        queue.complete(earlier, amount);
+                    }
+                }
+            }
+        }
+        size_t slot = 0;
+        uint32_t actual = 0;
+        while (queue.retire(slot, actual)) {
+            CHECK(actual == buffers[slot].size());
+            received += buffers[slot];
+        }
+    }
+    CHECK(received == pipeData);
+}
+
+int main() {
+    testBasics();
+    for (size_t depth = 1; depth <= 8; depth *= 2) {
+        testOutputStream(depth, 4 * 1024 * 1024, depth);
+        testInputStream(depth, depth);
+    }
+    return unitTestResult();
+}
@@ -0,0 +1,456 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "InputDfa.h"
+
+#include <string.h>
+
+#include <map>
+#include <utility>
+
+#include "../shared/WinptyAssert.h"
+
+namespace {
+
+// The DSR, mouse, and paste sequences are described by short patterns.  Each pattern
+// element is a byte from a set, any byte, or a decimal integer of at most
+// kMaxDigits digits (optionally negative).
+enum ElementType { kLiteral, kAnyByte, kInteger, kSignedInteger };
+
+struct PatternElement {
+    ElementType type;
+    const char *chars;
+};
+
+struct Pattern {
+    int acceptBit;
+    const PatternElement *elements;
+    int count;
+};
+
+const int kMaxDigits = 7;
+
+#define ESC "\x1B"
+#define DIM(x) (sizeof(x) / sizeof((x)[0]))
+
+// ESC [ nn ; mm R
+const PatternElement kDsrPattern[] = {
+    { kLiteral, ESC }, { kLiteral, "[" }, { kInteger, nullptr },
+    { kLiteral, ";" }, { kInteger, nullptr }, { kLiteral, "R" },
+};
+
+// ESC [ < flags ; x ; y M/m
+const PatternElement kMouse1006Pattern[] = {
+    { kLiteral, ESC }, { kLiteral, "[" }, { kLiteral, "<" },
+    { kInteger, nullptr }, { kLiteral, ";" },
+    { kSignedInteger, nullptr }, { kLiteral, ";" },
+    { kSignedInteger, nullptr }, { kLiteral, "Mm" },
+};
+
+// ESC [ flags ; x ; y M
+const PatternElement kMouse1015Pattern[] = {
+    { kLiteral, ESC }, { kLiteral, "[" }, { kInteger, nullptr },
+    { kLiteral, ";" }, { kSignedInteger, nullptr }, { kLiteral, ";" },
+    { kSignedInteger, nullptr }, { kLiteral, "M" },
+};
+
+// ESC [ M flags x y
+const PatternElement kMouseDefaultPattern[] = {
+    { kLiteral, ESC }, { kLiteral, "[" }, { kLiteral, "M" },
+    { kAnyByte, nullptr }, { kAnyByte, nullptr }, { kAnyByte, nullptr },
+};
+
+// ESC [ 2 0 0 ~ (the start of a bracketed paste)
+const PatternElement kPasteBeginPattern[] = {
+    { kLiteral, ESC }, { kLiteral, "[" }, { kLiteral, "2" },
+    { kLiteral, "0" }, { kLiteral, "0" }, { kLiteral, "~" },
+};
+
+// The order matches the sub-state slots in a ProductState.
+const Pattern kPatterns[] = {
+    { 0x01, kDsrPattern, DIM(kDsrPattern) },
+    { 0x02, kMouse1006Pattern, DIM(kMouse1006Pattern) },
+    { 0x04, kMouse1015Pattern, DIM(kMouse1015Pattern) },
+    { 0x08, kMouseDefaultPattern, DIM(kMouseDefaultPattern) },
+    { 0x10, kPasteBeginPattern, DIM(kPasteBeginPattern) },
+};
+
+// A pattern's position is encoded in a byte: 0 is dead, 1 means the pattern
+// has just matched, and otherwise it is 2 + element * 16 + progress.  For an
+// integer element, progress is the number of digits read so far, or
+// kMinusRead after a leading minus sign.
+const int kPatternDead = 0;
+const int kPatternAccepted = 1;
+const int kMinusRead = 8;
+
+static inline int patternPosition(const Pattern &p, int element,
+                                  int progress) {
+    return element == p.count ? kPatternAccepted :
+                                2 + element * 16 + progress;
+}
+
+static inline bool isDigit(unsigned char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+static int stepPatternElement(const Pattern &p, int element, int progress,
+                              unsigned char ch) {
+    const PatternElement &e = p.elements[element];
+    switch (e.type) {
+        case kLiteral:
+            return ch != '\0' && strchr(e.chars, ch) != nullptr ?
+                patternPosition(p, element + 1, 0) : kPatternDead;
+        case kAnyByte:
+            return patternPosition(p, element + 1, 0);
+        case kInteger:
+        case kSignedInteger:
+            if (progress == 0 && e.type == kSignedInteger && ch == '-') {
+                return patternPosition(p, element, kMinusRead);
+            }
+            if (progress == 0 || progress == kMinusRead) {
+                return isDigit(ch) ?
+                    patternPosition(p, element, 1) : kPatternDead;
+            }
+            if (isDigit(ch)) {
+                return progress < kMaxDigits ?
+                    patternPosition(p, element, progress + 1) : kPatternDead;
+            }
+            // The integer ends at the first non-digit, which must begin the
+            // next element.  No pattern ends with an integer.
+            return stepPatternElement(p, element + 1, 0, ch);
+    }
+    ASSERT(false && "invalid pattern element type");
+    return kPatternDead;
+}
+
+static inline int stepPattern(const Pattern &p, int position,
+                              unsigned char ch) {
+    if (position == kPatternDead || position == kPatternAccepted) {
+        return kPatternDead;
+    }
+    return stepPatternElement(p, (position - 2) / 16, (position - 2) % 16, ch);
+}
+
+const int kPatternCount = DIM(kPatterns);
+
+// A state of the DFA under construction: the frozen InputMap trie node (or
+// -1) and every pattern's position, packed one per byte.
+typedef std::pair<int, uint64_t> ProductState;
+
+static uint64_t packPositions(const int *pos) {
+    uint64_t ret = 0;
+    for (int i = 0; i < kPatternCount; ++i) {
+        ret |= static_cast<uint64_t>(pos[i]) << (i * 8);
+    }
+    return ret;
+}
+
+} // anonymous namespace
+
+void InputDfa::compile(const InputMap &inputMap) {
+    ASSERT(inputMap.isFrozen());
+    m_next.clear();
+    m_states.clear();
+    m_keys.clear();
+    Tables &t = m_tables;
+    t = Tables();
+    std::vector<StateInfo> infos;
+    std::vector<int> rowOf;     // offset into fullNext, or -1 if no exits
+
+    // Subset construction.  Every pattern and the trie are deterministic, so
+    // a DFA state is simply the tuple of their states.  Transitions are first
+    // recorded for all 256 bytes, then compressed into byte classes.
+    std::vector<ProductState> pending;
+    std::map<ProductState, int> stateIds;
+    std::vector<int> fullNext;
+    auto stateId = [&](const ProductState &state) -> int {
+        auto it = stateIds.find(state);
+        if (it != stateIds.end()) {
+            return it->second;
+        }
+        const int id = static_cast<int>(pending.size());
+        stateIds[state] = id;
+        pending.push_back(state);
+        return id;
+    };
+    stateId(ProductState(-1, 0));
+    {
+        int start[kPatternCount];
+        for (int i = 0; i < kPatternCount; ++i) {
+            start[i] = patternPosition(kPatterns[i], 0, 0);
+        }
+        stateId(ProductState(0, packPositions(start)));
+    }
+
+    for (size_t id = 0; id < pending.size(); ++id) {
+        const ProductState state = pending[id];
+        const int node = state.first;
+        int pos[kPatternCount];
+        for (int i = 0; i < kPatternCount; ++i) {
+            pos[i] = (state.second >> (i * 8)) & 0xFF;
+        }
+
+        StateInfo info = {};
+        for (int i = 0; i < kPatternCount; ++i) {
+            if (pos[i] == kPatternAccepted) {
+                info.accept |= kPatterns[i].acceptBit;
+            } else if (pos[i] != kPatternDead) {
+                info.live |= kPatterns[i].acceptBit;
+            }
+        }
+        if (node >= 0 && inputMap.m_tables.nodes[node].childCount > 0) {
+            info.live |= kInputMap;
+        }
+        const InputMap::Key *const key =
+            node >= 0 ? inputMap.frozenKey(node) : nullptr;
+        if (key != nullptr) {
+            m_keys.push_back(*key);
+            ASSERT(m_keys.size() < 0x10000);
+            info.key = static_cast<uint16_t>(m_keys.size());
+        }
+        infos.push_back(info);
+        if (info.live == 0) {
+            // Most states end a key encoding and go nowhere.
+            rowOf.push_back(-1);
+            continue;
+        }
+        rowOf.push_back(static_cast<int>(fullNext.size()));
+
+        for (int ch = 0; ch < 256; ++ch) {
+            const int nextNode =
+                node >= 0 ? inputMap.frozenChild(node, ch) : -1;
+            uint64_t packed = 0;
+            if (state.second != 0) {
+                int nextPos[kPatternCount];
+                for (int i = 0; i < kPatternCount; ++i) {
+                    nextPos[i] = stepPattern(kPatterns[i], pos[i], ch);
+                }
+                packed = packPositions(nextPos);
+            }
+            fullNext.push_back(nextNode < 0 && packed == 0 ? 0 :
+                stateId(ProductState(nextNode, packed)));
+        }
+    }
+    const size_t stateCount = pending.size();
+    ASSERT(stateCount < 0x10000 && "input DFA has too many states");
+
+    // Renumber the states into three ranges, so that match() can tell what
+    // a state needs from its number alone:
+    //  - states that only lead somewhere else,
+    //  - states that also end a match (they have a StateInfo to record),
+    //  - final states, which have no transitions.  Most states are the end of
+    //    a key encoding, and these need no row in the transition table.
+    std::vector<int> newId(stateCount);
+    std::vector<int> order;
+    for (int range = 0; range < 3; ++range) {
+        for (size_t s = 0; s < stateCount; ++s) {
+            const bool hasInfo = infos[s].accept != 0 || infos[s].key != 0;
+            // The dead state and start state keep their numbers.
+            const int stateRange =
+                s < 2 ? 0 : rowOf[s] < 0 ? 2 : hasInfo ? 1 : 0;
+            if (stateRange == range) {
+                newId[s] = static_cast<int>(order.size());
+                order.push_back(static_cast<int>(s));
+            }
+        }
+        if (range == 0) {
+            t.firstMatchState = static_cast<int>(order.size());
+        } else if (range == 1) {
+            t.firstFinalState = static_cast<int>(order.size());
+        }
+    }
+    for (size_t i = 0; i < stateCount; ++i) {
+        m_states.push_back(infos[order[i]]);
+    }
+
+    // Two bytes share a class when every state sends them to the same place.
+    std::map<std::vector<int>, int> classIds;
+    std::vector<int> representative;
+    for (int ch = 0; ch < 256; ++ch) {
+        std::vector<int> column(t.firstFinalState);
+        for (int s = 0; s < t.firstFinalState; ++s) {
+            const int row = rowOf[order[s]];
+            column[s] = row < 0 ? 0 : newId[fullNext[row + ch]];
+        }
+        auto it = classIds.find(column);
+        if (it == classIds.end()) {
+            it = classIds.insert(std::make_pair(
+                std::move(column), static_cast<int>(representative.size())))
+                    .first;
+            representative.push_back(ch);
+        }
+        m_byteClass[ch] = static_cast<unsigned char>(it->second);
+    }
+    t.classCount = static_cast<int>(representative.size());
+
+    // The table holds state codes rather than state numbers, so that
+    // following a transition needs no multiply.
+    t.finalCodeBase = t.firstFinalState * t.classCount;
+    ASSERT(t.finalCodeBase + (stateCount - t.firstFinalState) <= 0x10000 &&
+           "input DFA table is too large");
+    m_next.resize(t.finalCodeBase);
+    for (int s = 0; s < t.firstFinalState; ++s) {
+        for (int c = 0; c < t.classCount; ++c) {
+            const int row = rowOf[order[s]];
+            const int target = row < 0 ? 0 :
+                newId[fullNext[row + representative[c]]];
+            m_next[s * t.classCount + c] = static_cast<uint16_t>(
+                target < t.firstFinalState ?
+                    target * t.classCount :
+                    t.finalCodeBase + (target - t.firstFinalState));
+        }
+    }
+
+    t.byteClass = m_byteClass;
+    t.next = m_next.data();
+    t.nextCount = m_next.size();
+    t.states = m_states.data();
+    t.stateCount = m_states.size();
+    t.keys = m_keys.data();
+    t.keyCount = m_keys.size();
+}
+
+void InputDfa::load(const Tables &tables) {
+    m_next.clear();
+    m_states.clear();
+    m_keys.clear();
+    m_tables = tables;
+    memcpy(m_byteClass, tables.byteClass, sizeof(m_byteClass));
+}
+
+InputDfa::Match InputDfa::match(const char *input, int inputSize,
+                                bool isEof) const {
+    ASSERT(m_tables.stateCount != 0 && inputSize >= 1);
+
+    Match ret = { None, 0, kKeyZero };
+    const uint16_t *const next = m_tables.next;
+    const unsigned int firstMatchCode =
+        m_tables.firstMatchState * m_tables.classCount;
+    const unsigned int finalCodeBase = m_tables.finalCodeBase;
+
+    // Most input is ordinary text, which doesn't begin any sequence.
+    unsigned int code = next[m_tables.classCount +
+        m_byteClass[static_cast<unsigned char>(input[0])]];
+    if (code == 0) {
+        return ret;
+    }
+
+    int accepted = 0;
+    int acceptLen[kPatternCount] = {};  // indexed by the log2 of an accept bit
+    int keyLen = 0;
+    int keyIndex = 0;
+    for (int i = 0; ; ) {
+        if (code >= firstMatchCode) {
+            const StateInfo &info = m_tables.states[stateOfCode(code)];
+            if (info.accept != 0) {
+                accepted |= info.accept;
+                for (int bit = 0; bit < kPatternCount; ++bit) {
+                    if (info.accept & (1 << bit)) {
+                        acceptLen[bit] = i + 1;
+                    }
+                }
+            }
+            if (info.key != 0) {
+                keyLen = i + 1;
+                keyIndex = info.key;
+            }
+            if (code >= finalCodeBase) {
+                break;
+            }
+        }
+        if (++i == inputSize) {
+            break;
+        }
+        code = next[code + m_byteClass[static_cast<unsigned char>(input[i])]];
+        if (code == 0) {
+            break;
+        }
+    }
+    const int live = m_tables.states[stateOfCode(code)].live;
+
+    if ((accepted | live) == 0) {
+        // The usual case: a complete key, or nothing at all.
+        if (keyLen > 0) {
+            ret.kind = Key;
+            ret.len = keyLen;
+            ret.key = m_tables.keys[keyIndex - 1];
+        }
+        return ret;
+    }
+    if (acceptLen[4] > 0) {
+        ret.kind = PasteBegin;
+        ret.len = acceptLen[4];
+        return ret;
+    }
+    if (acceptLen[0] > 0) {
+        ret.kind = Dsr;
+        ret.len = acceptLen[0];
+        return ret;
+    }
+    if (!isEof && (live & (kDsr | kPasteBegin))) {
+        ret.kind = Incomplete;
+        return ret;
+    }
+
+    // The mouse formats are tried in order, and an incomplete match of one
+    // hides the formats after it, even at EOF.
+    static const struct {
+        int bit;
+        int index;
+        Kind kind;
+    } kMouseOrder[] = {
+        { kMouse1006, 1, Mouse1006 },
+        { kMouse1015, 2, Mouse1015 },
+        { kMouseDefault, 3, MouseDefault },
+    };
+    for (const auto &mouse : kMouseOrder) {
+        if (acceptLen[mouse.index] > 0) {
+            ret.kind = mouse.kind;
+            ret.len = acceptLen[mouse.index];
+            return ret;
+        }
+        if (live & mouse.bit) {
+            if (!isEof) {
+                ret.kind = Incomplete;
+                return ret;
+            }
+            break;
+        }
+    }
+
+    if (!isEof && (live & kInputMap)) {
+        ret.kind = Incomplete;
+        return ret;
+    }
+    if (keyLen > 0) {
+        ret.kind = Key;
+        ret.len = keyLen;
+        ret.key = m_tables.keys[keyIndex - 1];
+    }
+    return ret;
+}
+
+size_t InputDfa::tableBytes() const {
+    return sizeof(m_byteClass) +
+        m_tables.nextCount * sizeof(m_tables.next[0]) +
+        m_tables.stateCount * sizeof(m_tables.states[0]) +
+        m_tables.keyCount * sizeof(m_tables.keys[0]);
+}
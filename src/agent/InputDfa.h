@@ -0,0 +1,132 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_INPUT_DFA_H
+#define AGENT_INPUT_DFA_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "InputMap.h"
+
+// A table-driven DFA that recognizes every terminal input sequence the agent
+// decodes specially: the InputMap's key encodings, the Device Status Report
+// reply, the three mouse report formats, and the start of a bracketed paste.
+// It is compiled once from an InputMap, after which decoding a sequence is a
+// loop over one contiguous transition table.  Bytes that every state treats
+// alike share a byte class, which keeps the table small enough to stay in
+// cache.  The default map's tables are compiled ahead of time by
+// GenInputTables and loaded as static data.
+//
+// match() checks for the start of a paste, then reproduces the precedence of
+// the hand-written matchers it replaced: a DSR reply first, then mouse input
+// (SGR 1006, urxvt 1015, then the default X10 encoding), then the longest
+// InputMap key.  A partial DSR, mouse, or paste sequence, or an InputMap
+// prefix, is reported as incomplete unless isEof.  The end of a paste is
+// left to ConsoleInput.
+class InputDfa {
+public:
+    enum Kind {
+        None,
+        Incomplete,
+        Key,
+        Dsr,
+        MouseDefault,
+        Mouse1006,
+        Mouse1015,
+        PasteBegin,
+    };
+
+    struct Match {
+        Kind kind;
+        int len;
+        InputMap::Key key;
+    };
+
+    struct StateInfo {
+        uint16_t key;       // 1 + index into keys, or 0 for no key
+        uint8_t accept;
+        uint8_t live;
+    };
+
+    // The compiled DFA.  compile() keeps the arrays in the InputDfa, while
+    // load() uses arrays in static storage, which outlive the InputDfa.
+    struct Tables {
+        const unsigned char *byteClass;     // 256 entries
+        int classCount;
+        int firstMatchState;
+        int firstFinalState;
+        unsigned int finalCodeBase;
+        const uint16_t *next;               // [code + byte class] -> code
+        size_t nextCount;
+        const StateInfo *states;
+        size_t stateCount;
+        const InputMap::Key *keys;
+        size_t keyCount;
+    };
+
+    void compile(const InputMap &inputMap);
+    void load(const Tables &tables);
+    const Tables &tables() const { return m_tables; }
+    Match match(const char *input, int inputSize, bool isEof) const;
+    size_t stateCount() const { return m_tables.stateCount; }
+    int byteClassCount() const { return m_tables.classCount; }
+    size_t tableBytes() const;
+
+    // Returns true if some sequence begins with this byte.
+    bool startsSequence(unsigned char ch) const {
+        return m_tables.next[m_tables.classCount + m_byteClass[ch]] != 0;
+    }
+
+private:
+    // Bits for StateInfo's accept and live masks.  A pattern's accept bit is
+    // set on the state reached by the pattern's final byte.  A live bit means
+    // the component could still match if more input arrived.
+    enum {
+        kDsr          = 0x01,
+        kMouse1006    = 0x02,
+        kMouse1015    = 0x04,
+        kMouseDefault = 0x08,
+        kPasteBegin   = 0x10,
+        kInputMap     = 0x20,
+    };
+
+    // A state code is the offset of the state's row in the next table.
+    // Final states have no row, and their codes count up from finalCodeBase.
+    unsigned int stateOfCode(unsigned int code) const {
+        return code < m_tables.finalCodeBase ?
+            code / m_tables.classCount :
+            m_tables.firstFinalState + (code - m_tables.finalCodeBase);
+    }
+
+    // State 0 is the dead state, and state 1 is the start state.  Only
+    // states from firstMatchState onward end a match, and states from
+    // firstFinalState onward have no transitions.  m_byteClass is a copy of
+    // the byteClass table, which saves match() an indirection.
+    Tables m_tables = {};
+    unsigned char m_byteClass[256];
+    std::vector<uint16_t> m_next;
+    std::vector<StateInfo> m_states;
+    std::vector<InputMap::Key> m_keys;
+};
+
+#endif // AGENT_INPUT_DFA_H
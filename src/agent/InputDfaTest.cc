@@ -0,0 +1,409 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests and a benchmark for InputDfa.  The DFA compiled from the default
+// input map is checked against the hand-written DSR and mouse matchers and
+// the InputMap trie walk that ConsoleInput used previously, on every prefix
+// of a large set of random and realistic inputs.  The benchmark decodes a
+// recorded-style keystroke stream and a paste stream with both decoders.
+// Build with InputDfa.cc, InputMap.cc, DefaultInputMap.cc, and
+// -DWINPTY_AGENT_ASSERT.  It doesn't need windows.h, so the benchmark also
+// runs on Linux.
+
+#include "InputDfa.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+#include "DefaultInputMap.h"
+#include "InputMap.h"
+#include "UnicodeEncoding.h"
+#include "VirtualKeys.h"
+
+static double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The matchers below are ConsoleInput's previous code, verbatim.
+
+#define MATCH_CHECK(cond)                           \
+        do {                                        \
+            if (!(cond)) { return 0; }              \
+        } while(0)
+
+#define ADVANCE()                                   \
+        do {                                        \
+            pch++;                                  \
+            if (pch == stop) { return -1; }         \
+        } while(0)
+
+#define SCAN_INT(out, maxLen)                       \
+        do {                                        \
+            (out) = 0;                              \
+            MATCH_CHECK(isdigit(*pch));             \
+            const char *begin = pch;                \
+            do {                                    \
+                MATCH_CHECK(pch - begin + 1 < maxLen); \
+                (out) = (out) * 10 + *pch - '0';    \
+                ADVANCE();                          \
+            } while (isdigit(*pch));                \
+        } while(0)
+
+#define SCAN_SIGNED_INT(out, maxLen)                \
+        do {                                        \
+            bool negative = false;                  \
+            if (*pch == '-') {                      \
+                negative = true;                    \
+                ADVANCE();                          \
+            }                                       \
+            SCAN_INT(out, maxLen);                  \
+            if (negative) {                         \
+                (out) = -(out);                     \
+            }                                       \
+        } while(0)
+
+static int matchDsr(const char *input, int inputSize)
+{
+    int32_t dummy = 0;
+    const char *pch = input;
+    const char *stop = input + inputSize;
+    MATCH_CHECK(*pch == '\x1B');  ADVANCE();
+    MATCH_CHECK(*pch == '[');     ADVANCE();
+    SCAN_INT(dummy, 8);
+    MATCH_CHECK(*pch == ';');     ADVANCE();
+    SCAN_INT(dummy, 8);
+    MATCH_CHECK(*pch == 'R');
+    return pch - input + 1;
+}
+
+static int matchMouseDefault(const char *input, int inputSize)
+{
+    const char *pch = input;
+    const char *stop = input + inputSize;
+    MATCH_CHECK(*pch == '\x1B');  ADVANCE();
+    MATCH_CHECK(*pch == '[');     ADVANCE();
+    MATCH_CHECK(*pch == 'M');     ADVANCE();
+    ADVANCE();
+    ADVANCE();
+    return pch - input + 1;
+}
+
+static int matchMouse1006(const char *input, int inputSize)
+{
+    const char *pch = input;
+    const char *stop = input + inputSize;
+    int32_t temp;
+    MATCH_CHECK(*pch == '\x1B');  ADVANCE();
+    MATCH_CHECK(*pch == '[');     ADVANCE();
+    MATCH_CHECK(*pch == '<');     ADVANCE();
+    SCAN_INT(temp, 8);
+    MATCH_CHECK(*pch == ';');     ADVANCE();
+    SCAN_SIGNED_INT(temp, 8);
+    MATCH_CHECK(*pch == ';');     ADVANCE();
+    SCAN_SIGNED_INT(temp, 8);
+    MATCH_CHECK(*pch == 'M' || *pch == 'm');
+    return pch - input + 1;
+}
+
+static int matchMouse1015(const char *input, int inputSize)
+{
+    const char *pch = input;
+    const char *stop = input + inputSize;
+    int32_t temp;
+    MATCH_CHECK(*pch == '\x1B');  ADVANCE();
+    MATCH_CHECK(*pch == '[');     ADVANCE();
+    SCAN_INT(temp, 8);
+    MATCH_CHECK(*pch == ';');     ADVANCE();
+    SCAN_SIGNED_INT(temp, 8);
+    MATCH_CHECK(*pch == ';');     ADVANCE();
+    SCAN_SIGNED_INT(temp, 8);
+    MATCH_CHECK(*pch == 'M');
+    return pch - input + 1;
+}
+
+// The decision the old scanInput made before its Alt-<char> and UTF-8
+// fallbacks, expressed as an InputDfa::Match, with the bracketed paste
+// check added in front.
+static InputDfa::Match referenceMatch(const InputMap &inputMap,
+                                      const char *input, int inputSize,
+                                      bool isEof) {
+    InputDfa::Match ret = { InputDfa::None, 0, kKeyZero };
+    static const char kPasteBegin[] = "\x1B[200~";
+    const int pasteLen = static_cast<int>(strlen(kPasteBegin));
+    if (inputSize >= pasteLen && !memcmp(input, kPasteBegin, pasteLen)) {
+        ret.kind = InputDfa::PasteBegin;
+        ret.len = pasteLen;
+        return ret;
+    }
+    if (input[0] == '\x1B') {
+        const int dsrLen = matchDsr(input, inputSize);
+        if (dsrLen > 0) {
+            ret.kind = InputDfa::Dsr;
+            ret.len = dsrLen;
+            return ret;
+        } else if (!isEof && dsrLen == -1) {
+            ret.kind = InputDfa::Incomplete;
+            return ret;
+        }
+        int mouseLen = 0;
+        InputDfa::Kind kind = InputDfa::None;
+        if ((mouseLen = matchMouse1006(input, inputSize)) != 0) {
+            kind = InputDfa::Mouse1006;
+        } else if ((mouseLen = matchMouse1015(input, inputSize)) != 0) {
+            kind = InputDfa::Mouse1015;
+        } else if ((mouseLen = matchMouseDefault(input, inputSize)) != 0) {
+            kind = InputDfa::MouseDefault;
+        }
+        if (mouseLen > 0) {
+            ret.kind = kind;
+            ret.len = mouseLen;
+            return ret;
+        } else if (!isEof && mouseLen == -1) {
+            ret.kind = InputDfa::Incomplete;
+            return ret;
+        }
+    }
+    InputMap::Key key;
+    bool incomplete;
+    const int matchLen = inputMap.lookupKey(input, inputSize, key, incomplete);
+    if (!isEof && incomplete) {
+        ret.kind = InputDfa::Incomplete;
+    } else if (matchLen > 0) {
+        ret.kind = InputDfa::Key;
+        ret.len = matchLen;
+        ret.key = key;
+    }
+    return ret;
+}
+
+static bool sameMatch(const InputDfa::Match &a, const InputDfa::Match &b) {
+    return a.kind == b.kind && a.len == b.len &&
+        a.key.virtualKey == b.key.virtualKey &&
+        a.key.unicodeChar == b.key.unicodeChar &&
+        a.key.keyState == b.key.keyState;
+}
+
+static int g_mismatchReports = 0;
+
+static void checkAllPrefixes(const InputMap &inputMap, const InputDfa &dfa,
+                             const std::string &input) {
+    for (size_t len = 1; len <= input.size(); ++len) {
+        for (int isEof = 0; isEof < 2; ++isEof) {
+            const auto expected =
+                referenceMatch(inputMap, input.data(), len, isEof != 0);
+            const auto actual = dfa.match(input.data(), len, isEof != 0);
+            if (!sameMatch(expected, actual)) {
+                ++g_failures;
+                if (g_mismatchReports++ < 10) {
+                    std::string shown;
+                    for (size_t i = 0; i < len; ++i) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "%02X ",
+                                 static_cast<unsigned char>(input[i]));
+                        shown += buf;
+                    }
+                    printf("error: mismatch on %s(eof=%d): "
+                           "expected kind %d len %d, got kind %d len %d\n",
+                           shown.c_str(), isEof,
+                           expected.kind, expected.len,
+                           actual.kind, actual.len);
+                }
+            }
+        }
+    }
+}
+
+static void testKnownSequences(const InputMap &inputMap,
+                               const InputDfa &dfa) {
+    struct Case {
+        const char *input;
+        bool isEof;
+        InputDfa::Kind kind;
+        int len;
+    };
+    const Case cases[] = {
+        { "\x1B[12;34R",            false, InputDfa::Dsr,           8 },
+        { "\x1B[12;34",             false, InputDfa::Incomplete,    0 },
+        { "\x1B[<0;10;20M",         false, InputDfa::Mouse1006,    11 },
+        { "\x1B[<64;-1;2m",         false, InputDfa::Mouse1006,    11 },
+        { "\x1B[32;10;20M",         false, InputDfa::Mouse1015,    11 },
+        { "\x1B[M !!x",             false, InputDfa::MouseDefault,  6 },
+        { "\x1B[A",                 false, InputDfa::Key,           3 },
+        { "\x1B[1;5C",              false, InputDfa::Key,           6 },
+        { "\x1B[15~",               false, InputDfa::Key,           5 },
+        { "\x1B[200~hello",          false, InputDfa::PasteBegin,    6 },
+        { "\x1B[200",                false, InputDfa::Incomplete,    0 },
+        { "\x1B\x1B[[A",            false, InputDfa::Key,           5 },
+        { "\x7F",                   false, InputDfa::Key,           1 },
+        { "\x1B",                   false, InputDfa::Incomplete,    0 },
+        { "\x1B",                   true,  InputDfa::None,          0 },
+        { "\x1B[123456789;1R",      true,  InputDfa::None,          0 },
+        { "a",                      false, InputDfa::None,          0 },
+    };
+    for (const Case &c : cases) {
+        const auto m = dfa.match(c.input, strlen(c.input), c.isEof);
+        CHECK(m.kind == c.kind);
+        CHECK(m.len == c.len);
+        checkAllPrefixes(inputMap, dfa, c.input);
+    }
+}
+
+// Random inputs drawn mostly from the bytes that appear in escape sequences,
+// so that most of them share a long prefix with something the DFA knows.
+static void testRandomInputs(const InputMap &inputMap, const InputDfa &dfa) {
+    static const char kAlphabet[] =
+        "\x1B\x1B\x1B[[[[O;;;0123456789-<MmR~$^@ABCDEFHPQS\x7F\x03 a\xC3\xA9"
+        "200~";
+    srand(1);
+    for (int iter = 0; iter < 200000; ++iter) {
+        std::string input;
+        if (rand() % 2 == 0) {
+            input += "\x1B[";
+        }
+        const int len = 1 + rand() % 16;
+        for (int i = 0; i < len; ++i) {
+            if (rand() % 20 == 0) {
+                input += static_cast<char>(rand() % 256);
+            } else {
+                input += kAlphabet[rand() % (sizeof(kAlphabet) - 1)];
+            }
+        }
+        checkAllPrefixes(inputMap, dfa, input);
+    }
+}
+
+// Decode a whole stream the way ConsoleInput::doWrite does, falling back to
+// one UTF-8 character when nothing matches.  Returns the number of decoded
+// tokens.
+template <typename Decode>
+static size_t decodeStream(const std::string &stream, Decode decode) {
+    size_t tokens = 0;
+    size_t idx = 0;
+    while (idx < stream.size()) {
+        const int remaining = static_cast<int>(stream.size() - idx);
+        const InputDfa::Match m = decode(&stream[idx], remaining);
+        int len = m.len;
+        if (m.kind == InputDfa::None || m.kind == InputDfa::Incomplete) {
+            len = std::max(1, utf8CharLength(stream[idx]));
+        }
+        idx += len;
+        ++tokens;
+    }
+    return tokens;
+}
+
+// An interactive session: typing with cursor movement, Ctrl-arrows, function
+// keys, Alt-letters, mouse motion, and the occasional DSR reply.
+static std::string keystrokeStream(size_t size) {
+    static const char *const kEvents[] = {
+        "ls -la", "\r", "\x1B[A", "\x1B[B", "\x1B[C", "\x1B[D",
+        "\x1B[1;5C", "\x1B[1;5D", "\x1B[3~", "\x7F", "\x1B[15~",
+        "\x1B" "b", "\x1B" "f", "\x1B[H", "\x1B[F", "git status",
+        "\x1B[<35;40;12M", "\x1B[<35;41;12M", "\x1B[<0;41;12M",
+        "\x1B[<0;41;12m", "\x1B[24;80R", "\x1BOP", "\x1B[5~", "\t",
+    };
+    std::string ret;
+    srand(2);
+    while (ret.size() < size) {
+        ret += kEvents[rand() % (sizeof(kEvents) / sizeof(kEvents[0]))];
+    }
+    return ret;
+}
+
+static std::string pasteStream(size_t size) {
+    static const char kText[] =
+        "for (size_t i = 0; i < count; ++i) {\n"
+        "    total += values[i] * 2; // na\xC3\xAFve r\xC3\xA9sum\xC3\xA9\n"
+        "}\n";
+    std::string ret;
+    while (ret.size() < size) {
+        ret += kText;
+    }
+    return ret;
+}
+
+template <typename Decode>
+static double benchmark(const std::string &stream, Decode decode,
+                        size_t &tokens) {
+    const int kReps = 20;
+    const double start = nowSeconds();
+    for (int i = 0; i < kReps; ++i) {
+        tokens = decodeStream(stream, decode);
+    }
+    const double elapsed = nowSeconds() - start;
+    return stream.size() * kReps / elapsed / (1024.0 * 1024.0);
+}
+
+int main() {
+    InputMap inputMap;
+    addDefaultEntriesToInputMap(inputMap);
+    inputMap.freeze();
+    printf("InputMap: %d frozen bytes\n",
+           static_cast<int>(inputMap.frozenBytes()));
+    InputDfa dfa;
+    dfa.compile(inputMap);
+    printf("DFA: %d states, %d byte classes, %d table bytes\n",
+           static_cast<int>(dfa.stateCount()), dfa.byteClassCount(),
+           static_cast<int>(dfa.tableBytes()));
+
+    testKnownSequences(inputMap, dfa);
+    testRandomInputs(inputMap, dfa);
+
+    // The agent loads tables that GenInputTables wrote out from a compiled
+    // DFA.  A DFA loaded from another's tables must behave the same.
+    InputDfa loaded;
+    loaded.load(dfa.tables());
+    CHECK(loaded.stateCount() == dfa.stateCount());
+    CHECK(loaded.tableBytes() == dfa.tableBytes());
+    testKnownSequences(inputMap, loaded);
+
+    const std::string streams[] = {
+        keystrokeStream(4 * 1024 * 1024),
+        pasteStream(16 * 1024 * 1024),
+    };
+    const char *const names[] = { "keystrokes", "paste" };
+    for (int i = 0; i < 2; ++i) {
+        size_t oldTokens = 0;
+        size_t newTokens = 0;
+        const double oldMbps = benchmark(streams[i],
+            [&](const char *p, int n) {
+                return referenceMatch(inputMap, p, n, false);
+            }, oldTokens);
+        const double newMbps = benchmark(streams[i],
+            [&](const char *p, int n) {
+                return dfa.match(p, n, false);
+            }, newTokens);
+        CHECK(oldTokens == newTokens);
+        printf("%-10s: matchers + trie %7.1f MB/s, DFA %7.1f MB/s\n",
+               names[i], oldMbps, newMbps);
+    }
+
+    return unitTestResult();
+}
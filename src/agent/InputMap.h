@@ -26,10 +26,13 @@
 #include <string.h>
 
 #include <string>
+#include <vector>
 
 #include "SimplePool.h"
 #include "../shared/WinptyAssert.h"
 
+// A trie mapping input byte sequences to keys.  It's built with set(), then
+// frozen into a compact, read-only form that all lookups use.
 class InputMap {
 public:
     struct Key {
@@ -40,7 +43,38 @@ public:
         std::string toString() const;
     };
 
+    // The frozen trie is one array of nodes, numbered breadth-first from the
+    // root (node 0), so each node's children are contiguous and sorted by
+    // the byte leading to them.  Children are found by a linear scan, or for
+    // the few nodes with many children (e.g. ESC and ESC [), in a 256-entry
+    // table of child numbers.
+    struct FrozenNode {
+        uint16_t firstChild;
+        uint16_t childCount;
+        uint16_t keyIndex;      // 1-based index into keys, or 0
+        uint16_t wideIndex;     // 1-based 256-entry table in wide, or 0
+    };
+    enum { kWideChildCount = 8 };
+
+    // The arrays of a frozen trie.  freeze() keeps them in the InputMap,
+    // while the default map's arrays are generated ahead of time by
+    // GenInputTables and live in static storage.
+    struct FrozenTables {
+        const FrozenNode *nodes;
+        size_t nodeCount;
+        const unsigned char *bytes;     // the byte leading to each node
+        const Key *keys;
+        size_t keyCount;
+        const uint16_t *wide;           // 0 means no child
+        size_t wideCount;
+    };
+
+    InputMap() {}
+    explicit InputMap(const FrozenTables &tables) :
+        m_frozen(true), m_tables(tables) {}
+
 private:
+    friend class InputDfa;
     struct Node;
 
     struct Branch {
@@ -77,14 +111,47 @@ private:
     SimplePool<Node, 256> m_nodePool;
     SimplePool<Branch, 8> m_branchPool;
     Node m_root;
+    bool m_frozen = false;
+    FrozenTables m_tables = {};
+    // The arrays behind m_tables, when freeze() builds them.
+    std::vector<FrozenNode> m_frozenNodes;
+    std::vector<unsigned char> m_frozenBytes;
+    std::vector<Key> m_frozenKeys;
+    std::vector<uint16_t> m_frozenWide;
 
 public:
     void set(const char *encoding, int encodingLen, const Key &key);
+    void freeze();
+    bool isFrozen() const { return m_frozen; }
+    const FrozenTables &frozenTables() const { return m_tables; }
+    size_t frozenBytes() const;
     int lookupKey(const char *input, int inputSize,
                   Key &keyOut, bool &incompleteOut) const;
     void dumpInputMap() const;
 
 private:
+    // Returns the frozen child of `node` for `ch`, or -1.
+    int frozenChild(int node, unsigned char ch) const {
+        const FrozenNode &n = m_tables.nodes[node];
+        if (n.wideIndex != 0) {
+            const int child = m_tables.wide[(n.wideIndex - 1) * 256 + ch];
+            return child != 0 ? child : -1;
+        }
+        const unsigned char *const bytes = m_tables.bytes;
+        const int end = n.firstChild + n.childCount;
+        for (int i = n.firstChild; i < end && bytes[i] <= ch; ++i) {
+            if (bytes[i] == ch) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    const Key *frozenKey(int node) const {
+        const int index = m_tables.nodes[node].keyIndex;
+        return index == 0 ? NULL : &m_tables.keys[index - 1];
+    }
+
     Node *getChild(Node &node, unsigned char ch) {
         return const_cast<Node*>(getChild(static_cast<const Node&>(node), ch));
     }
@@ -104,7 +171,7 @@ private:
 
     void setHelper(Node &node, const char *encoding, int encodingLen, const Key &key);
     Node &getOrCreateChild(Node &node, unsigned char ch);
-    void dumpInputMapHelper(const Node &node, std::string &encoding) const;
+    void dumpInputMapHelper(int node, std::string &encoding) const;
 };
 
 const InputMap::Key kKeyZero = { 0, 0, 0 };
@@ -0,0 +1,96 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests for InputMap's frozen trie.  Build with InputMap.cc and
+// -DWINPTY_AGENT_ASSERT.  It doesn't need windows.h.
+
+#include "InputMap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "../shared/UnitTest.h"
+#include "VirtualKeys.h"
+
+static InputMap::Key key(uint16_t vk) {
+    InputMap::Key ret = { vk, 0, 0 };
+    return ret;
+}
+
+// Checks lookupKey's length, key, and incomplete flag for one input.
+static void checkLookup(const InputMap &map, const char *input,
+                        int expectLen, uint16_t expectVk,
+                        bool expectIncomplete) {
+    InputMap::Key k;
+    bool incomplete = false;
+    const int len = map.lookupKey(input, strlen(input), k, incomplete);
+    CHECK(len == expectLen);
+    CHECK(k.virtualKey == expectVk);
+    CHECK(incomplete == expectIncomplete);
+}
+
+static void testLookup() {
+    InputMap map;
+    map.set("\x1B", 1, key(VK_ESCAPE));
+    map.set("\x1B[A", 3, key(VK_UP));
+    map.set("\x1B[B", 3, key(VK_DOWN));
+    map.set("\x1B[15~", 5, key(VK_F5));
+    map.set("\x1BOP", 3, key(VK_F1));
+    // More children than fit in a tiny node, added out of order, so the
+    // node is converted to a 256-entry branch before freezing.
+    const char kLetters[] = "zyxwvutsrqponmlk";
+    for (int i = 0; kLetters[i] != '\0'; ++i) {
+        const char enc[] = { '\x1B', kLetters[i] };
+        map.set(enc, 2, key('A' + i));
+    }
+    map.freeze();
+    CHECK(map.isFrozen());
+
+    checkLookup(map, "\x1B", 1, VK_ESCAPE, true);
+    checkLookup(map, "\x1B[", 1, VK_ESCAPE, true);
+    checkLookup(map, "\x1B[A", 3, VK_UP, false);
+    checkLookup(map, "\x1B[Bxyz", 3, VK_DOWN, false);
+    checkLookup(map, "\x1B[15", 1, VK_ESCAPE, true);
+    checkLookup(map, "\x1B[15~", 5, VK_F5, false);
+    checkLookup(map, "\x1B[1x", 1, VK_ESCAPE, false);
+    checkLookup(map, "\x1BOP", 3, VK_F1, false);
+    checkLookup(map, "a", 0, 0, false);
+    for (int i = 0; kLetters[i] != '\0'; ++i) {
+        const char enc[] = { '\x1B', kLetters[i], '\0' };
+        checkLookup(map, enc, 2, 'A' + i, false);
+    }
+
+    // A map built from another's frozen tables, as the agent builds the
+    // default map from generated tables, shares them.
+    const InputMap copy(map.frozenTables());
+    CHECK(copy.isFrozen());
+    CHECK(copy.frozenTables().nodes == map.frozenTables().nodes);
+    checkLookup(copy, "\x1B[15~", 5, VK_F5, false);
+    checkLookup(copy, "\x1B[", 1, VK_ESCAPE, true);
+}
+
+int main() {
+    testLookup();
+    return unitTestResult();
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_LATENCY_HISTOGRAM_H
+#define AGENT_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// A fixed-size histogram of latencies in microseconds.  Bucket boundaries
+// are log-linear: each power of two is split into eight equal sub-buckets,
+// so a percentile is reported with at most 12.5% error no matter how large
+// the sample is, and recording a sample is a few shifts.
+//
+// This class doesn't depend on windows.h, so it can be tested anywhere.
+class LatencyHistogram {
+public:
+    LatencyHistogram() { clear(); }
+
+    void clear() {
+        memset(m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_max = 0;
+    }
+
+    void add(int64_t us) {
+        const uint64_t value = us < 0 ? 0 : static_cast<uint64_t>(us);
+        ++m_buckets[bucketIndex(value)];
+        ++m_count;
+        if (value > m_max) {
+            m_max = value;
+        }
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+
+    // Returns an upper bound on the given percentile (0-100), or 0 if the
+    // histogram is empty.
+    uint64_t percentile(int pct) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        // The rank of the sample we want, counting from 1.
+        uint64_t rank = (m_count * pct + 99) / 100;
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < kBucketCount; ++i) {
+            seen += m_buckets[i];
+            if (seen >= rank && i != kBucketCount - 1) {
+                const uint64_t bound = bucketUpperBound(i);
+                return bound < m_max ? bound : m_max;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    enum {
+        kSubBits = 3,
+        kSubBuckets = 1 << kSubBits,
+        // Values of 2^40 us (about 12 days) and up share the last bucket.
+        kMaxExponent = 39,
+        kBucketCount =
+            kSubBuckets + (kMaxExponent - kSubBits + 1) * kSubBuckets,
+    };
+
+    static int bucketIndex(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<int>(value);
+        }
+        int exponent = kSubBits;
+        while (exponent < kMaxExponent && (value >> (exponent + 1)) != 0) {
+            ++exponent;
+        }
+        if ((value >> (exponent + 1)) != 0) {
+            return kBucketCount - 1;
+        }
+        const int sub = static_cast<int>(
+            (value >> (exponent - kSubBits)) & (kSubBuckets - 1));
+        return kSubBuckets + (exponent - kSubBits) * kSubBuckets + sub;
+    }
+
+    static uint64_t bucketUpperBound(int index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        const int exponent = kSubBits + (index - kSubBuckets) / kSubBuckets;
+        const int sub = (index - kSubBuckets) % kSubBuckets;
+        const int shift = exponent - kSubBits;
+        return ((static_cast<uint64_t>(kSubBuckets + sub) + 1) << shift) - 1;
+    }
+
+    uint32_t m_buckets[kBucketCount];
+    uint64_t m_count;
+    uint64_t m_max;
+};
+
+#endif // AGENT_LATENCY_HISTOGRAM_H
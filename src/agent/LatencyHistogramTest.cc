@@ -0,0 +1,98 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests for LatencyHistogram.  The percentile bounds are compared against
+// exact percentiles of the same random samples.
+
+#include "LatencyHistogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+static void testSmallValues() {
+    LatencyHistogram h;
+    CHECK(h.count() == 0 && h.max() == 0 && h.percentile(50) == 0);
+    // Values below eight have a bucket each, so they are exact.
+    for (int i = 0; i < 8; ++i) {
+        h.add(i);
+    }
+    CHECK(h.count() == 8 && h.max() == 7);
+    CHECK(h.percentile(0) == 0);
+    CHECK(h.percentile(50) == 3);
+    CHECK(h.percentile(100) == 7);
+    // Negative samples (e.g. from a clock step) count as zero.
+    h.add(-5);
+    CHECK(h.count() == 9 && h.percentile(0) == 0);
+    h.clear();
+    CHECK(h.count() == 0 && h.max() == 0);
+}
+
+static void testBounds() {
+    // A bound never exceeds the maximum sample.
+    LatencyHistogram h;
+    h.add(1000);
+    CHECK(h.percentile(50) == 1000);
+    h.add(1001);
+    CHECK(h.percentile(100) == 1001);
+    CHECK(h.percentile(50) >= 1000 && h.percentile(50) <= 1001);
+    // Huge values land in the last bucket rather than overflowing.
+    h.add(1ll << 50);
+    CHECK(h.max() == 1ull << 50);
+    CHECK(h.percentile(100) == 1ull << 50);
+}
+
+static void testRandomPercentiles() {
+    srand(1);
+    LatencyHistogram h;
+    std::vector<uint64_t> samples;
+    for (int i = 0; i < 100000; ++i) {
+        // Mostly sub-millisecond, with a long tail.
+        uint64_t value = rand() % 2000;
+        if (rand() % 20 == 0) {
+            value = static_cast<uint64_t>(rand()) * 37 % 5000000;
+        }
+        samples.push_back(value);
+        h.add(value);
+    }
+    std::sort(samples.begin(), samples.end());
+    CHECK(h.count() == samples.size());
+    CHECK(h.max() == samples.back());
+    const int pcts[] = { 1, 10, 50, 90, 99, 100 };
+    for (int pct : pcts) {
+        size_t rank = (samples.size() * pct + 99) / 100;
+        const uint64_t exact = samples[rank == 0 ? 0 : rank - 1];
+        const uint64_t bound = h.percentile(pct);
+        CHECK(bound >= exact);
+        CHECK(bound <= exact + exact / 8 + 1);
+    }
+}
+
+int main() {
+    testSmallValues();
+    testBounds();
+    testRandomPercentiles();
+    return unitTestResult();
+}
@@ -39,6 +39,17 @@ bool NamedPipe::serviceIo(std::vector<HANDLE> *waitHandles)
     if (m_handle == NULL) {
         return false;
     }
+    if (m_ringWriter) {
+        const auto progress = m_ringWriter->service();
+        if (progress == kError) {
+            closePipe();
+            return true;
+        }
+        if (m_ringWriter->getWaitEvent() != nullptr) {
+            waitHandles->push_back(m_ringWriter->getWaitEvent());
+        }
+        return progress == kProgress;
+    }
     if (m_connectEvent.get() != nullptr) {
         // We're still connecting this server pipe.  Check whether the pipe is
         // now connected.  If it isn't, add the pipe to the list of handles to
@@ -87,57 +98,82 @@ static OwnedHandle createEvent() {
     return OwnedHandle(ret);
 }
 
-NamedPipe::IoWorker::IoWorker(NamedPipe &namedPipe) :
+NamedPipe::IoWorker::IoWorker(NamedPipe &namedPipe, size_t depth) :
     m_namedPipe(namedPipe),
-    m_event(createEvent())
+    m_queue(depth),
+    m_slots(new Slot[depth]())
 {
+    for (size_t i = 0; i < depth; ++i) {
+        m_slots[i].event = createEvent();
+    }
+}
+
+// Hand finished operations to completeIo in issue order.
+bool NamedPipe::IoWorker::retireCompletedIo()
+{
+    bool progress = false;
+    size_t slot = 0;
+    uint32_t actual = 0;
+    while (m_queue.retire(slot, actual)) {
+        completeIo(m_slots[slot], actual);
+        progress = true;
+    }
+    return progress;
 }
 
 NamedPipe::ServiceResult NamedPipe::IoWorker::service()
 {
     ServiceResult progress = ServiceResult::NoProgress;
-    if (m_pending) {
+    for (size_t i = 0; i < m_queue.inFlight(); ++i) {
+        const size_t index = m_queue.slotAt(i);
+        if (m_queue.isComplete(index)) {
+            continue;
+        }
+        Slot &slot = m_slots[index];
         DWORD actual = 0;
-        BOOL ret = GetOverlappedResult(m_namedPipe.m_handle, &m_over, &actual, FALSE);
+        BOOL ret = GetOverlappedResult(m_namedPipe.m_handle, &slot.over, &actual, FALSE);
         if (!ret) {
             if (GetLastError() == ERROR_IO_INCOMPLETE) {
-                // There is a pending I/O.
-                return progress;
+                // The I/O is still pending.
+                continue;
             } else {
                 // Pipe error.
                 return ServiceResult::Error;
             }
         }
-        ResetEvent(m_event.get());
-        m_pending = false;
-        completeIo(actual);
-        m_currentIoSize = 0;
+        ResetEvent(slot.event.get());
+        m_queue.complete(index, actual);
+    }
+    if (retireCompletedIo()) {
         progress = ServiceResult::Progress;
     }
-    DWORD nextSize = 0;
     bool isRead = false;
-    while (shouldIssueIo(&nextSize, &isRead)) {
-        m_currentIoSize = nextSize;
+    while (!m_queue.full()) {
+        Slot &slot = m_slots[m_queue.nextSlot()];
+        if (!shouldIssueIo(slot, &isRead)) {
+            break;
+        }
+        const size_t index = m_queue.issue();
         DWORD actual = 0;
-        memset(&m_over, 0, sizeof(m_over));
-        m_over.hEvent = m_event.get();
+        memset(&slot.over, 0, sizeof(slot.over));
+        slot.over.hEvent = slot.event.get();
         BOOL ret = isRead
-                ? ReadFile(m_namedPipe.m_handle, m_buffer, nextSize, &actual, &m_over)
-                : WriteFile(m_namedPipe.m_handle, m_buffer, nextSize, &actual, &m_over);
+                ? ReadFile(m_namedPipe.m_handle, slot.buffer, slot.size, &actual, &slot.over)
+                : WriteFile(m_namedPipe.m_handle, slot.buffer, slot.size, &actual, &slot.over);
         if (!ret) {
             if (GetLastError() == ERROR_IO_PENDING) {
-                // There is a pending I/O.
-                m_pending = true;
-                return progress;
+                // There is a pending I/O.  Keep issuing more.
+                continue;
             } else {
                 // Pipe error.
                 return ServiceResult::Error;
             }
         }
-        ResetEvent(m_event.get());
-        completeIo(actual);
-        m_currentIoSize = 0;
-        progress = ServiceResult::Progress;
+        ResetEvent(slot.event.get());
+        m_queue.complete(index, actual);
+        if (retireCompletedIo()) {
+            progress = ServiceResult::Progress;
+        }
     }
     return progress;
 }
@@ -147,60 +183,129 @@ NamedPipe::ServiceResult NamedPipe::IoWorker::service()
 // https://blogs.msdn.microsoft.com/oldnewthing/20110202-00/?p=11613
 void NamedPipe::IoWorker::waitForCanceledIo()
 {
-    if (m_pending) {
-        DWORD actual = 0;
-        GetOverlappedResult(m_namedPipe.m_handle, &m_over, &actual, TRUE);
-        m_pending = false;
+    for (size_t i = 0; i < m_queue.inFlight(); ++i) {
+        const size_t index = m_queue.slotAt(i);
+        if (!m_queue.isComplete(index)) {
+            DWORD actual = 0;
+            GetOverlappedResult(m_namedPipe.m_handle, &m_slots[index].over,
+                                &actual, TRUE);
+        }
     }
+    m_queue.clear();
 }
 
+// The oldest operation is always incomplete after service() returns, and
+// nothing can be retired until it finishes.
 HANDLE NamedPipe::IoWorker::getWaitEvent()
 {
-    return m_pending ? m_event.get() : NULL;
+    return m_queue.empty() ? NULL : m_slots[m_queue.slotAt(0)].event.get();
 }
 
-void NamedPipe::InputWorker::completeIo(DWORD size)
+NamedPipe::InputWorker::InputWorker(NamedPipe &namedPipe, size_t depth) :
+    IoWorker(namedPipe, depth),
+    m_buffers(new char[depth * kIoSize])
 {
-    m_namedPipe.m_inQueue.append(m_buffer, size);
+    for (size_t i = 0; i < depth; ++i) {
+        m_slots[i].buffer = &m_buffers[i * kIoSize];
+    }
 }
 
-bool NamedPipe::InputWorker::shouldIssueIo(DWORD *size, bool *isRead)
+void NamedPipe::InputWorker::completeIo(Slot &slot, DWORD size)
+{
+    m_namedPipe.m_inQueue.append(slot.buffer, size);
+    m_bytesInFlight -= slot.size;
+}
+
+// Count the reads in flight against the read buffer size, too.  Otherwise,
+// with several reads outstanding, the buffered input could exceed the limit
+// by up to the I/O depth times kIoSize.
+bool NamedPipe::InputWorker::shouldIssueIo(Slot &slot, bool *isRead)
 {
     *isRead = true;
     ASSERT(!m_namedPipe.isConnecting());
-    if (m_namedPipe.isClosed()) {
-        return false;
-    } else if (m_namedPipe.m_inQueue.size() < m_namedPipe.readBufferSize()) {
-        *size = kIoSize;
-        return true;
-    } else {
+    const size_t used = m_namedPipe.bytesAvailable() + m_bytesInFlight;
+    if (m_namedPipe.isClosed() || used >= m_namedPipe.readBufferSize()) {
         return false;
     }
+    slot.size = static_cast<DWORD>(std::min<size_t>(
+        kIoSize, m_namedPipe.readBufferSize() - used));
+    m_bytesInFlight += slot.size;
+    return true;
 }
 
-void NamedPipe::OutputWorker::completeIo(DWORD size)
+void NamedPipe::OutputWorker::completeIo(Slot &slot, DWORD size)
 {
-    ASSERT(size == m_currentIoSize);
+    ASSERT(size == slot.size);
+    m_namedPipe.m_outQueue.consume(size);
+    m_bytesInFlight -= size;
 }
 
-bool NamedPipe::OutputWorker::shouldIssueIo(DWORD *size, bool *isRead)
+// Write the queue in place, starting after the bytes that are already being
+// written.  Bytes appended while writes are pending go after them, so the
+// buffers don't move.
+bool NamedPipe::OutputWorker::shouldIssueIo(Slot &slot, bool *isRead)
 {
     *isRead = false;
-    if (!m_namedPipe.m_outQueue.empty()) {
-        auto &out = m_namedPipe.m_outQueue;
-        const DWORD writeSize = std::min<size_t>(out.size(), kIoSize);
-        std::copy(&out[0], &out[writeSize], m_buffer);
-        out.erase(0, writeSize);
-        *size = writeSize;
-        return true;
-    } else {
+    size_t available = 0;
+    const char *const data =
+        m_namedPipe.m_outQueue.dataAt(m_bytesInFlight, available);
+    if (available == 0) {
         return false;
     }
+    slot.buffer = const_cast<char*>(data);
+    slot.size = std::min<size_t>(available, kIoSize);
+    m_bytesInFlight += slot.size;
+    return true;
+}
+
+NamedPipe::RingWriter::RingWriter(
+        NamedPipe &namedPipe, void *view, size_t viewSize, uint32_t capacity,
+        OwnedHandle &&dataEvent, OwnedHandle &&spaceEvent) :
+    m_namedPipe(namedPipe),
+    m_view(view),
+    m_dataEvent(std::move(dataEvent)),
+    m_spaceEvent(std::move(spaceEvent))
+{
+    const bool success = m_ring.create(view, viewSize, capacity);
+    ASSERT(success && "SpscRing::create failed");
 }
 
-DWORD NamedPipe::OutputWorker::getPendingIoSize()
+// The client keeps its own handles to the mapping, so it can read whatever
+// is left in the ring after the agent closes it.
+NamedPipe::RingWriter::~RingWriter()
 {
-    return m_pending ? m_currentIoSize : 0;
+    m_ring.close();
+    SetEvent(m_dataEvent.get());
+    UnmapViewOfFile(m_view);
+}
+
+NamedPipe::ServiceResult NamedPipe::RingWriter::service()
+{
+    auto &out = m_namedPipe.m_outQueue;
+    bool progress = false;
+    while (!out.empty()) {
+        const size_t amount = m_ring.write(out.frontData(), out.frontSize());
+        if (amount == 0) {
+            if (m_ring.isBroken()) {
+                // The client corrupted the ring's read position.
+                return ServiceResult::Error;
+            }
+            break;
+        }
+        out.consume(amount);
+        progress = true;
+    }
+    if (!progress) {
+        return ServiceResult::NoProgress;
+    }
+    SetEvent(m_dataEvent.get());
+    return ServiceResult::Progress;
+}
+
+// Wait for the client to free up space only if there is output queued.
+HANDLE NamedPipe::RingWriter::getWaitEvent()
+{
+    return m_namedPipe.m_outQueue.empty() ? nullptr : m_spaceEvent.get();
 }
 
 void NamedPipe::openServerPipe(LPCWSTR pipeName, OpenMode::t openMode,
@@ -272,30 +377,75 @@ void NamedPipe::connectToServer(LPCWSTR pipeName, OpenMode::t openMode)
     startPipeWorkers();
 }
 
+// Named kernel objects for the ring.  The client opens them using the same
+// base name.
+static OwnedHandle createNamedEvent(const std::wstring &name,
+                                    SECURITY_ATTRIBUTES &sa)
+{
+    // auto reset, initially unset
+    HANDLE ret = CreateEventW(&sa, FALSE, FALSE, name.c_str());
+    ASSERT(ret != nullptr && GetLastError() != ERROR_ALREADY_EXISTS &&
+        "Could not create ring event");
+    return OwnedHandle(ret);
+}
+
+void NamedPipe::openSharedMemoryRing(LPCWSTR baseName, uint32_t capacity)
+{
+    ASSERT(isClosed());
+    const std::wstring base = baseName;
+    const auto sd = createPipeSecurityDescriptorOwnerFullControl();
+    ASSERT(sd && "error creating ring SECURITY_DESCRIPTOR");
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = sd.get();
+    const size_t viewSize = SpscRing::memorySize(capacity);
+    HANDLE mapping = CreateFileMappingW(
+        INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE,
+        0, static_cast<DWORD>(viewSize), (base + L"-map").c_str());
+    TRACE("opened shared memory ring [%s], handle == %p",
+        utf8FromWide(base).c_str(), mapping);
+    ASSERT(mapping != nullptr && GetLastError() != ERROR_ALREADY_EXISTS &&
+        "Could not create ring file mapping");
+    void *const view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, viewSize);
+    ASSERT(view != nullptr && "Could not map ring view");
+    auto dataEvent = createNamedEvent(base + L"-data", sa);
+    auto spaceEvent = createNamedEvent(base + L"-space", sa);
+    m_name = base;
+    m_handle = mapping;
+    m_openMode = OpenMode::Writing;
+    m_ringWriter.reset(new RingWriter(*this, view, viewSize, capacity,
+                                      std::move(dataEvent),
+                                      std::move(spaceEvent)));
+}
+
 void NamedPipe::startPipeWorkers()
 {
     if (m_openMode & OpenMode::Reading) {
-        m_inputWorker.reset(new InputWorker(*this));
+        m_inputWorker.reset(new InputWorker(*this, m_ioDepth));
     }
     if (m_openMode & OpenMode::Writing) {
-        m_outputWorker.reset(new OutputWorker(*this));
+        m_outputWorker.reset(new OutputWorker(*this, m_ioDepth));
     }
 }
 
+void NamedPipe::setIoDepth(size_t depth)
+{
+    ASSERT(isClosed());
+    ASSERT(depth >= 1);
+    m_ioDepth = depth;
+}
+
 size_t NamedPipe::bytesToSend()
 {
     ASSERT(m_openMode & OpenMode::Writing);
-    auto ret = m_outQueue.size();
-    if (m_outputWorker != NULL) {
-        ret += m_outputWorker->getPendingIoSize();
-    }
-    return ret;
+    // This includes the bytes of pending writes.
+    return m_outQueue.size();
 }
 
 void NamedPipe::write(const void *data, size_t size)
 {
     ASSERT(m_openMode & OpenMode::Writing);
-    m_outQueue.append(reinterpret_cast<const char*>(data), size);
+    m_outQueue.append(data, size);
 }
 
 void NamedPipe::write(const char *text)
@@ -321,37 +471,43 @@ size_t NamedPipe::bytesAvailable()
     return m_inQueue.size();
 }
 
-size_t NamedPipe::peek(void *data, size_t size)
+char *NamedPipe::peekData()
 {
     ASSERT(m_openMode & OpenMode::Reading);
-    const auto out = reinterpret_cast<char*>(data);
-    const size_t ret = std::min(size, m_inQueue.size());
-    std::copy(&m_inQueue[0], &m_inQueue[ret], out);
+    return m_inQueue.data();
+}
+
+void NamedPipe::consume(size_t size)
+{
+    m_inQueue.consume(size);
+}
+
+size_t NamedPipe::peek(void *data, size_t size)
+{
+    const size_t ret = std::min(size, bytesAvailable());
+    const char *const src = peekData();
+    std::copy(src, src + ret, reinterpret_cast<char*>(data));
     return ret;
 }
 
 size_t NamedPipe::read(void *data, size_t size)
 {
     size_t ret = peek(data, size);
-    m_inQueue.erase(0, ret);
+    consume(ret);
     return ret;
 }
 
 std::string NamedPipe::readToString(size_t size)
 {
-    ASSERT(m_openMode & OpenMode::Reading);
-    size_t retSize = std::min(size, m_inQueue.size());
-    std::string ret = m_inQueue.substr(0, retSize);
-    m_inQueue.erase(0, retSize);
+    const size_t retSize = std::min(size, bytesAvailable());
+    std::string ret(peekData(), retSize);
+    consume(retSize);
     return ret;
 }
 
 std::string NamedPipe::readAllToString()
 {
-    ASSERT(m_openMode & OpenMode::Reading);
-    std::string ret = m_inQueue;
-    m_inQueue.clear();
-    return ret;
+    return readToString(bytesAvailable());
 }
 
 void NamedPipe::closePipe()
@@ -359,6 +515,12 @@ void NamedPipe::closePipe()
     if (m_handle == NULL) {
         return;
     }
+    if (m_ringWriter) {
+        m_ringWriter.reset();
+        CloseHandle(m_handle);
+        m_handle = NULL;
+        return;
+    }
     CancelIo(m_handle);
     if (m_connectEvent.get() != nullptr) {
         DWORD actual = 0;
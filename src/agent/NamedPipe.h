@@ -28,6 +28,11 @@
 #include <vector>
 
 #include "../shared/OwnedHandle.h"
+#include "../shared/SpscRing.h"
+
+#include "ChunkedByteQueue.h"
+#include "CompactingByteBuffer.h"
+#include "InOrderIoQueue.h"
 
 class EventLoop;
 
@@ -44,43 +49,80 @@ private:
     enum class ServiceResult { NoProgress, Error, Progress };
 
 private:
+    // Keeps up to `depth` overlapped reads or writes outstanding, each with
+    // its own OVERLAPPED and buffer, so the pipe stays busy between calls to
+    // service().  Operations are completed in the order they were issued.
     class IoWorker
     {
     public:
-        IoWorker(NamedPipe &namedPipe);
+        IoWorker(NamedPipe &namedPipe, size_t depth);
         virtual ~IoWorker() {}
         ServiceResult service();
         void waitForCanceledIo();
         HANDLE getWaitEvent();
     protected:
+        struct Slot {
+            OwnedHandle event;
+            OVERLAPPED over;
+            char *buffer;
+            DWORD size;
+        };
         NamedPipe &m_namedPipe;
-        bool m_pending = false;
-        DWORD m_currentIoSize = 0;
-        OwnedHandle m_event;
-        OVERLAPPED m_over = {};
+        InOrderIoQueue m_queue;
+        std::unique_ptr<Slot[]> m_slots;
         enum { kIoSize = 64 * 1024 };
-        char m_buffer[kIoSize];
-        virtual void completeIo(DWORD size) = 0;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) = 0;
+        virtual void completeIo(Slot &slot, DWORD size) = 0;
+        // Sets the slot's buffer and size.  The buffer must remain valid
+        // until the I/O completes.
+        virtual bool shouldIssueIo(Slot &slot, bool *isRead) = 0;
+    private:
+        bool retireCompletedIo();
     };
 
     class InputWorker : public IoWorker
     {
     public:
-        InputWorker(NamedPipe &namedPipe) : IoWorker(namedPipe) {}
+        InputWorker(NamedPipe &namedPipe, size_t depth);
     protected:
-        virtual void completeIo(DWORD size) override;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) override;
+        virtual void completeIo(Slot &slot, DWORD size) override;
+        virtual bool shouldIssueIo(Slot &slot, bool *isRead) override;
+    private:
+        std::unique_ptr<char[]> m_buffers;
+        // The sizes of the reads that are issued but not yet retired.
+        size_t m_bytesInFlight = 0;
     };
 
     class OutputWorker : public IoWorker
     {
     public:
-        OutputWorker(NamedPipe &namedPipe) : IoWorker(namedPipe) {}
-        DWORD getPendingIoSize();
+        OutputWorker(NamedPipe &namedPipe, size_t depth) :
+            IoWorker(namedPipe, depth) {}
     protected:
-        virtual void completeIo(DWORD size) override;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) override;
+        virtual void completeIo(Slot &slot, DWORD size) override;
+        virtual bool shouldIssueIo(Slot &slot, bool *isRead) override;
+    private:
+        // Bytes at the front of the output queue that are being written.
+        size_t m_bytesInFlight = 0;
+    };
+
+    // Writes the output queue into a shared-memory ring rather than a pipe.
+    // The client is woken with the data event, and it wakes the agent with
+    // the space event after reading from a full ring.
+    class RingWriter
+    {
+    public:
+        RingWriter(NamedPipe &namedPipe, void *view, size_t viewSize,
+                   uint32_t capacity, OwnedHandle &&dataEvent,
+                   OwnedHandle &&spaceEvent);
+        ~RingWriter();
+        ServiceResult service();
+        HANDLE getWaitEvent();
+    private:
+        NamedPipe &m_namedPipe;
+        void *m_view;
+        SpscRing m_ring;
+        OwnedHandle m_dataEvent;
+        OwnedHandle m_spaceEvent;
     };
 
 public:
@@ -90,15 +132,26 @@ public:
     };
 
     std::wstring name() const { return m_name; }
+    // The number of reads or writes to keep outstanding.  Call this before
+    // opening the pipe.
+    void setIoDepth(size_t depth);
     void openServerPipe(LPCWSTR pipeName, OpenMode::t openMode,
                         int outBufferSize, int inBufferSize);
     void connectToServer(LPCWSTR pipeName, OpenMode::t openMode);
+    void openSharedMemoryRing(LPCWSTR baseName, uint32_t capacity);
     size_t bytesToSend();
     void write(const void *data, size_t size);
     void write(const char *text);
     size_t readBufferSize();
     void setReadBufferSize(size_t size);
     size_t bytesAvailable();
+    // Returns the buffered input as one contiguous span of bytesAvailable()
+    // bytes.  It remains valid until the next consume or read call, or until
+    // the EventLoop services the pipe.  The caller may rewrite the span in
+    // place, e.g. to drop bytes by moving the rest to its end and consuming
+    // the front.
+    char *peekData();
+    void consume(size_t size);
     size_t peek(void *data, size_t size);
     size_t read(void *data, size_t size);
     std::string readToString(size_t size);
@@ -115,11 +168,15 @@ private:
     OwnedHandle m_connectEvent;
     OpenMode::t m_openMode = OpenMode::None;
     size_t m_readBufferSize = 64 * 1024;
-    std::string m_inQueue;
-    std::string m_outQueue;
+    size_t m_ioDepth = 1;
+    CompactingByteBuffer m_inQueue;
+    // Output is written directly from the front of the queue, and it stays
+    // queued until the write completes.
+    ChunkedByteQueue m_outQueue;
     HANDLE m_handle = nullptr;
     std::unique_ptr<InputWorker> m_inputWorker;
     std::unique_ptr<OutputWorker> m_outputWorker;
+    std::unique_ptr<RingWriter> m_ringWriter;
 };
 
 #endif // NAMEDPIPE_H
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_OUTPUT_BACKPRESSURE_H
+#define AGENT_OUTPUT_BACKPRESSURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+// Decides when a Scraper should stop sending output to a slow CONOUT client,
+// and remembers which lines it must resend once the client catches up.
+//
+// Output pauses when the pipe's backlog exceeds the high watermark and
+// resumes when it falls to the low watermark.  While paused, the Scraper
+// keeps scraping (so its sync marker and scrollback history stay current),
+// but its changes only go to the history.  On resume, the lines changed
+// during the pause are resent once each, with their latest content, instead
+// of every intermediate frame.  If more than a screenful changed, the Scraper
+// redraws only the latest screen.
+class OutputBackpressure {
+public:
+    enum {
+        kDefaultHighWatermark = 256 * 1024,
+        kDefaultLowWatermark = 32 * 1024,
+    };
+
+    explicit OutputBackpressure(
+            size_t highWatermark = kDefaultHighWatermark,
+            size_t lowWatermark = kDefaultLowWatermark) :
+        m_highWatermark(highWatermark),
+        m_lowWatermark(lowWatermark)
+    {
+    }
+
+    // Updates the paused state from the number of bytes not yet written to
+    // the client.  Returns true if output has just resumed, in which case the
+    // caller should resend lines starting at takeFirstDirtyLine().
+    bool update(size_t backlog) {
+        if (!m_paused) {
+            if (backlog > m_highWatermark) {
+                m_paused = true;
+                m_firstDirtyLine = kNoDirtyLine;
+            }
+            return false;
+        } else if (backlog <= m_lowWatermark) {
+            m_paused = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool paused() const { return m_paused; }
+
+    // Records a line changed while paused.
+    void markLine(int64_t line) {
+        m_firstDirtyLine = std::min(m_firstDirtyLine, line);
+    }
+
+    // The terminal was reset (and possibly cleared), so lines before newLine
+    // can't be redrawn any more.
+    void reset(int64_t newLine) {
+        if (m_paused) {
+            m_firstDirtyLine = newLine;
+        }
+    }
+
+    // Returns the first line that changed during the pause, or kNoDirtyLine.
+    int64_t takeFirstDirtyLine() {
+        const int64_t ret = m_firstDirtyLine;
+        m_firstDirtyLine = kNoDirtyLine;
+        return ret;
+    }
+
+    // Abandons the pause without resending anything, e.g. because the whole
+    // history is being replayed to a new client.
+    void clear() {
+        m_paused = false;
+        m_firstDirtyLine = kNoDirtyLine;
+    }
+
+    static const int64_t kNoDirtyLine = INT64_MAX;
+
+private:
+    size_t m_highWatermark;
+    size_t m_lowWatermark;
+    bool m_paused = false;
+    int64_t m_firstDirtyLine = kNoDirtyLine;
+};
+
+#endif // AGENT_OUTPUT_BACKPRESSURE_H
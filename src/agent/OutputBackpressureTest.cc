@@ -0,0 +1,284 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests for OutputBackpressure.  A simulated console scrolls output and
+// redraws a status line every tick, while a throttled in-memory sink stands
+// in for a slow CONOUT client.  The scrape loop below mirrors the Scraper:
+// changed lines always go to the ScrollbackHistory, and go to the sink only
+// while output isn't paused.  Build with ScrollbackHistory.cc and
+// -DWINPTY_AGENT_ASSERT.
+
+#include "OutputBackpressure.h"
+#include "ScrollbackHistory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+static const int kWidth = 60;
+static const int kHeight = 20;
+
+// A program that prints `linesPerTick` lines per tick and keeps a progress
+// counter on the last line of the window.
+class SimulatedConsole {
+public:
+    explicit SimulatedConsole(int linesPerTick) :
+        m_linesPerTick(linesPerTick) {}
+
+    void tick() {
+        for (int i = 0; i < m_linesPerTick; ++i) {
+            char buf[64];
+            sprintf(buf, "output line %d", static_cast<int>(m_lines.size()));
+            m_lines.push_back(buf);
+        }
+        ++m_ticks;
+    }
+
+    int64_t windowTop() const {
+        return std::max<int64_t>(0, lineCount() - kHeight);
+    }
+
+    int64_t lineCount() const { return m_lines.size() + 1; }
+
+    std::string line(int64_t index) const {
+        if (index < static_cast<int64_t>(m_lines.size())) {
+            return m_lines[index];
+        }
+        char buf[64];
+        sprintf(buf, "progress: %d ticks", m_ticks);
+        return buf;
+    }
+
+private:
+    int m_linesPerTick;
+    int m_ticks = 0;
+    std::vector<std::string> m_lines;
+};
+
+static std::vector<CHAR_INFO> toCells(const std::string &text) {
+    std::vector<CHAR_INFO> ret(kWidth);
+    for (int i = 0; i < kWidth; ++i) {
+        ret[i].Char.UnicodeChar = i < static_cast<int>(text.size())
+            ? text[i] : L' ';
+        ret[i].Attributes = 7;
+    }
+    return ret;
+}
+
+static std::string fromCells(const std::vector<CHAR_INFO> &cells) {
+    std::string ret;
+    for (const auto &cell : cells) {
+        ret.push_back(static_cast<char>(cell.Char.UnicodeChar));
+    }
+    while (!ret.empty() && ret.back() == ' ') {
+        ret.pop_back();
+    }
+    return ret;
+}
+
+// Applies lines to the client's screen immediately, but only lets
+// `bytesPerTick` bytes out of its backlog each tick.
+class ThrottledSink {
+public:
+    explicit ThrottledSink(size_t bytesPerTick) :
+        m_bytesPerTick(bytesPerTick) {}
+
+    void sendLine(int64_t line, const std::string &text) {
+        // Roughly what the Terminal writes: cursor movement, text, and an
+        // erase-to-EOL.
+        const size_t bytes = text.size() + 8;
+        m_backlog += bytes;
+        m_totalBytes += bytes;
+        m_peakBacklog = std::max(m_peakBacklog, m_backlog);
+        m_screen[line] = text;
+    }
+
+    // Mirrors Terminal::reset with SendClear.
+    void clearScreen() {
+        m_backlog += 12;
+        m_totalBytes += 12;
+        m_screen.clear();
+    }
+
+    void drain() {
+        m_backlog -= std::min(m_backlog, m_bytesPerTick);
+    }
+
+    size_t backlog() const { return m_backlog; }
+    size_t totalBytes() const { return m_totalBytes; }
+    size_t peakBacklog() const { return m_peakBacklog; }
+    const std::map<int64_t, std::string> &screen() const { return m_screen; }
+
+private:
+    size_t m_bytesPerTick;
+    size_t m_backlog = 0;
+    size_t m_totalBytes = 0;
+    size_t m_peakBacklog = 0;
+    std::map<int64_t, std::string> m_screen;
+};
+
+struct RunResult {
+    size_t totalBytes;
+    size_t peakBacklog;
+    int pauses;
+};
+
+// Runs the program for `ticks` ticks, then lets the client catch up.
+static RunResult runSimulation(OutputBackpressure &backpressure,
+                               size_t bytesPerTick, int ticks) {
+    SimulatedConsole console(25);
+    ThrottledSink sink(bytesPerTick);
+    ScrollbackHistory history;
+    std::map<int64_t, std::string> scraped;
+    int64_t scrapeTop = 0;
+    int pauses = 0;
+
+    // Mirrors Scraper::updateOutputBackpressure.
+    auto resendFrom = [&](int64_t firstLine) {
+        firstLine = std::max(firstLine, history.firstLine());
+        const int64_t screenTop = history.endLine() - kHeight;
+        if (firstLine < screenTop) {
+            sink.clearScreen();
+            firstLine = screenTop;
+        }
+        std::vector<CHAR_INFO> cells;
+        for (int64_t line = firstLine; line < history.endLine(); ++line) {
+            history.getLine(line, cells);
+            if (!cells.empty()) {
+                sink.sendLine(line, fromCells(cells));
+            }
+        }
+    };
+
+    // Like the Scraper, read everything from the previous window top down,
+    // including lines that have already scrolled out of the window.
+    auto scrape = [&]() {
+        for (int64_t line = scrapeTop; line < console.lineCount(); ++line) {
+            const std::string text = console.line(line);
+            if (scraped[line] == text) {
+                continue;
+            }
+            scraped[line] = text;
+            const auto cells = toCells(text);
+            if (backpressure.paused()) {
+                backpressure.markLine(line);
+            } else {
+                sink.sendLine(line, text);
+            }
+            history.setLine(line, cells.data(), cells.size());
+        }
+        scrapeTop = console.windowTop();
+    };
+
+    auto pollTimeout = [&](bool finalScrape) {
+        const bool wasPaused = backpressure.paused();
+        if (backpressure.update(finalScrape ? 0 : sink.backlog())) {
+            resendFrom(backpressure.takeFirstDirtyLine());
+        }
+        if (!wasPaused && backpressure.paused()) {
+            ++pauses;
+        }
+        scrape();
+        sink.drain();
+    };
+
+    for (int i = 0; i < ticks; ++i) {
+        console.tick();
+        pollTimeout(false);
+    }
+    while (sink.backlog() > 0 || backpressure.paused()) {
+        pollTimeout(false);
+    }
+    pollTimeout(true);
+
+    // The client's screen must match the console.  Without backpressure, so
+    // must everything in the scrollback.
+    const int64_t firstChecked = backpressure.paused() || pauses > 0
+        ? console.windowTop()
+        : history.firstLine();
+    for (int64_t line = firstChecked; line < console.lineCount(); ++line) {
+        const auto it = sink.screen().find(line);
+        CHECK(it != sink.screen().end() && it->second == console.line(line));
+    }
+    RunResult ret = { sink.totalBytes(), sink.peakBacklog(), pauses };
+    return ret;
+}
+
+static void testHysteresis() {
+    OutputBackpressure bp(1000, 100);
+    CHECK(!bp.update(1000) && !bp.paused());
+    CHECK(!bp.update(1001) && bp.paused());
+    CHECK(bp.takeFirstDirtyLine() == OutputBackpressure::kNoDirtyLine);
+    bp.markLine(50);
+    bp.markLine(40);
+    bp.markLine(45);
+    CHECK(!bp.update(500) && bp.paused());
+    CHECK(bp.update(100) && !bp.paused());
+    CHECK(bp.takeFirstDirtyLine() == 40);
+    CHECK(!bp.update(100));
+
+    // A terminal reset while paused makes earlier lines unreachable.
+    bp.update(2000);
+    bp.markLine(10);
+    bp.reset(70);
+    bp.markLine(75);
+    CHECK(bp.update(0));
+    CHECK(bp.takeFirstDirtyLine() == 70);
+}
+
+static void testThrottledClient() {
+    const int kTicks = 2000;
+    // This client reads about 1/4 as fast as the program writes.
+    const size_t kBytesPerTick = 400;
+
+    OutputBackpressure unlimited(SIZE_MAX, SIZE_MAX);
+    const auto baseline = runSimulation(unlimited, kBytesPerTick, kTicks);
+    CHECK(baseline.pauses == 0);
+
+    OutputBackpressure limited(16 * 1024, 2 * 1024);
+    const auto throttled = runSimulation(limited, kBytesPerTick, kTicks);
+    CHECK(throttled.pauses > 0);
+    CHECK(throttled.totalBytes < baseline.totalBytes * 3 / 4);
+    // The backlog exceeds the high watermark by at most one tick's output or
+    // one coalesced screen update.
+    CHECK(throttled.peakBacklog < 16 * 1024 + 4 * 1024);
+
+    printf("unthrottled: %8u bytes sent, peak backlog %8u\n",
+           static_cast<unsigned int>(baseline.totalBytes),
+           static_cast<unsigned int>(baseline.peakBacklog));
+    printf("throttled:   %8u bytes sent, peak backlog %8u, %d pauses\n",
+           static_cast<unsigned int>(throttled.totalBytes),
+           static_cast<unsigned int>(throttled.peakBacklog),
+           throttled.pauses);
+}
+
+int main() {
+    testHysteresis();
+    testThrottledClient();
+    return unitTestResult();
+}
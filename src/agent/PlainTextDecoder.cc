@@ -0,0 +1,145 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "PlainTextDecoder.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PLAIN_TEXT_DECODER_SSE2 1
+#endif
+
+PlainTextDecoder::PlainTextDecoder() {
+    memset(m_special, 0, sizeof(m_special));
+    m_printableAsciiOrdinary = true;
+}
+
+void PlainTextDecoder::setSpecialByte(unsigned char ch, bool special) {
+    m_special[ch] = special;
+    m_printableAsciiOrdinary = true;
+    for (int i = 0x20; i < 0x7F; ++i) {
+        if (m_special[i]) {
+            m_printableAsciiOrdinary = false;
+        }
+    }
+}
+
+// Decodes one multibyte character with the same validity rules as
+// decodeUtf8 in UnicodeEncoding.h.  Returns its length, or 0 if it is
+// incomplete or invalid.
+static inline size_t decodeMultibyte(const unsigned char *in, size_t avail,
+                                     uint32_t &codePoint) {
+    const unsigned char lead = in[0];
+    size_t len = 0;
+    uint32_t cp = 0;
+    uint32_t min = 0;
+    if ((lead & 0xE0) == 0xC0) {
+        len = 2; cp = lead & 0x1F; min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 3; cp = lead & 0x0F; min = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 4; cp = lead & 0x07; min = 0x10000;
+    } else {
+        return 0;
+    }
+    if (len > avail) {
+        return 0;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if ((in[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (in[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return 0;
+    }
+    codePoint = cp;
+    return len;
+}
+
+size_t PlainTextDecoder::decode(const char *input, size_t size,
+                                uint16_t *out, size_t &outLen) const {
+    const unsigned char *const in =
+        reinterpret_cast<const unsigned char*>(input);
+    size_t i = 0;
+    size_t o = 0;
+    bool tryVector = m_printableAsciiOrdinary;
+    while (i < size) {
+#ifdef PLAIN_TEXT_DECODER_SSE2
+        if (tryVector) {
+            // Copy blocks of 16 printable ASCII characters, widening each
+            // byte to a code unit.  Signed compares reject bytes >= 0x80.
+            const __m128i kSpace = _mm_set1_epi8(0x1F);
+            const __m128i kDel = _mm_set1_epi8(0x7F);
+            const __m128i kZero = _mm_setzero_si128();
+            while (i + 16 <= size) {
+                const __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(in + i));
+                const __m128i printable = _mm_and_si128(
+                    _mm_cmpgt_epi8(v, kSpace), _mm_cmplt_epi8(v, kDel));
+                if (_mm_movemask_epi8(printable) != 0xFFFF) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o),
+                                 _mm_unpacklo_epi8(v, kZero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o + 8),
+                                 _mm_unpackhi_epi8(v, kZero));
+                i += 16;
+                o += 16;
+            }
+            if (i == size) {
+                break;
+            }
+        }
+#endif
+        // One character at a time until the next ASCII character, which
+        // may begin another printable block.
+        const unsigned char ch = in[i];
+        if (m_special[ch]) {
+            break;
+        }
+        if (ch < 0x80) {
+            out[o++] = ch;
+            ++i;
+            tryVector = m_printableAsciiOrdinary;
+            continue;
+        }
+        uint32_t cp = 0;
+        const size_t len = decodeMultibyte(in + i, size - i, cp);
+        if (len == 0) {
+            break;
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            out[o++] = static_cast<uint16_t>(0xD800 + (cp >> 10));
+            out[o++] = static_cast<uint16_t>(0xDC00 + (cp & 0x3FF));
+        } else {
+            out[o++] = static_cast<uint16_t>(cp);
+        }
+        i += len;
+        tryVector = false;
+    }
+    outLen = o;
+    return i;
+}
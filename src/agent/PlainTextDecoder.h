@@ -0,0 +1,50 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_PLAIN_TEXT_DECODER_H
+#define AGENT_PLAIN_TEXT_DECODER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Finds runs of ordinary text in terminal input and transcodes them from
+// UTF-8 to UTF-16 in bulk.  A byte is ordinary unless the caller marks it as
+// the start of something the general input decoder must see (an escape
+// sequence, Ctrl-C, ...).  A multibyte character is ordinary when its lead
+// byte is, and only if it is complete and valid; an incomplete or invalid
+// character ends the run, so that the general decoder reports it as before.
+class PlainTextDecoder {
+public:
+    PlainTextDecoder();
+    void setSpecialByte(unsigned char ch, bool special);
+
+    // Decodes the longest ordinary prefix of the input.  `out` must have room
+    // for `size` UTF-16 code units.  Returns the number of input bytes
+    // consumed and sets outLen to the number of code units written.
+    size_t decode(const char *input, size_t size,
+                  uint16_t *out, size_t &outLen) const;
+
+private:
+    bool m_special[256];
+    bool m_printableAsciiOrdinary;
+};
+
+#endif // AGENT_PLAIN_TEXT_DECODER_H
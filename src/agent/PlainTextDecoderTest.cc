@@ -0,0 +1,294 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests and a throughput benchmark for PlainTextDecoder.  The decoder is
+// checked against the per-character path in ConsoleInput (utf8CharLength,
+// decodeUtf8, and encodeUtf16) on every code point and on random mixes of
+// text, control bytes, and malformed UTF-8.  The benchmark compares that
+// path, building two key records per character, with the bulk decoder and
+// record fill.  (The VkKeyScan and MapVirtualKey calls the agent also
+// caches can't be measured here.)  Build on Linux with PlainTextDecoder.cc:
+//
+//     g++ -std=c++11 -O2 PlainTextDecoderTest.cc PlainTextDecoder.cc
+//         -o PlainTextDecoderTest
+
+#include "PlainTextDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+#include "UnicodeEncoding.h"
+
+static double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The same layout as a KEY_EVENT INPUT_RECORD.
+struct KeyRecord {
+    uint16_t eventType;
+    int32_t keyDown;
+    uint16_t repeatCount;
+    uint16_t virtualKey;
+    uint16_t scanCode;
+    uint16_t unicodeChar;
+    uint32_t controlKeyState;
+};
+
+static const unsigned char kSpecialBytes[] = { 0x03, 0x1B, 0x7F };
+
+static void makeDecoder(PlainTextDecoder &decoder) {
+    for (unsigned char ch : kSpecialBytes) {
+        decoder.setSpecialByte(ch, true);
+    }
+}
+
+static bool isSpecial(unsigned char ch) {
+    return memchr(kSpecialBytes, ch, sizeof(kSpecialBytes)) != nullptr;
+}
+
+// ConsoleInput's per-character path, stopping where it would stop treating
+// the input as ordinary text.
+static size_t referenceDecode(const char *input, size_t size,
+                              std::vector<uint16_t> &out) {
+    out.clear();
+    size_t i = 0;
+    while (i < size) {
+        if (isSpecial(input[i])) {
+            break;
+        }
+        const int len = utf8CharLength(input[i]);
+        if (len == 0 || static_cast<size_t>(len) > size - i) {
+            break;
+        }
+        const uint32_t cp = decodeUtf8(&input[i]);
+        if (cp == static_cast<uint32_t>(-1)) {
+            break;
+        }
+        wchar_t ws[2];
+        const int wslen = encodeUtf16(ws, cp);
+        for (int j = 0; j < wslen; ++j) {
+            out.push_back(static_cast<uint16_t>(ws[j]));
+        }
+        i += len;
+    }
+    return i;
+}
+
+static void checkSame(const PlainTextDecoder &decoder,
+                      const std::string &input) {
+    std::vector<uint16_t> expected;
+    const size_t expectedLen =
+        referenceDecode(input.data(), input.size(), expected);
+    std::vector<uint16_t> actual(input.size() + 1);
+    size_t actualUnits = 0;
+    const size_t actualLen = decoder.decode(
+        input.data(), input.size(), actual.data(), actualUnits);
+    actual.resize(actualUnits);
+    CHECK(actualLen == expectedLen);
+    CHECK(actual == expected);
+}
+
+static void testEveryCodePoint(const PlainTextDecoder &decoder) {
+    for (uint32_t cp = 0; cp < 0x110000; ++cp) {
+        char buf[4];
+        const int len = encodeUtf8(buf, cp);
+        if (len > 0) {
+            checkSame(decoder, std::string(buf, len));
+            // Within a long run too, so the vector path is involved.
+            checkSame(decoder, std::string("0123456789abcdef") +
+                               std::string(buf, len) + "0123456789abcdef");
+        }
+    }
+}
+
+static void testRandomInputs(const PlainTextDecoder &decoder) {
+    srand(1);
+    for (int iter = 0; iter < 100000; ++iter) {
+        std::string input;
+        const int pieces = 1 + rand() % 40;
+        for (int p = 0; p < pieces; ++p) {
+            const int kind = rand() % 10;
+            if (kind < 5) {
+                const int n = rand() % 40;
+                for (int i = 0; i < n; ++i) {
+                    input += static_cast<char>(0x20 + rand() % 0x5F);
+                }
+            } else if (kind < 8) {
+                static const uint32_t ranges[] = {
+                    0x80, 0x800, 0x10000, 0x110000,
+                };
+                char buf[4];
+                const int len = encodeUtf8(buf, rand() % ranges[rand() % 4]);
+                input.append(buf, len);
+            } else if (kind == 8) {
+                input += static_cast<char>(rand() % 0x20);
+            } else {
+                input += static_cast<char>(rand() % 256);
+            }
+        }
+        checkSame(decoder, input);
+        // A multibyte character cut off by the end of the buffer.
+        checkSame(decoder, input.substr(0, rand() % (input.size() + 1)));
+    }
+}
+
+static void appendKeyRecord(std::vector<KeyRecord> &records, bool keyDown,
+                            uint16_t ch) {
+    KeyRecord r = {};
+    r.eventType = 1;
+    r.keyDown = keyDown;
+    r.repeatCount = 1;
+    r.unicodeChar = ch;
+    records.push_back(r);
+}
+
+static size_t perCharacterPath(const char *input, size_t size,
+                               std::vector<KeyRecord> &records) {
+    records.clear();
+    size_t i = 0;
+    while (i < size) {
+        const int len = utf8CharLength(input[i]);
+        if (len == 0 || static_cast<size_t>(len) > size - i) {
+            break;
+        }
+        const uint32_t cp = decodeUtf8(&input[i]);
+        wchar_t ws[2];
+        const int wslen = encodeUtf16(ws, cp);
+        for (int j = 0; j < wslen; ++j) {
+            appendKeyRecord(records, true, static_cast<uint16_t>(ws[j]));
+        }
+        for (int j = 0; j < wslen; ++j) {
+            appendKeyRecord(records, false, static_cast<uint16_t>(ws[j]));
+        }
+        i += len;
+    }
+    return i;
+}
+
+static size_t bulkPath(const PlainTextDecoder &decoder,
+                       const char *input, size_t size,
+                       std::vector<uint16_t> &text,
+                       std::vector<KeyRecord> &records) {
+    records.clear();
+    if (text.size() < size) {
+        text.resize(size);
+    }
+    size_t units = 0;
+    const size_t consumed = decoder.decode(input, size, text.data(), units);
+    records.reserve(units * 2);
+    KeyRecord r = {};
+    r.eventType = 1;
+    r.repeatCount = 1;
+    for (size_t i = 0; i < units; ++i) {
+        r.unicodeChar = text[i];
+        r.keyDown = 1;
+        records.push_back(r);
+        r.keyDown = 0;
+        records.push_back(r);
+    }
+    return consumed;
+}
+
+static std::string pasteText(const char *line, size_t size) {
+    std::string ret;
+    while (ret.size() < size) {
+        ret += line;
+    }
+    return ret;
+}
+
+// The agent receives a paste in pipe-sized pieces, and the benchmark
+// decodes it the same way, reusing its buffers.
+template <typename Path>
+static double throughput(const std::string &input, Path path) {
+    const int kReps = 10;
+    const size_t kChunk = 64 * 1024;
+    const double start = nowSeconds();
+    for (int rep = 0; rep < kReps; ++rep) {
+        size_t offset = 0;
+        while (offset < input.size()) {
+            const size_t size = std::min(kChunk, input.size() - offset);
+            const size_t consumed = path(input.data() + offset, size);
+            // A chunk can end inside a character; carry it over, as
+            // ConsoleInput's byte queue would.
+            CHECK(consumed > 0);
+            offset += consumed;
+        }
+    }
+    return input.size() * kReps / (nowSeconds() - start) / (1024.0 * 1024.0);
+}
+
+static void benchmark(const PlainTextDecoder &decoder, const char *name,
+                      const std::string &input) {
+    std::vector<KeyRecord> records;
+    std::vector<uint16_t> text(input.size());
+    size_t oldRecords = 0;
+    size_t newRecords = 0;
+
+    const double oldMbps = throughput(input,
+        [&](const char *p, size_t n) {
+            const size_t ret = perCharacterPath(p, n, records);
+            oldRecords += records.size();
+            return ret;
+        });
+    const double newMbps = throughput(input,
+        [&](const char *p, size_t n) {
+            const size_t ret = bulkPath(decoder, p, n, text, records);
+            newRecords += records.size();
+            return ret;
+        });
+    const double transcodeMbps = throughput(input,
+        [&](const char *p, size_t n) {
+            size_t units = 0;
+            return decoder.decode(p, n, text.data(), units);
+        });
+
+    CHECK(oldRecords == newRecords);
+    printf("%-8s: per-character %7.1f MB/s, bulk %7.1f MB/s "
+           "(transcode only %7.1f MB/s)\n",
+           name, oldMbps, newMbps, transcodeMbps);
+}
+
+int main() {
+    PlainTextDecoder decoder;
+    makeDecoder(decoder);
+    testEveryCodePoint(decoder);
+    testRandomInputs(decoder);
+
+    const size_t kSize = 32 * 1024 * 1024;
+    benchmark(decoder, "ascii", pasteText(
+        "    for (size_t i = 0; i < count; ++i) { total += values[i]; }\n",
+        kSize));
+    benchmark(decoder, "mixed", pasteText(
+        "Na\xC3\xAFve caf\xC3\xA9 r\xC3\xA9sum\xC3\xA9s \xE2\x80\x94 "
+        "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E \xF0\x9F\x8C\x80\n", kSize));
+
+    return unitTestResult();
+}
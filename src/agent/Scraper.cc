@@ -27,6 +27,8 @@
 #include <algorithm>
 #include <utility>
 
+#include "../shared/ScreenSnapshot.h"
+#include "../shared/StartupTimeline.h"
 #include "../shared/WinptyAssert.h"
 #include "../shared/winpty_snprintf.h"
 
@@ -71,15 +73,22 @@ Scraper::Scraper(
     // While the small font intends to support large buffers, a user could
     // still hit a limit imposed by their monitor width, so cap the new window
     // size to GetLargestConsoleWindowSize().
-    setSmallFont(buffer.conout(), initialSize.X, m_console.isNewW10());
-    buffer.moveWindow(SmallRect(0, 0, 1, 1));
-    buffer.resizeBufferRange(Coord(initialSize.X, BUFFER_LINE_COUNT));
-    const auto largest = GetLargestConsoleWindowSize(buffer.conout());
-    buffer.moveWindow(SmallRect(
-        0, 0,
-        std::min(initialSize.X, largest.X),
-        std::min(initialSize.Y, largest.Y)));
-    buffer.setCursorPosition(Coord(0, 0));
+    StartupTimeline &timeline = processStartupTimeline();
+    {
+        StartupTimelineScope scope(timeline, "setSmallFont");
+        setSmallFont(buffer.conout(), initialSize.X, m_console.isNewW10());
+    }
+    {
+        StartupTimelineScope scope(timeline, "resize console buffer");
+        buffer.moveWindow(SmallRect(0, 0, 1, 1));
+        buffer.resizeBufferRange(Coord(initialSize.X, BUFFER_LINE_COUNT));
+        const auto largest = GetLargestConsoleWindowSize(buffer.conout());
+        buffer.moveWindow(SmallRect(
+            0, 0,
+            std::min(initialSize.X, largest.X),
+            std::min(initialSize.Y, largest.Y)));
+        buffer.setCursorPosition(Coord(0, 0));
+    }
 
     // For the sake of the color translation heuristic, set the console color
     // to LtGray-on-Black.
@@ -113,6 +122,60 @@ void Scraper::scrapeBuffer(Win32ConsoleBuffer &buffer,
     m_consoleBuffer = nullptr;
 }
 
+// Switch to a new Terminal (e.g. for a new CONOUT client) and bring it up to
+// date by replaying the recorded history, which ends with the current screen.
+void Scraper::reattachTerminal(std::unique_ptr<Terminal> terminal)
+{
+    m_terminal = std::move(terminal);
+    m_terminal->reset(Terminal::SendClear, m_history.firstLine());
+    m_backpressure.clear();
+    replayHistory(m_history.firstLine());
+}
+
+// Pause or resume terminal output depending on how much output the client
+// hasn't read yet.  On resume, send one coalesced update covering everything
+// that changed while paused.
+void Scraper::updateOutputBackpressure(size_t backlog)
+{
+    const bool wasPaused = m_backpressure.paused();
+    if (m_backpressure.update(backlog)) {
+        int64_t firstLine = std::max(m_backpressure.takeFirstDirtyLine(),
+                                     m_history.firstLine());
+        const int64_t screenTop = m_history.endLine() - m_ptySize.Y;
+        if (firstLine < screenTop) {
+            // More than a screenful changed, so skip straight to the latest
+            // screen.  The skipped lines remain in the history, so a
+            // reattached client still receives them.
+            m_terminal->reset(Terminal::SendClear, screenTop);
+            firstLine = screenTop;
+        }
+        trace("Resuming terminal output at line %lld",
+              static_cast<long long>(firstLine));
+        replayHistory(firstLine);
+    } else if (!wasPaused && m_backpressure.paused()) {
+        trace("Pausing terminal output (backlog %u bytes)",
+              static_cast<unsigned int>(backlog));
+    }
+}
+
+// Send the recorded lines from firstLine onward, then the cursor state.
+void Scraper::replayHistory(int64_t firstLine)
+{
+    std::vector<CHAR_INFO> lineData;
+    for (int64_t line = firstLine; line < m_history.endLine(); ++line) {
+        m_history.getLine(line, lineData);
+        if (!lineData.empty()) {
+            m_terminal->sendLine(line, lineData.data(), lineData.size(), -1);
+        }
+    }
+    if (m_history.cursorVisible()) {
+        m_terminal->showTerminalCursor(m_history.cursorColumn(),
+                                       m_history.cursorLine());
+    } else {
+        m_terminal->hideTerminalCursor();
+    }
+}
+
 void Scraper::resetConsoleTracking(
     Terminal::SendClearFlag sendClear, int64_t scrapedLineCount)
 {
@@ -126,6 +189,8 @@ void Scraper::resetConsoleTracking(
     m_dirtyWindowTop = -1;
     m_dirtyLineCount = 0;
     m_terminal->reset(sendClear, m_scrapedLineCount);
+    m_history.reset(m_scrapedLineCount);
+    m_backpressure.reset(m_scrapedLineCount);
 }
 
 // Detect window movement.  If the window moves down (presumably as a
@@ -383,9 +448,55 @@ void Scraper::syncConsoleContentAndSize(
         }
     }
 
+    // Remember the console state that goes with the read buffer.  A resize
+    // modifies the console after the read, so the buffer is stale then.
+    m_snapshotValid = !forceResize;
+    m_snapshotTick = GetTickCount();
+    m_snapshotWindow = info.windowRect();
+    m_snapshotBufferSize = info.bufferSize();
+    m_snapshotCursor = info.cursorPosition();
+    m_snapshotCursorVisible = cursorVisible;
+
     finalInfoOut = forceResize ? m_consoleBuffer->bufferInfo() : info;
 }
 
+bool Scraper::hasRecentSnapshotData(DWORD maxAgeMs)
+{
+    return m_snapshotValid && GetTickCount() - m_snapshotTick <= maxAgeMs;
+}
+
+// Append a screen snapshot of the visible window (see ScreenSnapshot.h) to
+// `out`, built from the most recent scrape's read buffer.  The scrape always
+// reads the entire window, so no console access is needed here.
+void Scraper::writeSnapshot(std::vector<char> &out)
+{
+    const SmallRect rect = m_snapshotValid
+        ? m_snapshotWindow.intersected(m_readBuffer.rect())
+        : SmallRect(0, 0, 0, 0);
+    ScreenSnapshotHeader header;
+    header.cols = rect.width();
+    header.rows = rect.height();
+    header.windowLeft = rect.left();
+    header.windowTop = rect.top();
+    header.bufferCols = m_snapshotBufferSize.X;
+    header.bufferRows = m_snapshotBufferSize.Y;
+    header.cursorX = m_snapshotCursor.X - rect.left();
+    header.cursorY = m_snapshotCursor.Y - rect.top();
+    header.cursorVisible =
+        m_snapshotValid && m_snapshotCursorVisible &&
+        rect.contains(m_snapshotCursor);
+    ScreenSnapshotWriter writer(out, header);
+    for (int row = rect.top(); row < rect.top() + rect.height(); ++row) {
+        const CHAR_INFO *const lineData = m_readBuffer.lineData(row) +
+            (rect.left() - m_readBuffer.rect().left());
+        for (int col = 0; col < rect.width(); ++col) {
+            writer.putCell(lineData[col].Char.UnicodeChar,
+                           lineData[col].Attributes);
+        }
+    }
+    writer.finish();
+}
+
 // Try to match Windows' behavior w.r.t. to the LVB attribute flags.  In some
 // situations, Windows ignores the LVB flags on a character cell because of
 // backwards compatibility -- apparently some programs set the flags without
@@ -452,7 +563,7 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
     const int cursorLine = !showTerminalCursor ? -1 : cursor.Y - scrapeRect.Top;
 
     if (!showTerminalCursor) {
-        m_terminal->hideTerminalCursor();
+        hideCursor();
     }
 
     largeConsoleRead(m_readBuffer, *m_consoleBuffer, scrapeRect, attributesMask());
@@ -464,12 +575,12 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
         if (bufLine.detectChangeAndSetLine(curLine, w)) {
             const int lineCursorColumn =
                 line == cursorLine ? cursorColumn : -1;
-            m_terminal->sendLine(line, curLine, w, lineCursorColumn);
+            sendLine(line, curLine, w, lineCursorColumn);
         }
     }
 
     if (showTerminalCursor) {
-        m_terminal->showTerminalCursor(cursorColumn, cursorLine);
+        showCursor(cursorColumn, cursorLine);
     }
 }
 
@@ -612,7 +723,7 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     const int cursorColumn = !showTerminalCursor ? -1 : cursor.X;
 
     if (!showTerminalCursor) {
-        m_terminal->hideTerminalCursor();
+        hideCursor();
     }
 
     bool sawModifiedLine = false;
@@ -634,19 +745,49 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
         if (sawModifiedLine) {
             const int lineCursorColumn =
                 line == cursorLine ? cursorColumn : -1;
-            m_terminal->sendLine(line, curLine, w, lineCursorColumn);
+            sendLine(line, curLine, w, lineCursorColumn);
         }
     }
 
     m_scrapedLineCount = windowRect.top() + m_scrolledCount;
 
     if (showTerminalCursor) {
-        m_terminal->showTerminalCursor(cursorColumn, cursorLine);
+        showCursor(cursorColumn, cursorLine);
     }
 
     return true;
 }
 
+// Terminal output from the scrape functions goes through these wrappers so that
+// the scrollback history sees every line that the client sees.  While output
+// is paused, only the history is updated.
+void Scraper::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
+                       int cursorColumn)
+{
+    if (m_backpressure.paused()) {
+        m_backpressure.markLine(line);
+    } else {
+        m_terminal->sendLine(line, lineData, width, cursorColumn);
+    }
+    m_history.setLine(line, lineData, width);
+}
+
+void Scraper::showCursor(int column, int64_t line)
+{
+    if (!m_backpressure.paused()) {
+        m_terminal->showTerminalCursor(column, line);
+    }
+    m_history.setCursor(column, line);
+}
+
+void Scraper::hideCursor()
+{
+    if (!m_backpressure.paused()) {
+        m_terminal->hideTerminalCursor();
+    }
+    m_history.hideCursor();
+}
+
 void Scraper::syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN])
 {
     // XXX: The marker text generated here could easily collide with ordinary
@@ -31,6 +31,8 @@
 #include "ConsoleLine.h"
 #include "Coord.h"
 #include "LargeConsoleRead.h"
+#include "OutputBackpressure.h"
+#include "ScrollbackHistory.h"
 #include "SmallRect.h"
 #include "Terminal.h"
 
@@ -61,8 +63,14 @@ public:
     void scrapeBuffer(Win32ConsoleBuffer &buffer,
                       ConsoleScreenBufferInfo &finalInfoOut);
     Terminal &terminal() { return *m_terminal; }
+    void reattachTerminal(std::unique_ptr<Terminal> terminal);
+    void updateOutputBackpressure(size_t backlog);
+    const ScrollbackHistory &history() const { return m_history; }
+    bool hasRecentSnapshotData(DWORD maxAgeMs);
+    void writeSnapshot(std::vector<char> &out);
 
 private:
+    void replayHistory(int64_t firstLine);
     void resetConsoleTracking(
         Terminal::SendClearFlag sendClear, int64_t scrapedLineCount);
     void markEntireWindowDirty(const SmallRect &windowRect);
@@ -77,6 +85,10 @@ private:
     bool scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                                bool consoleCursorVisible,
                                bool tentative);
+    void sendLine(int64_t line, const CHAR_INFO *lineData, int width,
+                  int cursorColumn);
+    void showCursor(int column, int64_t line);
+    void hideCursor();
     void syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN]);
     int findSyncMarker();
     void createSyncMarker(int row);
@@ -85,6 +97,8 @@ private:
     Win32Console &m_console;
     Win32ConsoleBuffer *m_consoleBuffer = nullptr;
     std::unique_ptr<Terminal> m_terminal;
+    ScrollbackHistory m_history;
+    OutputBackpressure m_backpressure;
 
     int m_syncRow = -1;
     unsigned int m_syncCounter = 0;
@@ -98,6 +112,15 @@ private:
     std::vector<ConsoleLine> m_bufferData;
     int m_dirtyWindowTop = -1;
     int m_dirtyLineCount = 0;
+
+    // The console state that goes with m_readBuffer's content, for building
+    // screen snapshots.
+    bool m_snapshotValid = false;
+    DWORD m_snapshotTick = 0;
+    SmallRect m_snapshotWindow;
+    Coord m_snapshotBufferSize;
+    Coord m_snapshotCursor;
+    bool m_snapshotCursorVisible = false;
 };
 
 #endif // AGENT_SCRAPER_H
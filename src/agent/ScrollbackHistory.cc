@@ -0,0 +1,232 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+//
+// ScrollbackHistory line encoding
+//
+// Each line is a sequence of unsigned LEB128 varints:
+//
+//     width
+//     run*
+//
+// where each run is:
+//
+//     (cellCount << 1) | isBlank
+//     attributes
+//     cellCount * UnicodeChar      (omitted when isBlank is set)
+//
+// A blank run is a stretch of space characters sharing one attribute.  The
+// runs cover exactly `width` cells.
+//
+
+#include "ScrollbackHistory.h"
+
+#include <algorithm>
+
+#include "../shared/WinptyAssert.h"
+
+namespace {
+
+// Shorter stretches of spaces are cheaper to store inline.
+const int kMinBlankRun = 4;
+
+static void putVarint(std::string &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static uint32_t getVarint(const std::string &in, size_t &pos)
+{
+    uint32_t ret = 0;
+    int shift = 0;
+    while (true) {
+        ASSERT(pos < in.size() && shift < 32);
+        const uint8_t byte = static_cast<uint8_t>(in[pos++]);
+        ret |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return ret;
+        }
+        shift += 7;
+    }
+}
+
+static void putRun(std::string &out, const CHAR_INFO *cells, int count,
+                   bool isBlank)
+{
+    if (count == 0) {
+        return;
+    }
+    putVarint(out, (static_cast<uint32_t>(count) << 1) | (isBlank ? 1 : 0));
+    putVarint(out, cells[0].Attributes);
+    if (!isBlank) {
+        for (int i = 0; i < count; ++i) {
+            putVarint(out, static_cast<uint16_t>(cells[i].Char.UnicodeChar));
+        }
+    }
+}
+
+static void encodeLine(std::string &out, const CHAR_INFO *line, int width)
+{
+    out.clear();
+    putVarint(out, width);
+    int i = 0;
+    while (i < width) {
+        const WORD attr = line[i].Attributes;
+        int end = i;
+        while (end < width && line[end].Attributes == attr) {
+            ++end;
+        }
+        // Split the same-attribute span into text and blank runs.
+        int textStart = i;
+        int col = i;
+        while (col < end) {
+            if (line[col].Char.UnicodeChar != L' ') {
+                ++col;
+                continue;
+            }
+            int blankEnd = col;
+            while (blankEnd < end && line[blankEnd].Char.UnicodeChar == L' ') {
+                ++blankEnd;
+            }
+            if (blankEnd - col >= kMinBlankRun) {
+                putRun(out, &line[textStart], col - textStart, false);
+                putRun(out, &line[col], blankEnd - col, true);
+                textStart = blankEnd;
+            }
+            col = blankEnd;
+        }
+        putRun(out, &line[textStart], end - textStart, false);
+        i = end;
+    }
+}
+
+static void decodeLine(const std::string &in, std::vector<CHAR_INFO> &out)
+{
+    out.clear();
+    if (in.empty()) {
+        return;
+    }
+    size_t pos = 0;
+    const uint32_t width = getVarint(in, pos);
+    out.resize(width);
+    uint32_t col = 0;
+    while (col < width) {
+        const uint32_t header = getVarint(in, pos);
+        const uint32_t count = header >> 1;
+        const bool isBlank = (header & 1) != 0;
+        const WORD attr = static_cast<WORD>(getVarint(in, pos));
+        ASSERT(count >= 1 && col + count <= width);
+        for (uint32_t i = 0; i < count; ++i) {
+            CHAR_INFO &cell = out[col + i];
+            cell.Char.UnicodeChar =
+                isBlank ? L' ' : static_cast<WCHAR>(getVarint(in, pos));
+            cell.Attributes = attr;
+        }
+        col += count;
+    }
+    ASSERT(pos == in.size());
+}
+
+} // anonymous namespace
+
+ScrollbackHistory::ScrollbackHistory(size_t maxLines, size_t maxBytes) :
+    m_maxLines(std::max<size_t>(maxLines, 1)),
+    m_maxBytes(maxBytes)
+{
+}
+
+void ScrollbackHistory::reset(int64_t newLine)
+{
+    m_firstLine = newLine - static_cast<int64_t>(m_lines.size());
+}
+
+void ScrollbackHistory::setLine(int64_t line, const CHAR_INFO *lineData,
+                                int width)
+{
+    ASSERT(width >= 1);
+    if (line < m_firstLine) {
+        // The line was already discarded.
+        return;
+    }
+    if (m_lines.empty() ||
+            line - endLine() >= static_cast<int64_t>(m_maxLines)) {
+        // Start recording at this line.  (If the history isn't empty,
+        // skipping this far ahead would discard everything anyway.)
+        m_lines.clear();
+        m_encodedBytes = 0;
+        m_firstLine = line;
+    }
+    while (line >= endLine()) {
+        m_lines.push_back(std::string());
+    }
+    encodeLine(m_scratch, lineData, width);
+    std::string &entry = m_lines[line - m_firstLine];
+    if (entry != m_scratch) {
+        m_encodedBytes -= entry.size();
+        // Construct a fresh string so the allocation is exactly sized.
+        entry = std::string(m_scratch.data(), m_scratch.size());
+        m_encodedBytes += entry.size();
+    }
+    trim();
+}
+
+void ScrollbackHistory::setCursor(int column, int64_t line)
+{
+    m_cursorVisible = true;
+    m_cursorColumn = column;
+    m_cursorLine = line;
+}
+
+void ScrollbackHistory::getLine(int64_t line,
+                                std::vector<CHAR_INFO> &out) const
+{
+    if (line < m_firstLine || line >= endLine()) {
+        out.clear();
+        return;
+    }
+    decodeLine(m_lines[line - m_firstLine], out);
+}
+
+size_t ScrollbackHistory::memoryUsage() const
+{
+    size_t ret = sizeof(*this) + m_scratch.capacity();
+    for (const auto &line : m_lines) {
+        ret += sizeof(line);
+        // Short strings are stored inline.
+        if (line.capacity() >= sizeof(line)) {
+            ret += line.capacity() + 1;
+        }
+    }
+    return ret;
+}
+
+void ScrollbackHistory::trim()
+{
+    while (m_lines.size() > 1 &&
+            (m_lines.size() > m_maxLines || m_encodedBytes > m_maxBytes)) {
+        m_encodedBytes -= m_lines.front().size();
+        m_lines.pop_front();
+        ++m_firstLine;
+    }
+}
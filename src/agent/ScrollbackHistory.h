@@ -0,0 +1,89 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_SCROLLBACK_HISTORY_H
+#define AGENT_SCROLLBACK_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "CharInfo.h"
+
+// A bounded record of every line the Scraper has sent to the terminal,
+// indexed by the same virtual line numbers the Terminal uses.  Each line is
+// stored run-length encoded, so a typical mostly-blank console line costs a
+// few dozen bytes rather than width * sizeof(CHAR_INFO).  The oldest lines
+// are discarded once either limit is exceeded.
+//
+// The record is used to bring a newly attached CONOUT client up to date:
+// replaying it from the first line reproduces both the scrollback and the
+// current screen.
+class ScrollbackHistory
+{
+public:
+    enum {
+        kDefaultMaxLines = 20000,
+        kDefaultMaxBytes = 4 * 1024 * 1024,
+    };
+
+    ScrollbackHistory(size_t maxLines = kDefaultMaxLines,
+                      size_t maxBytes = kDefaultMaxBytes);
+
+    // Mirrors Terminal::reset.  The lines recorded so far are kept, but they
+    // are renumbered to sit just above `newLine`.
+    void reset(int64_t newLine);
+    void setLine(int64_t line, const CHAR_INFO *lineData, int width);
+    void setCursor(int column, int64_t line);
+    void hideCursor() { m_cursorVisible = false; }
+
+    int64_t firstLine() const { return m_firstLine; }
+    int64_t endLine() const { return m_firstLine + m_lines.size(); }
+    bool cursorVisible() const { return m_cursorVisible; }
+    int cursorColumn() const { return m_cursorColumn; }
+    int64_t cursorLine() const { return m_cursorLine; }
+
+    // Decodes a line into `out`.  A line that was never sent (e.g. a gap
+    // left by a Terminal reset) decodes to an empty vector.
+    void getLine(int64_t line, std::vector<CHAR_INFO> &out) const;
+
+    size_t lineCount() const { return m_lines.size(); }
+    size_t encodedBytes() const { return m_encodedBytes; }
+    size_t memoryUsage() const;
+
+private:
+    void trim();
+
+private:
+    const size_t m_maxLines;
+    const size_t m_maxBytes;
+    std::deque<std::string> m_lines;
+    int64_t m_firstLine = 0;
+    size_t m_encodedBytes = 0;
+    std::string m_scratch;
+    bool m_cursorVisible = false;
+    int m_cursorColumn = 0;
+    int64_t m_cursorLine = 0;
+};
+
+#endif // AGENT_SCROLLBACK_HISTORY_H
@@ -0,0 +1,184 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Round-trip and benchmark tests for ScrollbackHistory.  Build with
+// ScrollbackHistory.cc and -DWINPTY_AGENT_ASSERT.
+
+#include "ScrollbackHistory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+static std::vector<CHAR_INFO> makeLine(const char *text, int width,
+                                       WORD attr = 7)
+{
+    std::vector<CHAR_INFO> ret(width);
+    const int len = strlen(text);
+    for (int i = 0; i < width; ++i) {
+        ret[i].Char.UnicodeChar = i < len ? text[i] : L' ';
+        ret[i].Attributes = attr;
+    }
+    return ret;
+}
+
+static bool sameLine(const std::vector<CHAR_INFO> &a,
+                     const std::vector<CHAR_INFO> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].Char.UnicodeChar != b[i].Char.UnicodeChar ||
+                a[i].Attributes != b[i].Attributes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testRoundTrip()
+{
+    ScrollbackHistory history;
+    std::vector<CHAR_INFO> out;
+
+    // Plain text, a colored stretch, interior blank runs, and non-ASCII.
+    auto line = makeLine("C:\\>dir        /w", 80);
+    for (int i = 20; i < 30; ++i) {
+        line[i].Attributes = 0x1F;
+    }
+    line[40].Char.UnicodeChar = 0x4E2D;
+    line[40].Attributes = 7 | 0x100;
+    line[41].Char.UnicodeChar = 0x4E2D;
+    line[41].Attributes = 7 | 0x200;
+    line[79].Char.UnicodeChar = L'$';
+    history.setLine(5, line.data(), line.size());
+    CHECK(history.firstLine() == 5 && history.endLine() == 6);
+    history.getLine(5, out);
+    CHECK(sameLine(out, line));
+
+    // Gaps decode as empty lines.
+    auto line2 = makeLine("x", 1);
+    history.setLine(8, line2.data(), line2.size());
+    history.getLine(6, out);
+    CHECK(out.empty());
+    history.getLine(8, out);
+    CHECK(sameLine(out, line2));
+
+    // Rewriting a line replaces it.
+    auto line3 = makeLine("rewritten", 40);
+    history.setLine(5, line3.data(), line3.size());
+    history.getLine(5, out);
+    CHECK(sameLine(out, line3));
+
+    // A reset renumbers the recorded lines to end just above the new line.
+    history.reset(100);
+    CHECK(history.firstLine() == 96 && history.endLine() == 100);
+    history.getLine(96, out);
+    CHECK(sameLine(out, line3));
+}
+
+static void testLimits()
+{
+    ScrollbackHistory history(100, 1024 * 1024);
+    for (int i = 0; i < 1000; ++i) {
+        char text[32];
+        sprintf(text, "line %d", i);
+        auto line = makeLine(text, 80);
+        history.setLine(i, line.data(), line.size());
+    }
+    CHECK(history.lineCount() == 100);
+    CHECK(history.firstLine() == 900);
+    std::vector<CHAR_INFO> out;
+    history.getLine(950, out);
+    CHECK(sameLine(out, makeLine("line 950", 80)));
+
+    ScrollbackHistory small(100000, 4096);
+    for (int i = 0; i < 1000; ++i) {
+        auto line = makeLine("0123456789abcdef0123456789abcdef", 80);
+        small.setLine(i, line.data(), line.size());
+    }
+    CHECK(small.encodedBytes() <= 4096);
+    CHECK(small.endLine() == 1000);
+}
+
+// Simulate typical console output: text of varying lengths followed by
+// blanks, with an occasional colored prompt.
+static void benchmark()
+{
+    const int kWidth = 120;
+    const int kLines = 10000;
+    std::vector<std::vector<CHAR_INFO>> lines;
+    srand(1);
+    for (int i = 0; i < kLines; ++i) {
+        char text[kWidth + 1];
+        const int len = rand() % 100;
+        for (int j = 0; j < len; ++j) {
+            text[j] = (rand() % 6 == 0) ? ' ' : 'a' + rand() % 26;
+        }
+        text[len] = '\0';
+        lines.push_back(makeLine(text, kWidth));
+        if (i % 10 == 0) {
+            for (int j = 0; j < 8; ++j) {
+                lines.back()[j].Attributes = 0x0A;
+            }
+        }
+    }
+
+    ScrollbackHistory history(kLines, 64 * 1024 * 1024);
+    clock_t start = clock();
+    for (int i = 0; i < kLines; ++i) {
+        history.setLine(i, lines[i].data(), kWidth);
+    }
+    clock_t stop = clock();
+    printf("record: %.3fms per 10k lines\n",
+        (double)(stop - start) / CLOCKS_PER_SEC * 1000.0);
+    printf("memory: %zu bytes per 10k lines (%zu encoded, raw CHAR_INFO %zu)\n",
+        history.memoryUsage(), history.encodedBytes(),
+        sizeof(CHAR_INFO) * kWidth * kLines);
+
+    const int kIterations = 20;
+    std::vector<CHAR_INFO> out;
+    size_t cells = 0;
+    start = clock();
+    for (int iter = 0; iter < kIterations; ++iter) {
+        for (int64_t i = history.firstLine(); i < history.endLine(); ++i) {
+            history.getLine(i, out);
+            cells += out.size();
+        }
+    }
+    stop = clock();
+    CHECK(cells == static_cast<size_t>(kWidth) * kLines * kIterations);
+    printf("replay: %.3fms per 10k lines\n",
+        (double)(stop - start) / CLOCKS_PER_SEC * 1000.0 / kIterations);
+}
+
+int main()
+{
+    testRoundTrip();
+    testLimits();
+    benchmark();
+    return unitTestResult();
+}
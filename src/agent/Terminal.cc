@@ -533,3 +533,12 @@ void Terminal::enableMouseMode(bool enabled)
             CSI "?1006l" CSI "?1015l" CSI "?1003l" CSI "?1002l" CSI "?1000l");
     }
 }
+
+void Terminal::enableBracketedPaste(bool enabled)
+{
+    if (m_bracketedPasteEnabled == enabled || m_plainMode) {
+        return;
+    }
+    m_bracketedPasteEnabled = enabled;
+    m_output.write(enabled ? CSI "?2004h" : CSI "?2004l");
+}
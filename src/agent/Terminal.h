@@ -51,6 +51,7 @@ private:
 
 public:
     void enableMouseMode(bool enabled);
+    void enableBracketedPaste(bool enabled);
 
 private:
     NamedPipe &m_output;
@@ -64,6 +65,7 @@ private:
     bool m_plainMode = false;
     bool m_outputColor = true;
     bool m_mouseModeEnabled = false;
+    bool m_bracketedPasteEnabled = false;
 };
 
 #endif // TERMINAL_H
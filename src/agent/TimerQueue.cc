@@ -0,0 +1,159 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "TimerQueue.h"
+
+#include <algorithm>
+
+#include "../shared/WinptyAssert.h"
+
+namespace {
+
+// True if tick `a` is after tick `b`, modulo 2^32.
+static inline bool tickAfter(TimerQueue::Tick a, TimerQueue::Tick b) {
+    return static_cast<int32_t>(a - b) > 0;
+}
+
+// std::push_heap builds a max-heap, so put the earliest deadline on top.
+struct LaterDeadline {
+    template <typename Entry>
+    bool operator()(const Entry &a, const Entry &b) const {
+        return tickAfter(a.deadline, b.deadline);
+    }
+};
+
+} // anonymous namespace
+
+int TimerQueue::createTimer()
+{
+    m_timers.push_back(Timer());
+    return static_cast<int>(m_timers.size() - 1);
+}
+
+void TimerQueue::start(int id, Tick now, uint32_t delayMs, uint32_t periodMs,
+                       uint32_t slackMs)
+{
+    ASSERT(id >= 0 && static_cast<size_t>(id) < m_timers.size());
+    ASSERT(delayMs < 0x80000000u && periodMs < 0x80000000u);
+    Timer &timer = m_timers[id];
+    if (!timer.active) {
+        ++m_activeCount;
+    }
+    timer.active = true;
+    ++timer.generation;
+    timer.deadline = now + delayMs;
+    timer.period = periodMs;
+    timer.slack = slackMs;
+    push(id);
+}
+
+void TimerQueue::stop(int id)
+{
+    ASSERT(id >= 0 && static_cast<size_t>(id) < m_timers.size());
+    Timer &timer = m_timers[id];
+    if (timer.active) {
+        --m_activeCount;
+    }
+    timer.active = false;
+    ++timer.generation;
+}
+
+bool TimerQueue::isActive(int id) const
+{
+    ASSERT(id >= 0 && static_cast<size_t>(id) < m_timers.size());
+    return m_timers[id].active;
+}
+
+uint32_t TimerQueue::timeUntilNext(Tick now)
+{
+    pruneTop();
+    if (m_heap.empty()) {
+        return kNoDeadline;
+    }
+    const Entry &top = m_heap.front();
+    return tickAfter(top.deadline, now) ? top.deadline - now : 0;
+}
+
+bool TimerQueue::popDue(Tick now, int &idOut)
+{
+    pruneTop();
+    if (m_heap.empty()) {
+        return false;
+    }
+    const int id = m_heap.front().id;
+    Timer &timer = m_timers[id];
+    // Let the timer fire a little early if that's within its slack.
+    if (tickAfter(timer.deadline, now + timer.slack)) {
+        return false;
+    }
+    popTop();
+    if (timer.period > 0) {
+        timer.deadline += timer.period;
+        if (!tickAfter(timer.deadline, now)) {
+            timer.deadline = now + timer.period;
+        }
+        push(id);
+    } else {
+        timer.active = false;
+        --m_activeCount;
+    }
+    idOut = id;
+    return true;
+}
+
+bool TimerQueue::isStale(const Entry &entry) const
+{
+    return entry.generation != m_timers[entry.id].generation;
+}
+
+void TimerQueue::push(int id)
+{
+    const Timer &timer = m_timers[id];
+    const Entry entry = { timer.deadline, id, timer.generation };
+    m_heap.push_back(entry);
+    std::push_heap(m_heap.begin(), m_heap.end(), LaterDeadline());
+    if (m_heap.size() > 2 * m_activeCount + 16) {
+        compact();
+    }
+}
+
+void TimerQueue::popTop()
+{
+    std::pop_heap(m_heap.begin(), m_heap.end(), LaterDeadline());
+    m_heap.pop_back();
+}
+
+void TimerQueue::pruneTop()
+{
+    while (!m_heap.empty() && isStale(m_heap.front())) {
+        popTop();
+    }
+}
+
+// Drop every stale entry (e.g. after a timer was restarted many times).
+void TimerQueue::compact()
+{
+    m_heap.erase(
+        std::remove_if(m_heap.begin(), m_heap.end(),
+            [this](const Entry &entry) { return isStale(entry); }),
+        m_heap.end());
+    std::make_heap(m_heap.begin(), m_heap.end(), LaterDeadline());
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_TIMER_QUEUE_H
+#define AGENT_TIMER_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// One-shot and periodic timers for the EventLoop, kept in a binary heap
+// ordered by deadline.  Times are 32-bit millisecond ticks (GetTickCount),
+// compared modulo 2^32, so they keep working when the tick count wraps as
+// long as no deadline is more than ~24 days away.
+//
+// Stopping or restarting a timer leaves its old heap entry behind; stale
+// entries are discarded when they reach the top of the heap, or all at once
+// when they outnumber the live ones.
+//
+// This class doesn't depend on windows.h, so it can be tested anywhere.
+class TimerQueue {
+public:
+    typedef uint32_t Tick;
+    enum : uint32_t { kNoDeadline = 0xFFFFFFFFu };
+
+    // Allocates a stopped timer and returns its ID.
+    int createTimer();
+
+    // Arms the timer to fire `delayMs` after `now`, then every `periodMs` if
+    // it's non-zero.  Restarting an armed timer replaces its deadline.  The
+    // timer may fire up to `slackMs` early so that it shares a wakeup with
+    // an earlier timer.
+    void start(int id, Tick now, uint32_t delayMs, uint32_t periodMs = 0,
+               uint32_t slackMs = 0);
+    void stop(int id);
+    bool isActive(int id) const;
+
+    // Returns the number of milliseconds until the earliest deadline, 0 if a
+    // timer is already due, or kNoDeadline if no timer is armed.
+    uint32_t timeUntilNext(Tick now);
+
+    // If a timer is due, sets idOut, re-arms it if it's periodic, and
+    // returns true.  A periodic timer that has fallen more than a period
+    // behind skips the missed firings.
+    bool popDue(Tick now, int &idOut);
+
+    size_t heapSize() const { return m_heap.size(); }
+
+private:
+    struct Timer {
+        bool active = false;
+        uint32_t generation = 0;
+        Tick deadline = 0;
+        uint32_t period = 0;
+        uint32_t slack = 0;
+    };
+    struct Entry {
+        Tick deadline;
+        int id;
+        uint32_t generation;
+    };
+
+    bool isStale(const Entry &entry) const;
+    void push(int id);
+    void popTop();
+    void pruneTop();
+    void compact();
+
+    std::vector<Timer> m_timers;
+    std::vector<Entry> m_heap;
+    size_t m_activeCount = 0;
+};
+
+#endif // AGENT_TIMER_QUEUE_H
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests and a benchmark for TimerQueue.  Build with TimerQueue.cc and
+// -DWINPTY_AGENT_ASSERT.
+
+#include "TimerQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+// Returns the IDs that fire at `now`, in order.
+static std::vector<int> fire(TimerQueue &tq, TimerQueue::Tick now) {
+    std::vector<int> ret;
+    int id = -1;
+    while (tq.popDue(now, id)) {
+        ret.push_back(id);
+    }
+    return ret;
+}
+
+static void testOneShotAndPeriodic(TimerQueue::Tick base) {
+    TimerQueue tq;
+    const int poll = tq.createTimer();
+    const int esc = tq.createTimer();
+    CHECK(tq.timeUntilNext(base) == TimerQueue::kNoDeadline);
+
+    tq.start(poll, base, 25, 25);
+    tq.start(esc, base, 100);
+    CHECK(tq.timeUntilNext(base) == 25);
+    CHECK(fire(tq, base + 24).empty());
+    CHECK(fire(tq, base + 25) == std::vector<int>{ poll });
+    CHECK(tq.timeUntilNext(base + 30) == 20);
+
+    // Restarting the one-shot timer replaces its deadline.
+    tq.start(esc, base + 30, 100);
+    std::vector<int> fired;
+    for (TimerQueue::Tick t = base + 31; t != base + 131; ++t) {
+        for (int id : fire(tq, t)) {
+            if (id == esc) {
+                CHECK(t == base + 130);
+            }
+            fired.push_back(id);
+        }
+    }
+    // Polls at 50, 75, 100, and 125, then the ESC timer at 130.
+    CHECK(fired.size() == 5 && fired.back() == esc);
+    CHECK(!tq.isActive(esc) && tq.isActive(poll));
+
+    tq.stop(poll);
+    CHECK(tq.timeUntilNext(base + 200) == TimerQueue::kNoDeadline);
+    CHECK(fire(tq, base + 1000).empty());
+}
+
+static void testLateAndCoalesced() {
+    TimerQueue tq;
+    const int a = tq.createTimer();
+    const int b = tq.createTimer();
+    tq.start(a, 0, 10, 10);
+    // A late event loop fires the periodic timer once, not once per missed
+    // period.
+    CHECK(fire(tq, 55) == std::vector<int>{ a });
+    CHECK(tq.timeUntilNext(55) == 10);
+
+    // b is due at 70 but may run 10ms early, so it shares a's wakeup at 65.
+    tq.start(b, 55, 15, 0, 10);
+    const auto both = fire(tq, 65);
+    CHECK(both.size() == 2);
+    CHECK(!tq.isActive(b));
+}
+
+static void testRestartChurn() {
+    // Restarting a timer on every keystroke mustn't grow the heap forever.
+    TimerQueue tq;
+    const int esc = tq.createTimer();
+    for (int i = 0; i < 100000; ++i) {
+        tq.start(esc, i, 1000);
+    }
+    CHECK(tq.heapSize() < 64);
+    CHECK(fire(tq, 100998).empty());
+    CHECK(fire(tq, 100999) == std::vector<int>{ esc });
+}
+
+static double nowSeconds() {
+    return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+// 1000 periodic timers with assorted periods, plus a one-shot timer that is
+// restarted every tick, simulated over 100 seconds of 1ms ticks.
+static void benchmark() {
+    TimerQueue tq;
+    const int kTimers = 1000;
+    srand(1);
+    for (int i = 0; i < kTimers; ++i) {
+        const int id = tq.createTimer();
+        const uint32_t period = 1 + rand() % 500;
+        tq.start(id, 0, period, period, rand() % 5);
+    }
+    const int esc = tq.createTimer();
+    const double start = nowSeconds();
+    long long fired = 0;
+    long long waits = 0;
+    const TimerQueue::Tick kEnd = 100 * 1000;
+    TimerQueue::Tick now = 0;
+    while (now < kEnd) {
+        tq.start(esc, now, 1000);
+        int id = -1;
+        while (tq.popDue(now, id)) {
+            ++fired;
+        }
+        // Jump straight to the next deadline, as the EventLoop would.
+        const uint32_t wait = tq.timeUntilNext(now);
+        now += wait > 0 ? wait : 1;
+        ++waits;
+    }
+    const double elapsed = nowSeconds() - start;
+    printf("%lld timer firings and %lld wakeups in %.3f s: %.1f ns/firing\n",
+           fired, waits, elapsed, elapsed * 1e9 / fired);
+}
+
+int main() {
+    testOneShotAndPeriodic(0);
+    // Repeat across the 32-bit tick wraparound.
+    testOneShotAndPeriodic(0xFFFFFFC0u);
+    testLateAndCoalesced();
+    testRestartChurn();
+    benchmark();
+    return unitTestResult();
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_VIRTUAL_KEYS_H
+#define AGENT_VIRTUAL_KEYS_H
+
+// The virtual-key codes and control key state flags that the default input
+// map uses.  On Windows they come from windows.h.  Elsewhere, they're
+// defined here with the same values, so the input map, the input DFA, and
+// their tests build with only the host compiler.
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#define VK_BACK         0x08
+#define VK_TAB          0x09
+#define VK_CLEAR        0x0C
+#define VK_RETURN       0x0D
+#define VK_ESCAPE       0x1B
+#define VK_PRIOR        0x21
+#define VK_NEXT         0x22
+#define VK_END          0x23
+#define VK_HOME         0x24
+#define VK_LEFT         0x25
+#define VK_UP           0x26
+#define VK_RIGHT        0x27
+#define VK_DOWN         0x28
+#define VK_INSERT       0x2D
+#define VK_DELETE       0x2E
+#define VK_MULTIPLY     0x6A
+#define VK_ADD          0x6B
+#define VK_SUBTRACT     0x6D
+#define VK_DIVIDE       0x6F
+#define VK_F1           0x70
+#define VK_F2           0x71
+#define VK_F3           0x72
+#define VK_F4           0x73
+#define VK_F5           0x74
+#define VK_F6           0x75
+#define VK_F7           0x76
+#define VK_F8           0x77
+#define VK_F9           0x78
+#define VK_F10          0x79
+#define VK_F11          0x7A
+#define VK_F12          0x7B
+
+#define RIGHT_ALT_PRESSED   0x0001
+#define LEFT_ALT_PRESSED    0x0002
+#define RIGHT_CTRL_PRESSED  0x0004
+#define LEFT_CTRL_PRESSED   0x0008
+#define SHIFT_PRESSED       0x0010
+#define ENHANCED_KEY        0x0100
+
+#endif
+
+#endif // AGENT_VIRTUAL_KEYS_H
@@ -33,7 +33,8 @@
 #include "DebugShowInput.h"
 
 const char USAGE[] =
-"Usage: %ls controlPipeName flags mouseMode cols rows\n"
+"Usage: %ls controlPipeName flags mouseMode cols rows inputQueueLimit\n"
+"           escapeTimeoutMs\n"
 "Usage: %ls controlPipeName --create-desktop\n"
 "\n"
 "Ordinarily, this program is launched by winpty.dll and is not directly\n"
@@ -96,7 +97,7 @@ int main() {
         return 0;
     }
 
-    if (argc != 6) {
+    if (argc != 8) {
         fprintf(stderr, USAGE, argv[0], argv[0], argv[0]);
         return 1;
     }
@@ -105,7 +106,9 @@ int main() {
                 winpty_atoi64(utf8FromWide(argv[2]).c_str()),
                 atoi(utf8FromWide(argv[3]).c_str()),
                 atoi(utf8FromWide(argv[4]).c_str()),
-                atoi(utf8FromWide(argv[5]).c_str()));
+                atoi(utf8FromWide(argv[5]).c_str()),
+                atoi(utf8FromWide(argv[6]).c_str()),
+                atoi(utf8FromWide(argv[7]).c_str()));
     agent.run();
 
     // The Agent destructor shouldn't return, but if it does, exit
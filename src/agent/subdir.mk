@@ -25,18 +25,24 @@ $(eval $(call def_mingw_target,agent,-DWINPTY_AGENT_ASSERT))
 AGENT_OBJECTS = \
 	build/agent/agent/Agent.o \
 	build/agent/agent/AgentCreateDesktop.o \
+	build/agent/agent/ChunkedByteQueue.o \
 	build/agent/agent/ConsoleFont.o \
 	build/agent/agent/ConsoleInput.o \
 	build/agent/agent/ConsoleInputReencoding.o \
 	build/agent/agent/ConsoleLine.o \
 	build/agent/agent/DebugShowInput.o \
-	build/agent/agent/DefaultInputMap.o \
 	build/agent/agent/EventLoop.o \
+	build/agent/agent/InOrderIoQueue.o \
+	build/agent/agent/InputDfa.o \
 	build/agent/agent/InputMap.o \
+	build/agent/agent/InputMapDebug.o \
 	build/agent/agent/LargeConsoleRead.o \
 	build/agent/agent/NamedPipe.o \
+	build/agent/agent/PlainTextDecoder.o \
 	build/agent/agent/Scraper.o \
+	build/agent/agent/ScrollbackHistory.o \
 	build/agent/agent/Terminal.o \
+	build/agent/agent/TimerQueue.o \
 	build/agent/agent/Win32Console.o \
 	build/agent/agent/Win32ConsoleBuffer.o \
 	build/agent/agent/main.o \
@@ -45,17 +51,45 @@ AGENT_OBJECTS = \
 	build/agent/shared/DebugClient.o \
 	build/agent/shared/GenRandom.o \
 	build/agent/shared/OwnedHandle.o \
+	build/agent/shared/ScreenSnapshot.o \
+	build/agent/shared/SpscRing.o \
+	build/agent/shared/StartupTimeline.o \
 	build/agent/shared/StringUtil.o \
 	build/agent/shared/WindowsSecurity.o \
 	build/agent/shared/WindowsVersion.o \
 	build/agent/shared/WinptyAssert.o \
 	build/agent/shared/WinptyException.o \
-	build/agent/shared/WinptyVersion.o
+	build/agent/shared/WinptyVersion.o \
+	build/agent/shared/WireFormat.o
 
 build/agent/shared/WinptyVersion.o : build/gen/GenVersion.h
 
+# The default input map and the DFA compiled from it are generated ahead of
+# time, as static tables, by a program that runs on the build machine.  It's
+# built with the host compiler, because a MinGW cross build's binaries may
+# not run there.
+
+$(eval $(call def_host_target,host,-DWINPTY_AGENT_ASSERT))
+
+GEN_INPUT_TABLES_OBJECTS = \
+	build/host/agent/DefaultInputMap.o \
+	build/host/agent/GenInputTables.o \
+	build/host/agent/InputDfa.o \
+	build/host/agent/InputMap.o
+
+build/host/gen-input-tables : $(GEN_INPUT_TABLES_OBJECTS)
+	$(info Linking $@)
+	@$(HOST_CXX) -o $@ $^
+
+build/gen/DefaultInputTables.h : build/host/gen-input-tables | $$(@D)/.mkdir
+	$(info Generating $@)
+	@build/host/gen-input-tables $@
+
+build/agent/agent/ConsoleInput.o : build/gen/DefaultInputTables.h
+
 build/winpty-agent.exe : $(AGENT_OBJECTS)
 	$(info Linking $@)
 	@$(MINGW_CXX) $(MINGW_LDFLAGS) -o $@ $^
 
 -include $(AGENT_OBJECTS:.o=.d)
+-include $(GEN_INPUT_TABLES_OBJECTS:.o=.d)
@@ -106,6 +106,40 @@ winpty_config_set_mouse_mode(winpty_config_t *cfg, int mouseMode);
 WINPTY_API void
 winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs);
 
+/* Coalesce rapid winpty_set_size calls, e.g. while the user drags a window.
+ * A call made less than debounceMs after the last resize was sent returns
+ * TRUE immediately, and the latest such size is sent when the interval
+ * elapses.  An error from a deferred resize is reported by the next RPC,
+ * which fails with the resize's error code.  Other RPCs are not ordered
+ * after a deferred resize.  The default, 0, disables debouncing. */
+WINPTY_API void
+winpty_config_set_resize_debounce(winpty_config_t *cfg, DWORD debounceMs);
+
+/* If async is TRUE, winpty_set_size returns once the request is sent,
+ * without waiting for the agent to apply the new size.  A failure is
+ * reported by the next RPC instead, which fails with the resize's error
+ * code and a message naming winpty_set_size. */
+WINPTY_API void
+winpty_config_set_async_resize(winpty_config_t *cfg, BOOL async);
+
+/* Limit the number of unread events the agent leaves in the console input
+ * buffer.  Input beyond the limit (e.g. a large paste) is held by the agent
+ * and written as the console program reads it.  While the agent holds that
+ * many events itself, it stops reading the CONIN pipe, so the client's
+ * writes back up.  Ctrl-C, in processed input mode, is not held.  The
+ * default, 0, means no limit. */
+WINPTY_API void
+winpty_config_set_input_queue_limit(winpty_config_t *cfg, DWORD maxEvents);
+
+/* When the input ends with an incomplete escape sequence (e.g. a lone ESC
+ * from the Escape key), the agent waits this long for the rest of it before
+ * decoding the bytes as they are.  A longer timeout suits a terminal on a
+ * slow connection.  (The agent also sends a cursor position query after such
+ * input, and the terminal's reply ends the wait early.)  The default is 50
+ * milliseconds. */
+WINPTY_API void
+winpty_config_set_escape_timeout(winpty_config_t *cfg, DWORD timeoutMs);
+
 
 
 /*****************************************************************************
@@ -121,6 +155,40 @@ WINPTY_API winpty_t *
 winpty_open(const winpty_config_t *cfg,
             winpty_error_ptr_t *err /*OPTIONAL*/);
 
+/* An agent pool keeps idle agents started ahead of time, so that a program
+ * that runs many short-lived commands doesn't pay for agent startup (the
+ * background desktop, the agent process, console setup, and the pipe
+ * handshake) on each one.  A background thread refills the pool.  All of
+ * the pool's agents use the configuration passed to winpty_pool_new.  The
+ * winpty_pool_t object is thread-safe. */
+typedef struct winpty_pool_s winpty_pool_t;
+
+/* Creates a pool that keeps idleCount agents ready.  Agents that stay idle
+ * for maxIdleMs are replaced; 0 keeps them indefinitely.  Returns NULL on
+ * error. */
+WINPTY_API winpty_pool_t *
+winpty_pool_new(const winpty_config_t *cfg, int idleCount, DWORD maxIdleMs,
+                winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Returns a started agent, which the caller owns as if it came from
+ * winpty_open.  If no agent is idle, this call waits up to timeoutMs for one
+ * that the pool is starting, then starts one itself.  Returns NULL on
+ * error. */
+WINPTY_API winpty_t *
+winpty_pool_acquire(winpty_pool_t *pool, DWORD timeoutMs,
+                    winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Gives an agent back to the pool.  An agent that hasn't been used for an
+ * RPC (e.g. winpty_spawn or winpty_set_size) is kept if the pool has room;
+ * otherwise, the agent is freed as with winpty_free.  An agent whose data
+ * pipe names were fetched (winpty_conin_name etc.) or whose CONOUT ring was
+ * read is also freed, since its pipes may already be connected. */
+WINPTY_API void winpty_pool_release(winpty_pool_t *pool, winpty_t *wp);
+
+/* Stops the refill thread and frees the idle agents.  Agents acquired from
+ * the pool are unaffected. */
+WINPTY_API void winpty_pool_free(winpty_pool_t *pool);
+
 /* A handle to the agent process.  This value is valid for the lifetime of the
  * winpty_t object.  Do not close it. */
 WINPTY_API HANDLE winpty_agent_process(winpty_t *wp);
@@ -136,6 +204,8 @@ WINPTY_API HANDLE winpty_agent_process(winpty_t *wp);
  * The strings are freed when the winpty_t object is freed.
  *
  * winpty_conerr_name returns NULL unless WINPTY_FLAG_CONERR is specified.
+ * winpty_conout_name returns NULL if WINPTY_FLAG_CONOUT_SHARED_MEMORY is
+ * specified.
  *
  * N.B.: CreateFile does not block when connecting to a local server pipe.  If
  * the server pipe does not exist or is already connected, then it fails
@@ -144,6 +214,17 @@ WINPTY_API LPCWSTR winpty_conin_name(winpty_t *wp);
 WINPTY_API LPCWSTR winpty_conout_name(winpty_t *wp);
 WINPTY_API LPCWSTR winpty_conerr_name(winpty_t *wp);
 
+/* With WINPTY_FLAG_CONOUT_SHARED_MEMORY, reads CONOUT output from the agent's
+ * shared-memory ring.  Blocks until at least one byte is available, then
+ * copies up to size bytes into buffer and sets *amount.  At the end of the
+ * output (i.e. the agent has shut down or the CONOUT was reattached), *amount
+ * is set to 0.  Only one thread may read at a time.  A read that is blocked
+ * when another thread calls winpty_reattach_conout returns with *amount set
+ * to 0, and the next read uses the new ring.  Returns FALSE on error. */
+WINPTY_API BOOL
+winpty_conout_read(winpty_t *wp, void *buffer, DWORD size, DWORD *amount,
+                   winpty_error_ptr_t *err /*OPTIONAL*/);
+
 
 
 /*****************************************************************************
@@ -223,6 +304,157 @@ WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
                                 winpty_error_ptr_t *err /*OPTIONAL*/);
 
+/* A request token for an RPC that has been sent to the agent.  Any number of
+ * requests may be in flight at once, and the agent answers them in order.
+ * A libwinpty thread reads the replies.  Each request is signaled when its
+ * reply arrives, or when the RPC fails.  Free every request before freeing
+ * the winpty_t object. */
+typedef struct winpty_request_s winpty_request_t;
+
+/* Called once on the libwinpty reply thread when a request completes or
+ * fails, even if the request was already freed.  (Requests still in flight
+ * fail during winpty_free.)  The callback should return quickly, and it must
+ * not call winpty_free or a _finish function. */
+typedef void (*winpty_request_callback_t)(void *context);
+
+/* A manual-reset event that is signaled when the request completes.  The
+ * handle is valid until the request is freed.  Do not close it. */
+WINPTY_API HANDLE winpty_request_event(winpty_request_t *req);
+
+/* Frees the request.  If it hasn't completed, its reply is discarded. */
+WINPTY_API void winpty_request_free(winpty_request_t *req);
+
+/* Each _async function sends a request and returns without waiting for the
+ * reply.  It returns NULL on error.  callback is optional.
+ *
+ * The matching _finish function waits for the request to complete (up to
+ * the agent timeout), then returns the same results as the blocking
+ * function.  Call it at most once per request. */
+WINPTY_API winpty_request_t *
+winpty_set_size_async(winpty_t *wp, int cols, int rows,
+                      winpty_request_callback_t callback /*OPTIONAL*/,
+                      void *context,
+                      winpty_error_ptr_t *err /*OPTIONAL*/);
+WINPTY_API BOOL
+winpty_set_size_finish(winpty_request_t *req,
+                       winpty_error_ptr_t *err /*OPTIONAL*/);
+
+WINPTY_API winpty_request_t *
+winpty_get_console_process_list_async(
+    winpty_t *wp,
+    winpty_request_callback_t callback /*OPTIONAL*/,
+    void *context,
+    winpty_error_ptr_t *err /*OPTIONAL*/);
+WINPTY_API int
+winpty_get_console_process_list_finish(winpty_request_t *req,
+                                       int *processList,
+                                       const int processCount,
+                                       winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* A batch sends several agent requests in one control pipe packet and gets
+ * back one aggregated reply, so that (for example) a resize followed by a
+ * process list query costs a single round trip.  The winpty_batch_add_*
+ * functions return the request's index within the batch, or -1 on error.
+ * After winpty_batch_run, query the results by index.  A resize in a batch
+ * bypasses winpty_config_set_resize_debounce and replaces a resize that is
+ * still being debounced.  A winpty_batch_t runs once and is not
+ * thread-safe. */
+typedef struct winpty_batch_s winpty_batch_t;
+
+WINPTY_API winpty_batch_t *
+winpty_batch_new(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+WINPTY_API int
+winpty_batch_add_set_size(winpty_batch_t *batch, int cols, int rows,
+                          winpty_error_ptr_t *err /*OPTIONAL*/);
+
+WINPTY_API int
+winpty_batch_add_get_console_process_list(
+    winpty_batch_t *batch, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Sends the batch and waits for its reply.  Returns FALSE on error. */
+WINPTY_API BOOL
+winpty_batch_run(winpty_batch_t *batch, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Returns the result of a winpty_batch_add_get_console_process_list request,
+ * like winpty_get_console_process_list. */
+WINPTY_API int
+winpty_batch_console_process_list(winpty_batch_t *batch, int index,
+                                  int *processList, const int processCount,
+                                  winpty_error_ptr_t *err /*OPTIONAL*/);
+
+WINPTY_API void winpty_batch_free(winpty_batch_t *batch);
+
+/* Replaces the agent's CONOUT pipe with a new pipe and returns its name, which
+ * remains valid until the next winpty_reattach_conout call or until the
+ * winpty_t object is freed.  The previous CONOUT client, if any, is
+ * disconnected.  Once the new pipe is connected, the agent sends it a replay
+ * of its recent scrollback history and the current screen, followed by new
+ * output.  The amount of history retained by the agent is bounded.
+ *
+ * This call is intended for a client that has lost its CONOUT connection
+ * (e.g. after a crash) and wants to restore the terminal content.  It updates
+ * the name returned by winpty_conout_name, so it must not race with that
+ * function.  With WINPTY_FLAG_CONOUT_SHARED_MEMORY, it instead reopens the
+ * ring read by winpty_conout_read and returns an empty string.  Returns NULL
+ * on error. */
+WINPTY_API LPCWSTR
+winpty_reattach_conout(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* The winpty_screen_snapshot_t object holds a binary snapshot of the visible
+ * console window.  All fields are little-endian.  The blob starts with this
+ * header of 32-bit integers:
+ *
+ *     magic            0x4E535057 ("WPSN")
+ *     version          1
+ *     headerSize       byte offset of the cell array (56 for version 1)
+ *     cellFormat       1 == UTF-16 code units
+ *     cols, rows       size of the cell array
+ *     windowLeft/Top   position of the window in the console buffer
+ *     bufferCols/Rows  size of the console buffer
+ *     cursorX/Y        cursor position, relative to the window
+ *     cursorVisible    non-zero if the cursor is visible within the window
+ *     attrRunCount     number of attribute runs
+ *
+ * It is followed by cols * rows 16-bit cells in row-major order, then
+ * attrRunCount runs of { UINT32 length; UINT16 attributes; UINT16 reserved; }
+ * that assign console attributes (e.g. FOREGROUND_RED) to consecutive cells.
+ * As with CHAR_INFO, a full-width character occupies two cells.  Code that
+ * reads the blob should check the version and honor headerSize. */
+typedef struct winpty_screen_snapshot_s winpty_screen_snapshot_t;
+
+/* Gets a snapshot of the visible console window.  The agent builds it from
+ * its most recent scrape of the console, scraping again first if the last
+ * scrape is stale.  Returns NULL on error. */
+WINPTY_API winpty_screen_snapshot_t *
+winpty_get_screen_snapshot(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Returns a pointer to the snapshot blob and stores its size in *size.  The
+ * pointer is valid until the snapshot is freed. */
+WINPTY_API const void *
+winpty_screen_snapshot_data(winpty_screen_snapshot_t *snapshot, DWORD *size);
+
+WINPTY_API void winpty_screen_snapshot_free(winpty_screen_snapshot_t *snapshot);
+
+/* Writes a timeline of the startup phases of winpty_open and the agent to
+ * the given file, in the Chrome trace event format (viewable with
+ * chrome://tracing or Perfetto).  The phases are only recorded if the
+ * WINPTY_DEBUG environment variable includes startup_timeline when
+ * winpty_open is called.  The agent's part of the timeline is complete once
+ * it has finished initializing, which it does before handling this call.
+ * Returns FALSE on error. */
+WINPTY_API BOOL
+winpty_save_startup_timeline(winpty_t *wp, LPCWSTR path,
+                             winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Reads agent statistics.  ids is an array of count WINPTY_STAT_xxx
+ * constants, and the statistics are stored in the corresponding elements of
+ * values.  A statistic the agent doesn't know reads as 0.  The counts are
+ * cumulative from agent startup.  Returns FALSE on error. */
+WINPTY_API BOOL
+winpty_get_stats(winpty_t *wp, const int *ids, UINT64 *values, int count,
+                 winpty_error_ptr_t *err /*OPTIONAL*/);
+
 /* Frees the winpty_t object and the OS resources contained in it.  This
  * call breaks the connection with the agent, which should then close its
  * console, terminating the processes attached to it.
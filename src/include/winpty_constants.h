@@ -76,11 +76,33 @@
  * See https://github.com/rprichard/winpty/issues/58. */
 #define WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION 0x8ull
 
+/* Send CONOUT output through a shared-memory ring buffer rather than a named
+ * pipe.  This avoids the pipe's copies and small writes for high-volume
+ * output.  There is no CONOUT pipe in this mode: winpty_conout_name returns
+ * NULL, and the client reads output with winpty_conout_read instead. */
+#define WINPTY_FLAG_CONOUT_SHARED_MEMORY 0x10ull
+
+/* Enable bracketed paste mode (2004) on the terminal.  The agent decodes a
+ * paste as literal text, even if it contains escape sequences or control
+ * characters.  If the console is in VT input mode, the agent passes the paste
+ * markers through to the console. */
+#define WINPTY_FLAG_BRACKETED_PASTE     0x20ull
+
+/* Treat an ESC byte that arrives by itself (i.e. it is the only input in the
+ * CONIN pipe) as an Escape keypress at once, rather than waiting for the
+ * escape timeout.  This helps programs like vim, but it can split an escape
+ * sequence that the terminal's connection delivers in pieces.  See
+ * winpty_config_set_escape_timeout. */
+#define WINPTY_FLAG_LONE_ESC_IS_KEY     0x40ull
+
 #define WINPTY_FLAG_MASK (0ull \
     | WINPTY_FLAG_CONERR \
     | WINPTY_FLAG_PLAIN_OUTPUT \
     | WINPTY_FLAG_COLOR_ESCAPES \
     | WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION \
+    | WINPTY_FLAG_CONOUT_SHARED_MEMORY \
+    | WINPTY_FLAG_BRACKETED_PASTE \
+    | WINPTY_FLAG_LONE_ESC_IS_KEY \
 )
 
 /* QuickEdit mode is initially disabled, and the agent does not send mouse
@@ -128,4 +150,37 @@
 
 
 
+/*****************************************************************************
+ * winpty agent RPC call: statistics (winpty_get_stats). */
+
+/* The number of mouse events the agent has written into CONIN, counting
+ * each event of a coalesced run. */
+#define WINPTY_STAT_MOUSE_EVENTS            1
+
+/* The number of those mouse events that were coalesced away.  Within one
+ * batch of input, a run of motion events with the same buttons and modifier
+ * keys is written as one event with the final position. */
+#define WINPTY_STAT_MOUSE_EVENTS_COALESCED  2
+
+/* Input latency, in microseconds.  INPUT_TO_INJECT is measured for each
+ * batch of CONIN input, from its arrival at the agent until the agent writes
+ * its first input record into the console.  INJECT_TO_ECHO runs from an
+ * injection until the end of the next scrape that sends CONOUT output,
+ * which is usually the echo.  The percentiles are upper bounds, accurate to
+ * within 12.5%.  With WINPTY_DEBUG=latency_probe, the agent also reports
+ * each echo's latencies in-band, following the echoed output, as
+ * ESC ] 9999 ; winpty-latency ; <input-to-inject> ; <inject-to-echo> BEL. */
+#define WINPTY_STAT_INPUT_TO_INJECT_COUNT   3
+#define WINPTY_STAT_INPUT_TO_INJECT_P50_US  4
+#define WINPTY_STAT_INPUT_TO_INJECT_P90_US  5
+#define WINPTY_STAT_INPUT_TO_INJECT_P99_US  6
+#define WINPTY_STAT_INPUT_TO_INJECT_MAX_US  7
+#define WINPTY_STAT_INJECT_TO_ECHO_COUNT    8
+#define WINPTY_STAT_INJECT_TO_ECHO_P50_US   9
+#define WINPTY_STAT_INJECT_TO_ECHO_P90_US   10
+#define WINPTY_STAT_INJECT_TO_ECHO_P99_US   11
+#define WINPTY_STAT_INJECT_TO_ECHO_MAX_US   12
+
+
+
 #endif /* WINPTY_CONSTANTS_H */
@@ -0,0 +1,151 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "AgentPool.h"
+
+#include <algorithm>
+
+#include "../shared/WinptyAssert.h"
+
+namespace {
+
+// Wraparound-safe: true if `now` is at or after `deadline`, assuming the
+// two are within 2^31 ms of each other.
+static bool reached(uint32_t now, uint32_t deadline) {
+    return static_cast<int32_t>(now - deadline) >= 0;
+}
+
+static uint32_t remaining(uint32_t now, uint32_t deadline) {
+    return reached(now, deadline) ? 0 : deadline - now;
+}
+
+} // anonymous namespace
+
+AgentPool::AgentPool(Launcher &launcher, const Options &options) :
+    m_launcher(launcher),
+    m_options(options)
+{
+    ASSERT(options.idleCount >= 1);
+    ASSERT(options.retryMinMs >= 1 && options.retryMinMs <= options.retryMaxMs);
+}
+
+bool AgentPool::isExpired(const IdleAgent &idle, uint32_t now) const {
+    return m_options.maxIdleMs != 0 &&
+        reached(now, idle.since + m_options.maxIdleMs);
+}
+
+// Removes expired idle agents and, at most once per liveness interval, the
+// ones that have exited.
+void AgentPool::collectDiscards(uint32_t now, std::vector<Agent> &out) {
+    const bool checkLiveness =
+        reached(now, m_lastLivenessCheck + m_options.livenessCheckMs);
+    if (checkLiveness) {
+        m_lastLivenessCheck = now;
+    }
+    auto keep = m_idle.begin();
+    for (auto it = m_idle.begin(); it != m_idle.end(); ++it) {
+        if (isExpired(*it, now) ||
+                (checkLiveness && !m_launcher.isAlive(it->agent))) {
+            out.push_back(it->agent);
+            ++m_stats.discarded;
+        } else {
+            *keep++ = *it;
+        }
+    }
+    m_idle.erase(keep, m_idle.end());
+}
+
+bool AgentPool::beginLaunch(uint32_t now) {
+    if (m_idle.size() + m_launching >= m_options.idleCount) {
+        return false;
+    }
+    if (m_backingOff && !reached(now, m_retryAt)) {
+        return false;
+    }
+    ++m_launching;
+    return true;
+}
+
+void AgentPool::finishLaunch(Agent agent, uint32_t now) {
+    ASSERT(m_launching > 0);
+    --m_launching;
+    if (agent == nullptr) {
+        ++m_stats.launchFailures;
+        m_retryDelay = m_backingOff
+            ? std::min(m_retryDelay * 2, m_options.retryMaxMs)
+            : m_options.retryMinMs;
+        m_retryAt = now + m_retryDelay;
+        m_backingOff = true;
+        return;
+    }
+    ++m_stats.launches;
+    m_backingOff = false;
+    m_idle.push_back(IdleAgent { agent, now });
+}
+
+uint32_t AgentPool::timeUntilNextStep(uint32_t now) const {
+    uint32_t ret = kNoDeadline;
+    if (m_idle.size() + m_launching < m_options.idleCount) {
+        ret = m_backingOff ? remaining(now, m_retryAt) : 0;
+    }
+    if (!m_idle.empty()) {
+        ret = std::min(ret, remaining(now, m_lastLivenessCheck +
+                                           m_options.livenessCheckMs));
+        if (m_options.maxIdleMs != 0) {
+            // The front of the queue is the oldest agent.
+            ret = std::min(ret, remaining(now, m_idle.front().since +
+                                               m_options.maxIdleMs));
+        }
+    }
+    return ret;
+}
+
+AgentPool::Agent AgentPool::take(uint32_t now, std::vector<Agent> &discarded) {
+    while (!m_idle.empty()) {
+        const IdleAgent idle = m_idle.front();
+        m_idle.pop_front();
+        if (isExpired(idle, now) || !m_launcher.isAlive(idle.agent)) {
+            discarded.push_back(idle.agent);
+            ++m_stats.discarded;
+            continue;
+        }
+        ++m_stats.hits;
+        return idle.agent;
+    }
+    ++m_stats.misses;
+    return nullptr;
+}
+
+bool AgentPool::giveBack(Agent agent, uint32_t now) {
+    ASSERT(agent != nullptr);
+    if (m_idle.size() >= m_options.idleCount || !m_launcher.isAlive(agent)) {
+        return false;
+    }
+    m_idle.push_back(IdleAgent { agent, now });
+    return true;
+}
+
+void AgentPool::drain(std::vector<Agent> &out) {
+    for (const auto &idle : m_idle) {
+        out.push_back(idle.agent);
+    }
+    m_idle.clear();
+}
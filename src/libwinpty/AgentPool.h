@@ -0,0 +1,147 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef LIBWINPTY_AGENT_POOL_H
+#define LIBWINPTY_AGENT_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+// The bookkeeping behind winpty_pool_t: a set of idle, fully started agents
+// that a background thread keeps topped up.  Agents are opaque here, and
+// the Launcher starts, checks, and destroys them, so this class is free of
+// Windows APIs and can be tested with fake agents.  Times are millisecond
+// ticks (e.g. GetTickCount) compared with wraparound-safe arithmetic.
+//
+// The class itself isn't thread-safe.  refillStep takes the caller's lock
+// and drops it while agents are launched or destroyed; every other method
+// must be called with the lock held.
+class AgentPool {
+public:
+    typedef void *Agent;
+
+    class Launcher {
+    public:
+        virtual ~Launcher() {}
+        // Starts an agent and waits until it is ready.  Returns nullptr on
+        // failure.
+        virtual Agent launch() = 0;
+        virtual bool isAlive(Agent agent) = 0;
+        virtual void destroy(Agent agent) = 0;
+    };
+
+    struct Options {
+        size_t idleCount = 1;
+        // Idle agents older than this are replaced.  Zero means never.
+        uint32_t maxIdleMs = 0;
+        // How often idle agents are checked for an unexpected exit.
+        uint32_t livenessCheckMs = 1000;
+        // After a failed launch, the pool waits before the next one.  The
+        // delay doubles with each consecutive failure.
+        uint32_t retryMinMs = 100;
+        uint32_t retryMaxMs = 10000;
+    };
+
+    struct Stats {
+        uint64_t launches = 0;
+        uint64_t launchFailures = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t discarded = 0;
+    };
+
+    static const uint32_t kNoDeadline = 0xFFFFFFFFu;
+
+    AgentPool(Launcher &launcher, const Options &options);
+    AgentPool(const AgentPool &other) = delete;
+    AgentPool &operator=(const AgentPool &other) = delete;
+
+    // Refill thread.  Discards dead and expired idle agents and launches an
+    // agent if the pool is short one.  Returns how long the thread can wait
+    // before the next step, or kNoDeadline if only a take or giveBack can
+    // create more work.  A zero return means "step again now".
+    template <typename Lock, typename Clock>
+    uint32_t refillStep(Lock &lock, Clock clock);
+
+    // Clients.  take returns the oldest live idle agent, or nullptr, and
+    // moves dead or expired agents it skipped into `discarded` for the
+    // caller to destroy outside the lock.  giveBack returns false if the
+    // pool is full or the agent is dead, in which case the caller destroys
+    // it.  drain empties the pool.
+    Agent take(uint32_t now, std::vector<Agent> &discarded);
+    bool giveBack(Agent agent, uint32_t now);
+    void drain(std::vector<Agent> &out);
+    bool launchInProgress() const { return m_launching > 0; }
+    size_t idleCount() const { return m_idle.size(); }
+    const Stats &stats() const { return m_stats; }
+
+private:
+    struct IdleAgent {
+        Agent agent;
+        uint32_t since;
+    };
+
+    bool isExpired(const IdleAgent &idle, uint32_t now) const;
+    void collectDiscards(uint32_t now, std::vector<Agent> &out);
+    bool beginLaunch(uint32_t now);
+    void finishLaunch(Agent agent, uint32_t now);
+    uint32_t timeUntilNextStep(uint32_t now) const;
+
+    Launcher &m_launcher;
+    const Options m_options;
+    std::deque<IdleAgent> m_idle;
+    size_t m_launching = 0;
+    bool m_backingOff = false;
+    uint32_t m_retryDelay = 0;
+    uint32_t m_retryAt = 0;
+    uint32_t m_lastLivenessCheck = 0;
+    Stats m_stats;
+};
+
+template <typename Lock, typename Clock>
+uint32_t AgentPool::refillStep(Lock &lock, Clock clock) {
+    std::vector<Agent> discards;
+    lock.lock();
+    collectDiscards(clock(), discards);
+    const bool launch = beginLaunch(clock());
+    lock.unlock();
+
+    for (Agent agent : discards) {
+        m_launcher.destroy(agent);
+    }
+    if (launch) {
+        Agent agent = m_launcher.launch();
+        lock.lock();
+        finishLaunch(agent, clock());
+        lock.unlock();
+        return 0;
+    }
+
+    lock.lock();
+    const uint32_t ret = timeUntilNextStep(clock());
+    lock.unlock();
+    return ret;
+}
+
+#endif // LIBWINPTY_AGENT_POOL_H
@@ -0,0 +1,314 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Tests for the agent pool's scheduling, using fake agents and a fake
+// clock.  Build on Linux with AgentPool.cc:
+//
+//     g++ -std=c++11 -O2 -pthread AgentPoolTest.cc AgentPool.cc -o AgentPoolTest
+
+#include "AgentPool.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../shared/UnitTest.h"
+
+namespace {
+
+struct FakeAgent {
+    int id;
+    bool alive;
+};
+
+class FakeLauncher : public AgentPool::Launcher {
+public:
+    AgentPool::Agent launch() override {
+        ++launchCalls;
+        if (failuresLeft > 0) {
+            --failuresLeft;
+            return nullptr;
+        }
+        if (launchDelayUs > 0) {
+            usleep(launchDelayUs);
+        }
+        FakeAgent *agent = new FakeAgent { nextId++, true };
+        ++live;
+        return agent;
+    }
+    bool isAlive(AgentPool::Agent agent) override {
+        return static_cast<FakeAgent*>(agent)->alive;
+    }
+    void destroy(AgentPool::Agent agent) override {
+        destroyed.push_back(static_cast<FakeAgent*>(agent)->id);
+        delete static_cast<FakeAgent*>(agent);
+        --live;
+    }
+    int failuresLeft = 0;
+    int launchDelayUs = 0;
+    std::atomic<int> launchCalls { 0 };
+    std::atomic<int> live { 0 };
+    int nextId = 1;
+    std::vector<int> destroyed;
+};
+
+struct NullLock {
+    void lock() {}
+    void unlock() {}
+};
+
+struct FakeClock {
+    uint32_t now = 0;
+    uint32_t operator()() const { return now; }
+};
+
+static int idOf(AgentPool::Agent agent) {
+    return agent == nullptr ? 0 : static_cast<FakeAgent*>(agent)->id;
+}
+
+static AgentPool::Options options(size_t idleCount) {
+    AgentPool::Options ret;
+    ret.idleCount = idleCount;
+    return ret;
+}
+
+static void destroyAll(FakeLauncher &launcher,
+                       const std::vector<AgentPool::Agent> &agents) {
+    for (auto agent : agents) {
+        launcher.destroy(agent);
+    }
+}
+
+} // anonymous namespace
+
+static void testFillAndTake() {
+    FakeLauncher launcher;
+    NullLock lock;
+    FakeClock clock;
+    AgentPool pool(launcher, options(2));
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.idleCount() == 2);
+    // Full: the next step only waits for the liveness check.
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 1000);
+    CHECK(launcher.launchCalls == 2);
+
+    std::vector<AgentPool::Agent> discarded;
+    auto first = pool.take(clock.now, discarded);
+    CHECK(idOf(first) == 1 && discarded.empty());
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.idleCount() == 2);
+    auto second = pool.take(clock.now, discarded);
+    auto third = pool.take(clock.now, discarded);
+    CHECK(idOf(second) == 2 && idOf(third) == 3);
+    CHECK(pool.take(clock.now, discarded) == nullptr);
+    CHECK(pool.stats().hits == 3 && pool.stats().misses == 1);
+
+    // A returned agent is reused while there's room.
+    CHECK(pool.giveBack(first, clock.now));
+    CHECK(pool.giveBack(second, clock.now));
+    CHECK(!pool.giveBack(third, clock.now));
+    launcher.destroy(third);
+    static_cast<FakeAgent*>(second)->alive = false;
+    CHECK(idOf(pool.take(clock.now, discarded)) == 1);
+    CHECK(pool.take(clock.now, discarded) == nullptr);
+    CHECK(discarded.size() == 1 && idOf(discarded[0]) == 2);
+    destroyAll(launcher, discarded);
+    launcher.destroy(first);
+    CHECK(launcher.live == 0);
+}
+
+static void testDeadAndExpiredAgents() {
+    FakeLauncher launcher;
+    NullLock lock;
+    FakeClock clock;
+    AgentPool::Options opts = options(2);
+    opts.maxIdleMs = 5000;
+    opts.livenessCheckMs = 500;
+    AgentPool pool(launcher, opts);
+    clock.now = 100;
+    pool.refillStep(lock, std::ref(clock));
+    clock.now = 200;
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 300);
+
+    // An agent that exits is replaced at the next liveness check.
+    std::vector<AgentPool::Agent> agents;
+    pool.drain(agents);
+    static_cast<FakeAgent*>(agents[0])->alive = false;
+    CHECK(pool.giveBack(agents[1], clock.now));
+    CHECK(!pool.giveBack(agents[0], clock.now));
+    launcher.destroy(agents[0]);
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.idleCount() == 2);
+
+    // Agents are replaced once they've been idle for maxIdleMs.
+    clock.now = 5199;
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.idleCount() == 2);
+    clock.now = 5200;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(std::count(launcher.destroyed.begin(), launcher.destroyed.end(),
+                     2) == 1);
+    CHECK(std::count(launcher.destroyed.begin(), launcher.destroyed.end(),
+                     3) == 1);
+    CHECK(pool.idleCount() == 2);
+    CHECK(pool.stats().discarded == 2);
+
+    agents.clear();
+    pool.drain(agents);
+    destroyAll(launcher, agents);
+}
+
+static void testLaunchBackoff() {
+    FakeLauncher launcher;
+    NullLock lock;
+    FakeClock clock;
+    AgentPool::Options opts = options(1);
+    opts.retryMinMs = 100;
+    opts.retryMaxMs = 300;
+    AgentPool pool(launcher, opts);
+    launcher.failuresLeft = 4;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 100);
+    clock.now = 99;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 1);
+    CHECK(launcher.launchCalls == 1);
+    clock.now = 100;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 200);
+    clock.now = 300;
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 300);
+    clock.now = 600;
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 300);
+    CHECK(pool.stats().launchFailures == 4);
+    clock.now = 900;
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.idleCount() == 1);
+
+    // A success resets the delay.
+    std::vector<AgentPool::Agent> agents;
+    launcher.failuresLeft = 1;
+    agents.push_back(pool.take(clock.now, agents));
+    CHECK(agents.size() == 1 && agents[0] != nullptr);
+    pool.refillStep(lock, std::ref(clock));
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 100);
+    pool.drain(agents);
+    destroyAll(launcher, agents);
+    CHECK(launcher.live == 0);
+}
+
+static void testClockWraparound() {
+    FakeLauncher launcher;
+    NullLock lock;
+    FakeClock clock;
+    AgentPool::Options opts = options(1);
+    opts.maxIdleMs = 1000;
+    opts.livenessCheckMs = 10000;
+    AgentPool pool(launcher, opts);
+    clock.now = 0xFFFFFF00u;
+    pool.refillStep(lock, std::ref(clock));
+    pool.refillStep(lock, std::ref(clock));
+    clock.now = 0x100;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 488);
+    clock.now = 0x2E8;
+    CHECK(pool.refillStep(lock, std::ref(clock)) == 0);
+    CHECK(launcher.launchCalls == 2 && launcher.destroyed.size() == 1);
+    std::vector<AgentPool::Agent> agents;
+    pool.drain(agents);
+    destroyAll(launcher, agents);
+}
+
+// Run a real refill thread while a client takes agents as fast as it can,
+// falling back to its own launches the way winpty_pool_acquire does.  Every
+// agent must be handed out exactly once, and the lock must not be held
+// during launches.
+static void testThreaded() {
+    FakeLauncher launcher;
+    launcher.launchDelayUs = 200;
+    std::mutex mutex;
+    AgentPool pool(launcher, options(4));
+    std::atomic<bool> stop { false };
+    const auto clock = []() {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    };
+    std::thread refill([&]() {
+        while (!stop) {
+            if (pool.refillStep(mutex, clock) != 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    });
+    std::set<AgentPool::Agent> seen;
+    int hits = 0;
+    std::vector<AgentPool::Agent> discarded;
+    for (int i = 0; i < 500; ++i) {
+        AgentPool::Agent agent;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            agent = pool.take(clock(), discarded);
+        }
+        if (agent != nullptr) {
+            ++hits;
+        } else {
+            agent = launcher.launch();
+        }
+        CHECK(seen.insert(agent).second);
+        if (i % 3 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(400));
+        }
+    }
+    stop = true;
+    refill.join();
+    CHECK(discarded.empty());
+    CHECK(hits > 0);
+    std::vector<AgentPool::Agent> idle;
+    pool.drain(idle);
+    for (auto agent : idle) {
+        CHECK(seen.count(agent) == 0);
+        delete static_cast<FakeAgent*>(agent);
+    }
+    for (auto agent : seen) {
+        delete static_cast<FakeAgent*>(agent);
+    }
+    printf("threaded: %d of 500 acquisitions served from the pool\n", hits);
+}
+
+int main() {
+    testFillAndTake();
+    testDeadAndExpiredAgents();
+    testLaunchBackoff();
+    testClockWraparound();
+    testThreaded();
+    return unitTestResult();
+}
@@ -21,13 +21,21 @@
 #ifndef LIBWINPTY_WINPTY_INTERNAL_H
 #define LIBWINPTY_WINPTY_INTERNAL_H
 
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "../include/winpty.h"
 
+#include "../shared/Buffer.h"
 #include "../shared/Mutex.h"
 #include "../shared/OwnedHandle.h"
+#include "../shared/SpscRing.h"
+#include "../shared/StartupTimeline.h"
+
+#include "AgentPool.h"
 
 // The structures in this header are not intended to be accessed directly by
 // client programs.
@@ -47,9 +55,65 @@ struct winpty_config_s {
     int rows = 25;
     int mouseMode = WINPTY_MOUSE_MODE_AUTO;
     DWORD timeoutMs = 30000;
+    DWORD resizeDebounceMs = 0;
+    bool asyncResize = false;
+    DWORD inputQueueLimit = 0;
+    DWORD escapeTimeoutMs = 50;
+};
+
+// The client end of the shared-memory CONOUT ring
+// (WINPTY_FLAG_CONOUT_SHARED_MEMORY).
+struct ConoutRing {
+    ConoutRing() {}
+    ConoutRing(const ConoutRing &other) = delete;
+    ConoutRing &operator=(const ConoutRing &other) = delete;
+    ~ConoutRing() {
+        if (view != nullptr) {
+            UnmapViewOfFile(view);
+        }
+    }
+    OwnedHandle mapping;
+    void *view = nullptr;
+    OwnedHandle dataEvent;
+    OwnedHandle spaceEvent;
+    SpscRing ring;
+};
+
+// An agent RPC that has been sent.  The reply thread completes it by storing
+// the reply (or an error) and setting the event.  The fields are guarded by
+// winpty_s::mutex until the event is set; the callback never changes.
+struct RpcRequest {
+    uint32_t id = 0;
+    OwnedHandle event;
+    bool completed = false;
+    std::vector<char> reply;
+    winpty_result_t errorCode = WINPTY_ERROR_SUCCESS;
+    std::wstring errorMsg;
+    winpty_request_callback_t callback = nullptr;
+    void *context = nullptr;
+};
+
+struct winpty_request_s {
+    winpty_t *wp = nullptr;
+    std::shared_ptr<RpcRequest> rpc;
 };
 
 struct winpty_s {
+    winpty_s() {}
+    winpty_s(const winpty_s &other) = delete;
+    winpty_s &operator=(const winpty_s &other) = delete;
+    ~winpty_s() {
+        // Wait for a deferred resize callback to finish.
+        if (resizeTimerQueue != nullptr) {
+            DeleteTimerQueueEx(resizeTimerQueue, INVALID_HANDLE_VALUE);
+        }
+        // The reply thread fails any requests still in flight and closes
+        // the control pipe.
+        if (replyThread.get() != nullptr) {
+            SetEvent(replyThreadStop.get());
+            WaitForSingleObject(replyThread.get(), INFINITE);
+        }
+    }
     Mutex mutex;
     OwnedHandle agentProcess;
     OwnedHandle controlPipe;
@@ -59,6 +123,83 @@ struct winpty_s {
     std::wstring coninPipeName;
     std::wstring conoutPipeName;
     std::wstring conerrPipeName;
+    // Guarded by the mutex.  A reader holds its own reference, so
+    // winpty_reattach_conout can replace the ring during a read.
+    std::shared_ptr<ConoutRing> conoutRing;
+    // Set once a data pipe name is handed out or the CONOUT ring is read.
+    // The agent's pipe instances may be taken then, so winpty_pool_release
+    // frees the agent rather than pooling it.  Guarded by the mutex, because
+    // winpty_conout_read may run on another thread.
+    bool pipesUsed = false;
+    // Requests that have been sent, keyed by request ID.  The reply thread
+    // starts with the first request.  Once an RPC fails, rpcBroken is set
+    // and no more requests are sent.
+    uint32_t nextRequestId = 1;
+    std::map<uint32_t, std::shared_ptr<RpcRequest>> pendingRequests;
+    bool rpcBroken = false;
+    bool asyncResize = false;
+    // The last resize sent without waiting for its reply (async or
+    // deferred).  If it fails, the next RPC reports its error.
+    std::shared_ptr<RpcRequest> unwaitedResize;
+    OwnedHandle replyThread;
+    OwnedHandle replyThreadStop;
+    OwnedHandle replyEvent;
+    // Resize debouncing (winpty_config_set_resize_debounce).  The deferred
+    // size is sent from a timer-queue callback.
+    DWORD resizeDebounceMs = 0;
+    DWORD lastResizeTick = 0;
+    bool resizeDeferred = false;
+    int deferredCols = 0;
+    int deferredRows = 0;
+    HANDLE resizeTimerQueue = nullptr;
+    HANDLE resizeTimer = nullptr;
+    // The phases of winpty_open, when the startup_timeline debug flag is
+    // set.  The agent's phases are fetched when the timeline is saved.
+    StartupTimeline startupTimeline;
+};
+
+// A pool of idle agents (winpty_pool_new).  The refill thread keeps the pool
+// full, and the mutex guards the AgentPool bookkeeping.
+struct winpty_pool_s {
+    winpty_pool_s() {}
+    winpty_pool_s(const winpty_pool_s &other) = delete;
+    winpty_pool_s &operator=(const winpty_pool_s &other) = delete;
+    ~winpty_pool_s() {
+        if (thread.get() != nullptr) {
+            SetEvent(stopEvent.get());
+            WaitForSingleObject(thread.get(), INFINITE);
+        }
+        if (pool) {
+            std::vector<AgentPool::Agent> idle;
+            pool->drain(idle);
+            for (auto agent : idle) {
+                launcher->destroy(agent);
+            }
+        }
+    }
+    winpty_config_t cfg;
+    Mutex mutex;
+    std::unique_ptr<AgentPool::Launcher> launcher;
+    std::unique_ptr<AgentPool> pool;
+    // wakeEvent (auto-reset) prompts the refill thread.  launchedEvent
+    // (manual-reset) is set after each launch attempt, for waiting acquirers.
+    OwnedHandle wakeEvent;
+    OwnedHandle launchedEvent;
+    OwnedHandle stopEvent;
+    OwnedHandle thread;
+};
+
+// A batch of agent requests, sent as one AgentMsg::Batch packet.  Each
+// request is encoded into the packet as it is added.  Once the batch has
+// run, `results` points at each request's reply inside `reply`.
+struct winpty_batch_s {
+    winpty_t *wp = nullptr;
+    WriteBuffer packet;
+    size_t countPos = 0;
+    std::vector<int> types;
+    bool ran = false;
+    std::unique_ptr<ReadBuffer> reply;
+    std::vector<std::pair<const char*, size_t>> results;
 };
 
 struct winpty_spawn_config_s {
@@ -69,4 +210,13 @@ struct winpty_spawn_config_s {
     std::wstring env;
 };
 
+struct winpty_screen_snapshot_s {
+    explicit winpty_screen_snapshot_s(ReadBuffer &&packet) :
+        packet(std::move(packet)) {}
+    // The blob points into the reply packet, which owns the data.
+    ReadBuffer packet;
+    const char *data = nullptr;
+    size_t size = 0;
+};
+
 #endif // LIBWINPTY_WINPTY_INTERNAL_H
@@ -24,18 +24,22 @@ $(eval $(call def_mingw_target,libwinpty,-DCOMPILING_WINPTY_DLL))
 
 LIBWINPTY_OBJECTS = \
 	build/libwinpty/libwinpty/AgentLocation.o \
+	build/libwinpty/libwinpty/AgentPool.o \
 	build/libwinpty/libwinpty/winpty.o \
 	build/libwinpty/shared/BackgroundDesktop.o \
 	build/libwinpty/shared/Buffer.o \
 	build/libwinpty/shared/DebugClient.o \
 	build/libwinpty/shared/GenRandom.o \
 	build/libwinpty/shared/OwnedHandle.o \
+	build/libwinpty/shared/SpscRing.o \
+	build/libwinpty/shared/StartupTimeline.o \
 	build/libwinpty/shared/StringUtil.o \
 	build/libwinpty/shared/WindowsSecurity.o \
 	build/libwinpty/shared/WindowsVersion.o \
 	build/libwinpty/shared/WinptyAssert.o \
 	build/libwinpty/shared/WinptyException.o \
-	build/libwinpty/shared/WinptyVersion.o
+	build/libwinpty/shared/WinptyVersion.o \
+	build/libwinpty/shared/WireFormat.o
 
 build/libwinpty/shared/WinptyVersion.o : build/gen/GenVersion.h
 
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <vector>
@@ -36,6 +37,7 @@
 #include "../shared/DebugClient.h"
 #include "../shared/GenRandom.h"
 #include "../shared/OwnedHandle.h"
+#include "../shared/StartupTimeline.h"
 #include "../shared/StringBuilder.h"
 #include "../shared/StringUtil.h"
 #include "../shared/WindowsSecurity.h"
@@ -187,6 +189,30 @@ winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs) {
     cfg->timeoutMs = timeoutMs;
 }
 
+WINPTY_API void
+winpty_config_set_resize_debounce(winpty_config_t *cfg, DWORD debounceMs) {
+    ASSERT(cfg != nullptr);
+    cfg->resizeDebounceMs = debounceMs;
+}
+
+WINPTY_API void
+winpty_config_set_async_resize(winpty_config_t *cfg, BOOL async) {
+    ASSERT(cfg != nullptr);
+    cfg->asyncResize = async != FALSE;
+}
+
+WINPTY_API void
+winpty_config_set_input_queue_limit(winpty_config_t *cfg, DWORD maxEvents) {
+    ASSERT(cfg != nullptr);
+    cfg->inputQueueLimit = maxEvents;
+}
+
+WINPTY_API void
+winpty_config_set_escape_timeout(winpty_config_t *cfg, DWORD timeoutMs) {
+    ASSERT(cfg != nullptr);
+    cfg->escapeTimeoutMs = timeoutMs;
+}
+
 
 
 /*****************************************************************************
@@ -317,6 +343,7 @@ static void writeData(winpty_t &wp, const void *data, size_t amount) {
 static inline WriteBuffer newPacket() {
     WriteBuffer packet;
     packet.putRawValue<uint64_t>(0); // Reserve space for size.
+    packet.putRawValue<uint32_t>(kAgentMsgNoRequestId); // Set by startRpc.
     return packet;
 }
 
@@ -355,16 +382,31 @@ static uint64_t readUInt64(winpty_t &wp) {
     return ret;
 }
 
-// Returns a reply packet's payload.
+// Returns the payload of a packet the agent sent unprompted at startup.
+// Replies to requests are read by the reply thread instead.
 static ReadBuffer readPacket(winpty_t &wp) {
     const uint64_t packetSize = readUInt64(wp);
-    if (packetSize < sizeof(packetSize) || packetSize > SIZE_MAX) {
+    if (packetSize < sizeof(packetSize) + sizeof(uint32_t) ||
+            packetSize > SIZE_MAX) {
         throwWinptyException(L"Agent RPC error: invalid packet size");
     }
-    const size_t payloadSize = packetSize - sizeof(packetSize);
+    uint32_t requestId = 0;
+    readAll(wp, &requestId, sizeof(requestId));
+    if (requestId != kAgentMsgNoRequestId) {
+        throwWinptyException(L"Agent RPC error: unexpected reply");
+    }
+    const size_t payloadSize =
+        packetSize - sizeof(packetSize) - sizeof(requestId);
     std::vector<char> bytes(payloadSize);
     readAll(wp, bytes.data(), bytes.size());
-    return ReadBuffer(std::move(bytes));
+    ReadBuffer ret(std::move(bytes));
+    // Every startup packet begins with the agent's wire format version.
+    if (ret.getInt32() != kWireFormatVersion) {
+        throwWinptyException(
+            L"Agent RPC error: the agent uses a different wire format "
+            L"(is winpty-agent.exe from another winpty version?)");
+    }
+    return ret;
 }
 
 static OwnedHandle createControlPipe(const std::wstring &name) {
@@ -544,20 +586,32 @@ static std::unique_ptr<winpty_t>
 createAgentSession(const winpty_config_t *cfg,
                    const std::wstring &desktop,
                    const std::wstring &params,
-                   DWORD creationFlags) {
+                   DWORD creationFlags,
+                   StartupTimeline &timeline) {
     std::unique_ptr<winpty_t> wp(new winpty_t);
     wp->agentTimeoutMs = cfg->timeoutMs;
+    wp->resizeDebounceMs = cfg->resizeDebounceMs;
+    wp->asyncResize = cfg->asyncResize;
     wp->ioEvent = createEvent();
 
     // Create control server pipe.
     const auto pipeName =
         L"\\\\.\\pipe\\winpty-control-" + GenRandom().uniqueName();
-    wp->controlPipe = createControlPipe(pipeName);
+    {
+        StartupTimelineScope scope(timeline, "createControlPipe");
+        wp->controlPipe = createControlPipe(pipeName);
+    }
 
     DWORD agentPid = 0;
-    wp->agentProcess = startAgentProcess(
-        desktop, pipeName, params, creationFlags, agentPid);
-    connectControlPipe(*wp.get());
+    {
+        StartupTimelineScope scope(timeline, "startAgentProcess");
+        wp->agentProcess = startAgentProcess(
+            desktop, pipeName, params, creationFlags, agentPid);
+    }
+    {
+        StartupTimelineScope scope(timeline, "connectControlPipe");
+        connectControlPipe(*wp.get());
+    }
     verifyPipeClientPid(wp->controlPipe.get(), agentPid);
 
     return std::move(wp);
@@ -599,7 +653,8 @@ private:
 } // anonymous namespace
 
 std::unique_ptr<AgentDesktop>
-setupBackgroundDesktop(const winpty_config_t *cfg) {
+setupBackgroundDesktop(const winpty_config_t *cfg,
+                       StartupTimeline &timeline) {
     bool useDesktopAgent =
         !(cfg->flags & WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION);
     const bool useDesktop = shouldCreateBackgroundDesktop(useDesktopAgent);
@@ -610,9 +665,11 @@ setupBackgroundDesktop(const winpty_config_t *cfg) {
 
     if (useDesktopAgent) {
         auto wp = createAgentSession(
-            cfg, std::wstring(), L"--create-desktop", DETACHED_PROCESS);
+            cfg, std::wstring(), L"--create-desktop", DETACHED_PROCESS,
+            timeline);
 
         // Read the desktop name.
+        StartupTimelineScope scope(timeline, "read desktop name");
         auto packet = readPacket(*wp.get());
         auto desktopName = packet.getWString();
         packet.assertEof();
@@ -626,6 +683,7 @@ setupBackgroundDesktop(const winpty_config_t *cfg) {
         }
     } else {
         try {
+            StartupTimelineScope scope(timeline, "BackgroundDesktop");
             BackgroundDesktop desktop;
             return std::unique_ptr<AgentDesktop>(new AgentDesktopDirect(
                 std::move(desktop)));
@@ -638,6 +696,107 @@ setupBackgroundDesktop(const winpty_config_t *cfg) {
     }
 }
 
+static OwnedHandle openRingObject(const std::wstring &name, bool isEvent) {
+    const HANDLE ret = isEvent
+        ? OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, name.c_str())
+        : OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str());
+    if (ret == nullptr) {
+        throwWindowsError((L"Could not open CONOUT ring object " +
+                           name).c_str());
+    }
+    return OwnedHandle(ret);
+}
+
+// Open the kernel objects created by the agent's
+// NamedPipe::openSharedMemoryRing.
+static std::unique_ptr<ConoutRing> openConoutRing(const std::wstring &base) {
+    std::unique_ptr<ConoutRing> ret(new ConoutRing);
+    ret->mapping = openRingObject(base + L"-map", false);
+    ret->dataEvent = openRingObject(base + L"-data", true);
+    ret->spaceEvent = openRingObject(base + L"-space", true);
+    ret->view = MapViewOfFile(ret->mapping.get(),
+                              FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    if (ret->view == nullptr) {
+        throwWindowsError(L"MapViewOfFile failed for CONOUT ring");
+    }
+    MEMORY_BASIC_INFORMATION info = {};
+    if (VirtualQuery(ret->view, &info, sizeof(info)) != sizeof(info)) {
+        throwWindowsError(L"VirtualQuery failed for CONOUT ring");
+    }
+    if (!ret->ring.attach(ret->view, info.RegionSize)) {
+        throwWinptyException(L"CONOUT ring has an invalid header");
+    }
+    return ret;
+}
+
+// Starts an agent and reads its pipe names.  Used by winpty_open and by the
+// agent pool.
+static std::unique_ptr<winpty_t> openAgent(const winpty_config_t *cfg) {
+    StartupTimeline timeline;
+    const int64_t openStart = timeline.enabled() ? StartupTimeline::now() : 0;
+
+    // Setup a background desktop for the agent.
+    std::unique_ptr<AgentDesktop> desktop;
+    {
+        StartupTimelineScope scope(timeline, "setupBackgroundDesktop");
+        desktop = setupBackgroundDesktop(cfg, timeline);
+    }
+    const auto desktopName = desktop ? desktop->name() : std::wstring();
+
+    // Start the primary agent session.
+    const auto params =
+        (WStringBuilder(128)
+            << cfg->flags << L' '
+            << cfg->mouseMode << L' '
+            << cfg->cols << L' '
+            << cfg->rows << L' '
+            << cfg->inputQueueLimit << L' '
+            << cfg->escapeTimeoutMs).str_moved();
+    auto wp = createAgentSession(cfg, desktopName, params,
+                                 CREATE_NEW_CONSOLE, timeline);
+
+    // Close handles to the background desktop and restore the original
+    // window station.  This must wait until we know the agent is running
+    // -- if we close these handles too soon, then the desktop and
+    // windowstation will be destroyed before the agent can connect with
+    // them.
+    //
+    // If we used a separate agent process to create the desktop, we
+    // disconnect from that process here, allowing it to exit.
+    desktop.reset();
+
+    // If we ran the agent process on a background desktop, then when we
+    // spawn a child process from the agent, it will need to be explicitly
+    // placed back onto the original desktop.
+    if (!desktopName.empty()) {
+        wp->spawnDesktopName = getCurrentDesktopName();
+    }
+
+    // Get the CONIN/CONOUT pipe names.  With a shared-memory CONOUT, the
+    // second name is the ring's base name instead.
+    {
+        StartupTimelineScope scope(timeline, "read pipe names");
+        auto packet = readPacket(*wp.get());
+        wp->coninPipeName = packet.getWString();
+        wp->conoutPipeName = packet.getWString();
+        if (cfg->flags & WINPTY_FLAG_CONERR) {
+            wp->conerrPipeName = packet.getWString();
+        }
+        packet.assertEof();
+    }
+    if (cfg->flags & WINPTY_FLAG_CONOUT_SHARED_MEMORY) {
+        StartupTimelineScope scope(timeline, "openConoutRing");
+        wp->conoutRing = openConoutRing(wp->conoutPipeName);
+        wp->conoutPipeName.clear();
+    }
+
+    if (timeline.enabled()) {
+        timeline.add("winpty_open", openStart, StartupTimeline::now());
+        wp->startupTimeline.append(timeline.events());
+    }
+    return std::move(wp);
+}
+
 WINPTY_API winpty_t *
 winpty_open(const winpty_config_t *cfg,
             winpty_error_ptr_t *err /*OPTIONAL*/) {
@@ -645,51 +804,159 @@ winpty_open(const winpty_config_t *cfg,
         ASSERT(cfg != nullptr);
         dumpWindowsVersion();
         dumpVersionToTrace();
+        return openAgent(cfg).release();
+    } API_CATCH(nullptr)
+}
 
-        // Setup a background desktop for the agent.
-        auto desktop = setupBackgroundDesktop(cfg);
-        const auto desktopName = desktop ? desktop->name() : std::wstring();
-
-        // Start the primary agent session.
-        const auto params =
-            (WStringBuilder(128)
-                << cfg->flags << L' '
-                << cfg->mouseMode << L' '
-                << cfg->cols << L' '
-                << cfg->rows).str_moved();
-        auto wp = createAgentSession(cfg, desktopName, params,
-                                     CREATE_NEW_CONSOLE);
-
-        // Close handles to the background desktop and restore the original
-        // window station.  This must wait until we know the agent is running
-        // -- if we close these handles too soon, then the desktop and
-        // windowstation will be destroyed before the agent can connect with
-        // them.
-        //
-        // If we used a separate agent process to create the desktop, we
-        // disconnect from that process here, allowing it to exit.
-        desktop.reset();
 
-        // If we ran the agent process on a background desktop, then when we
-        // spawn a child process from the agent, it will need to be explicitly
-        // placed back onto the original desktop.
-        if (!desktopName.empty()) {
-            wp->spawnDesktopName = getCurrentDesktopName();
+
+/*****************************************************************************
+ * Agent pool. */
+
+namespace {
+
+class PoolLauncher : public AgentPool::Launcher {
+public:
+    explicit PoolLauncher(const winpty_config_t &cfg) : m_cfg(cfg) {}
+    AgentPool::Agent launch() override {
+        try {
+            return openAgent(&m_cfg).release();
+        } catch (...) {
+            // Log the error.  The pool retries after a delay.
+            winpty_error_ptr_t *err = nullptr;
+            translateException(err);
+            return nullptr;
         }
+    }
+    bool isAlive(AgentPool::Agent agent) override {
+        const auto wp = static_cast<winpty_t*>(agent);
+        return WaitForSingleObject(wp->agentProcess.get(), 0) == WAIT_TIMEOUT;
+    }
+    void destroy(AgentPool::Agent agent) override {
+        delete static_cast<winpty_t*>(agent);
+    }
+private:
+    const winpty_config_t &m_cfg;
+};
 
-        // Get the CONIN/CONOUT pipe names.
-        auto packet = readPacket(*wp.get());
-        wp->coninPipeName = packet.getWString();
-        wp->conoutPipeName = packet.getWString();
-        if (cfg->flags & WINPTY_FLAG_CONERR) {
-            wp->conerrPipeName = packet.getWString();
+} // anonymous namespace
+
+static DWORD WINAPI poolThreadProc(LPVOID param) {
+    winpty_pool_t &pool = *static_cast<winpty_pool_t*>(param);
+    const HANDLE handles[] = { pool.stopEvent.get(), pool.wakeEvent.get() };
+    while (true) {
+        // kNoDeadline is INFINITE.
+        const DWORD delay = pool.pool->refillStep(pool.mutex, GetTickCount);
+        if (delay == 0) {
+            SetEvent(pool.launchedEvent.get());
         }
-        packet.assertEof();
+        const DWORD result = WaitForMultipleObjects(2, handles, FALSE, delay);
+        if (result == WAIT_OBJECT_0) {
+            break;
+        }
+    }
+    return 0;
+}
 
-        return wp.release();
+WINPTY_API winpty_pool_t *
+winpty_pool_new(const winpty_config_t *cfg, int idleCount, DWORD maxIdleMs,
+                winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(cfg != nullptr && idleCount >= 1);
+        dumpWindowsVersion();
+        dumpVersionToTrace();
+        std::unique_ptr<winpty_pool_t> pool(new winpty_pool_t);
+        pool->cfg = *cfg;
+        pool->launcher.reset(new PoolLauncher(pool->cfg));
+        AgentPool::Options options;
+        options.idleCount = idleCount;
+        options.maxIdleMs = maxIdleMs;
+        pool->pool.reset(new AgentPool(*pool->launcher, options));
+        const HANDLE wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        if (wake == nullptr) {
+            throwWindowsError(L"CreateEventW failed");
+        }
+        pool->wakeEvent = OwnedHandle(wake);
+        pool->launchedEvent = createEvent();
+        pool->stopEvent = createEvent();
+        const HANDLE thread =
+            CreateThread(nullptr, 0, poolThreadProc, pool.get(), 0, nullptr);
+        if (thread == nullptr) {
+            throwWindowsError(L"CreateThread failed");
+        }
+        pool->thread = OwnedHandle(thread);
+        return pool.release();
     } API_CATCH(nullptr)
 }
 
+WINPTY_API winpty_t *
+winpty_pool_acquire(winpty_pool_t *pool, DWORD timeoutMs,
+                    winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(pool != nullptr);
+        const DWORD start = GetTickCount();
+        winpty_t *ret = nullptr;
+        while (true) {
+            std::vector<AgentPool::Agent> discarded;
+            bool launching = false;
+            {
+                LockGuard<Mutex> lock(pool->mutex);
+                ret = static_cast<winpty_t*>(
+                    pool->pool->take(GetTickCount(), discarded));
+                launching = pool->pool->launchInProgress();
+                if (ret == nullptr && launching) {
+                    ResetEvent(pool->launchedEvent.get());
+                }
+            }
+            for (auto agent : discarded) {
+                pool->launcher->destroy(agent);
+            }
+            // Waiting for an agent that is already starting is never slower
+            // than starting another.
+            const DWORD elapsed = GetTickCount() - start;
+            if (ret != nullptr || !launching || elapsed >= timeoutMs) {
+                break;
+            }
+            WaitForSingleObject(pool->launchedEvent.get(),
+                                timeoutMs - elapsed);
+        }
+        SetEvent(pool->wakeEvent.get());
+        if (ret != nullptr) {
+            return ret;
+        }
+        trace("winpty_pool_acquire: no idle agent, starting one");
+        return openAgent(&pool->cfg).release();
+    } API_CATCH(nullptr)
+}
+
+WINPTY_API void winpty_pool_release(winpty_pool_t *pool, winpty_t *wp) {
+    ASSERT(pool != nullptr);
+    if (wp == nullptr) {
+        return;
+    }
+    // The reply thread starts with the first RPC (e.g. winpty_spawn), after
+    // which the agent is no longer fresh.  Likewise once the caller may have
+    // connected to its data pipes.
+    bool fresh = false;
+    {
+        LockGuard<Mutex> lock(wp->mutex);
+        fresh = wp->replyThread.get() == nullptr && !wp->rpcBroken &&
+            !wp->pipesUsed;
+    }
+    bool kept = false;
+    if (fresh) {
+        LockGuard<Mutex> lock(pool->mutex);
+        kept = pool->pool->giveBack(wp, GetTickCount());
+    }
+    if (!kept) {
+        delete wp;
+    }
+}
+
+WINPTY_API void winpty_pool_free(winpty_pool_t *pool) {
+    delete pool;
+}
+
 WINPTY_API HANDLE winpty_agent_process(winpty_t *wp) {
     ASSERT(wp != nullptr);
     return wp->agentProcess.get();
@@ -700,6 +967,11 @@ WINPTY_API HANDLE winpty_agent_process(winpty_t *wp) {
 /*****************************************************************************
  * I/O pipes. */
 
+static void markPipesUsed(winpty_t *wp) {
+    LockGuard<Mutex> lock(wp->mutex);
+    wp->pipesUsed = true;
+}
+
 static const wchar_t *cstrFromWStringOrNull(const std::wstring &str) {
     try {
         return str.c_str();
@@ -710,16 +982,23 @@ static const wchar_t *cstrFromWStringOrNull(const std::wstring &str) {
 
 WINPTY_API LPCWSTR winpty_conin_name(winpty_t *wp) {
     ASSERT(wp != nullptr);
+    markPipesUsed(wp);
     return cstrFromWStringOrNull(wp->coninPipeName);
 }
 
 WINPTY_API LPCWSTR winpty_conout_name(winpty_t *wp) {
     ASSERT(wp != nullptr);
-    return cstrFromWStringOrNull(wp->conoutPipeName);
+    markPipesUsed(wp);
+    if (wp->conoutPipeName.empty()) {
+        return nullptr;
+    } else {
+        return cstrFromWStringOrNull(wp->conoutPipeName);
+    }
 }
 
 WINPTY_API LPCWSTR winpty_conerr_name(winpty_t *wp) {
     ASSERT(wp != nullptr);
+    markPipesUsed(wp);
     if (wp->conerrPipeName.empty()) {
         return nullptr;
     } else {
@@ -727,26 +1006,99 @@ WINPTY_API LPCWSTR winpty_conerr_name(winpty_t *wp) {
     }
 }
 
+WINPTY_API BOOL
+winpty_conout_read(winpty_t *wp, void *buffer, DWORD size, DWORD *amount,
+                   winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        ASSERT(buffer != nullptr && amount != nullptr);
+        *amount = 0;
+        std::shared_ptr<ConoutRing> ring;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            wp->pipesUsed = true;
+            ring = wp->conoutRing;
+        }
+        if (!ring) {
+            throwWinptyException(
+                L"winpty_conout_read requires WINPTY_FLAG_CONOUT_SHARED_MEMORY");
+        }
+        ConoutRing &cr = *ring;
+        const HANDLE waitHandles[2] = { cr.dataEvent.get(),
+                                        wp->agentProcess.get() };
+        while (true) {
+            // The agent only waits on the space event while it has output
+            // queued, so signal it after every read that freed space.
+            const size_t actual = cr.ring.read(buffer, size);
+            if (actual > 0) {
+                SetEvent(cr.spaceEvent.get());
+                *amount = static_cast<DWORD>(actual);
+                return TRUE;
+            }
+            // Check the ring once more after seeing the closed flag, because
+            // the agent may have written its last bytes before closing.
+            if (cr.ring.isClosed()) {
+                if (cr.ring.readable() == 0) {
+                    return TRUE;
+                }
+                continue;
+            }
+            const DWORD waitRet =
+                WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE);
+            if (waitRet == WAIT_OBJECT_0 + 1) {
+                // The agent is gone.  Drain what it left behind, then EOF.
+                *amount = static_cast<DWORD>(cr.ring.read(buffer, size));
+                return TRUE;
+            } else if (waitRet != WAIT_OBJECT_0) {
+                throwWindowsError(L"WaitForMultipleObjects failed");
+            }
+            // winpty_reattach_conout replaced the ring and woke this read.
+            // End it as at EOF, so the caller reads the new ring.
+            {
+                LockGuard<Mutex> lock(wp->mutex);
+                if (wp->conoutRing != ring) {
+                    return TRUE;
+                }
+            }
+        }
+    } API_CATCH(FALSE)
+}
+
 
 
 /*****************************************************************************
  * winpty agent RPC calls. */
 
+// Requests are sent under the mutex, and a reply thread reads every reply
+// and completes the request with the matching ID.  Waiting for a reply does
+// not hold the mutex, so other threads can send requests meanwhile.
+
+typedef std::vector<std::shared_ptr<RpcRequest>> RpcRequestList;
+
+// Stops all RPC.  The reply thread fails the requests in flight and closes
+// the control pipe, which tells the agent to exit.  The caller must hold the
+// mutex.
+static void breakRpc(winpty_t &wp) {
+    wp.rpcBroken = true;
+    if (wp.replyThread.get() != nullptr) {
+        SetEvent(wp.replyThreadStop.get());
+    } else {
+        wp.controlPipe.dispose(true);
+    }
+}
+
 namespace {
 
-// Close the control pipe if something goes wrong with the pipe communication,
-// which could leave the control pipe in an inconsistent state.
+// Stop using the control pipe if something goes wrong with the pipe
+// communication, which could leave the control pipe in an inconsistent state.
 class RpcOperation {
 public:
-    RpcOperation(winpty_t &wp) : m_wp(wp) {
-        if (m_wp.controlPipe.get() == nullptr) {
-            throwWinptyException(L"Agent shutdown due to RPC failure");
-        }
-    }
+    RpcOperation(winpty_t &wp) : m_wp(wp) {}
     ~RpcOperation() {
         if (!m_success) {
             trace("~RpcOperation: Closing control pipe");
-            m_wp.controlPipe.dispose(true);
+            LockGuard<Mutex> lock(m_wp.mutex);
+            breakRpc(m_wp);
         }
     }
     void success() { m_success = true; }
@@ -757,6 +1109,225 @@ private:
 
 } // anonymous namespace
 
+// The caller must hold the mutex.
+static void completeRpc(RpcRequest &req, winpty_result_t code,
+                        const wchar_t *msg) {
+    req.completed = true;
+    req.errorCode = code;
+    req.errorMsg = msg;
+    SetEvent(req.event.get());
+}
+
+static void runRpcCallbacks(const RpcRequestList &done) {
+    for (const auto &req : done) {
+        if (req->callback != nullptr) {
+            req->callback(req->context);
+        }
+    }
+}
+
+// Completes the requests for the complete reply packets at the front of
+// `bytes` and removes the packets.  Returns false if a packet is malformed.
+static bool dispatchReplies(winpty_t &wp, std::vector<char> &bytes) {
+    const size_t headerSize = sizeof(uint64_t) + sizeof(uint32_t);
+    RpcRequestList done;
+    size_t offset = 0;
+    bool valid = true;
+    {
+        LockGuard<Mutex> lock(wp.mutex);
+        while (bytes.size() - offset >= headerSize) {
+            uint64_t packetSize = 0;
+            uint32_t requestId = 0;
+            memcpy(&packetSize, &bytes[offset], sizeof(packetSize));
+            memcpy(&requestId, &bytes[offset + sizeof(packetSize)],
+                   sizeof(requestId));
+            if (packetSize < headerSize || packetSize > SIZE_MAX) {
+                valid = false;
+                break;
+            }
+            if (bytes.size() - offset < packetSize) {
+                break;
+            }
+            const auto it = wp.pendingRequests.find(requestId);
+            if (it == wp.pendingRequests.end()) {
+                valid = false;
+                break;
+            }
+            const auto req = it->second;
+            wp.pendingRequests.erase(it);
+            req->reply.assign(bytes.begin() + offset + headerSize,
+                              bytes.begin() + offset + packetSize);
+            completeRpc(*req, WINPTY_ERROR_SUCCESS, L"");
+            done.push_back(req);
+            offset += packetSize;
+        }
+    }
+    bytes.erase(bytes.begin(), bytes.begin() + offset);
+    runRpcCallbacks(done);
+    return valid;
+}
+
+static DWORD WINAPI replyThreadProc(LPVOID param) {
+    winpty_t &wp = *static_cast<winpty_t*>(param);
+    const HANDLE pipe = wp.controlPipe.get();
+    std::vector<char> bytes;
+    std::vector<char> chunk(8192);
+    winpty_result_t failureCode = WINPTY_ERROR_LOST_CONNECTION;
+    const wchar_t *failure = L"lost connection to agent";
+    while (true) {
+        if (WaitForSingleObject(wp.replyThreadStop.get(), 0) ==
+                WAIT_OBJECT_0) {
+            failureCode = WINPTY_ERROR_UNSPECIFIED;
+            failure = L"Agent shutdown due to RPC failure";
+            break;
+        }
+        OVERLAPPED over = {};
+        over.hEvent = wp.replyEvent.get();
+        DWORD actual = 0;
+        BOOL success = ReadFile(pipe, chunk.data(), chunk.size(),
+                                &actual, &over);
+        if (!success && GetLastError() == ERROR_IO_PENDING) {
+            const HANDLE waitHandles[2] = { wp.replyEvent.get(),
+                                            wp.replyThreadStop.get() };
+            const DWORD waitRet =
+                WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE);
+            if (waitRet != WAIT_OBJECT_0) {
+                // We issued the read, so CancelIo can cancel it.
+                CancelIo(pipe);
+            }
+            success = GetOverlappedResult(pipe, &over, &actual, TRUE);
+            if (waitRet != WAIT_OBJECT_0) {
+                failureCode = WINPTY_ERROR_UNSPECIFIED;
+                failure = L"Agent shutdown due to RPC failure";
+                break;
+            }
+        }
+        if (!success) {
+            break;
+        }
+        bytes.insert(bytes.end(), chunk.data(), chunk.data() + actual);
+        if (!dispatchReplies(wp, bytes)) {
+            failureCode = WINPTY_ERROR_UNSPECIFIED;
+            failure = L"Agent RPC error: invalid reply packet";
+            break;
+        }
+    }
+    trace("Reply thread exiting: %s", utf8FromWide(failure).c_str());
+    RpcRequestList done;
+    {
+        LockGuard<Mutex> lock(wp.mutex);
+        wp.rpcBroken = true;
+        wp.controlPipe.dispose(true);
+        for (const auto &entry : wp.pendingRequests) {
+            completeRpc(*entry.second, failureCode, failure);
+            done.push_back(entry.second);
+        }
+        wp.pendingRequests.clear();
+    }
+    runRpcCallbacks(done);
+    return 0;
+}
+
+// Sends a request and registers it for its reply.  The caller must hold the
+// mutex.
+static std::shared_ptr<RpcRequest>
+startRpc(winpty_t &wp, WriteBuffer &packet,
+         winpty_request_callback_t callback=nullptr, void *context=nullptr) {
+    if (wp.rpcBroken || wp.controlPipe.get() == nullptr) {
+        // Nothing waits for an async or deferred resize, so its failure is
+        // reported here, once, by the next RPC.
+        const std::shared_ptr<RpcRequest> resize =
+            std::move(wp.unwaitedResize);
+        if (resize && resize->completed &&
+                resize->errorCode != WINPTY_ERROR_SUCCESS) {
+            throw LibWinptyException(resize->errorCode,
+                (L"winpty_set_size failed: " + resize->errorMsg).c_str());
+        }
+        throwWinptyException(L"Agent shutdown due to RPC failure");
+    }
+    if (wp.replyThread.get() == nullptr) {
+        wp.replyEvent = createEvent();
+        wp.replyThreadStop = createEvent();
+        const HANDLE thread =
+            CreateThread(nullptr, 0, replyThreadProc, &wp, 0, nullptr);
+        if (thread == nullptr) {
+            throwWindowsError(L"CreateThread failed");
+        }
+        wp.replyThread = OwnedHandle(thread);
+    }
+    std::shared_ptr<RpcRequest> req(new RpcRequest);
+    req->id = wp.nextRequestId++;
+    if (wp.nextRequestId == kAgentMsgNoRequestId) {
+        wp.nextRequestId++;
+    }
+    req->event = createEvent();
+    req->callback = callback;
+    req->context = context;
+    packet.replaceRawValue<uint32_t>(sizeof(uint64_t), req->id);
+    wp.pendingRequests[req->id] = req;
+    RpcOperation rpc(wp);
+    writePacket(wp, packet);
+    rpc.success();
+    return req;
+}
+
+// Waits for a request's reply and returns its payload.  The caller must not
+// hold the mutex, which the reply thread needs.
+static ReadBuffer finishRpc(winpty_t &wp, RpcRequest &req) {
+    const HANDLE waitHandles[2] = { req.event.get(), wp.agentProcess.get() };
+    DWORD waitRet = WaitForMultipleObjects(
+        2, waitHandles, FALSE, wp.agentTimeoutMs);
+    if (waitRet == WAIT_OBJECT_0 + 1) {
+        // The agent may have written the reply just before exiting.  The
+        // reply thread dispatches every reply left in the pipe before it
+        // sees the pipe break and exits, so let it finish and look again.
+        WaitForSingleObject(wp.replyThread.get(), wp.agentTimeoutMs);
+        if (WaitForSingleObject(req.event.get(), 0) == WAIT_OBJECT_0 &&
+                req.errorCode == WINPTY_ERROR_SUCCESS) {
+            waitRet = WAIT_OBJECT_0;
+        }
+    }
+    if (waitRet != WAIT_OBJECT_0) {
+        {
+            LockGuard<Mutex> lock(wp.mutex);
+            breakRpc(wp);
+        }
+        if (waitRet == WAIT_OBJECT_0 + 1) {
+            throw LibWinptyException(WINPTY_ERROR_AGENT_DIED, L"agent died");
+        } else if (waitRet == WAIT_TIMEOUT) {
+            throw LibWinptyException(WINPTY_ERROR_AGENT_TIMEOUT,
+                                     L"agent timed out");
+        } else if (waitRet == WAIT_FAILED) {
+            throwWindowsError(L"WaitForMultipleObjects failed");
+        } else {
+            ASSERT(false && "unexpected WaitForMultipleObjects return value");
+        }
+    }
+    // The reply thread filled in the request before setting the event.
+    ASSERT(req.completed);
+    if (req.errorCode != WINPTY_ERROR_SUCCESS) {
+        throw LibWinptyException(req.errorCode, req.errorMsg.c_str());
+    }
+    return ReadBuffer(std::move(req.reply));
+}
+
+static winpty_request_t *newRequest(winpty_t &wp,
+                                    std::shared_ptr<RpcRequest> &&rpc) {
+    std::unique_ptr<winpty_request_t> ret(new winpty_request_t);
+    ret->wp = &wp;
+    ret->rpc = std::move(rpc);
+    return ret.release();
+}
+
+WINPTY_API HANDLE winpty_request_event(winpty_request_t *req) {
+    ASSERT(req != nullptr);
+    return req->rpc->event.get();
+}
+
+WINPTY_API void winpty_request_free(winpty_request_t *req) {
+    delete req;
+}
+
 
 
 /*****************************************************************************
@@ -855,24 +1426,34 @@ winpty_spawn(winpty_t *wp,
         if (thread_handle != nullptr) { *thread_handle = nullptr; }
         if (create_process_error != nullptr) { *create_process_error = 0; }
 
-        LockGuard<Mutex> lock(wp->mutex);
-        RpcOperation rpc(*wp);
-
         // Send spawn request.
-        auto packet = newPacket();
-        packet.putInt32(AgentMsg::StartProcess);
-        packet.putInt64(cfg->winptyFlags);
-        packet.putInt32(process_handle != nullptr);
-        packet.putInt32(thread_handle != nullptr);
-        packet.putWString(cfg->appname);
-        packet.putWString(cfg->cmdline);
-        packet.putWString(cfg->cwd);
-        packet.putWString(cfg->env);
-        packet.putWString(wp->spawnDesktopName);
-        writePacket(*wp, packet);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            auto packet = newPacket();
+            // The environment block can be large, so size the packet once.
+            packet.reserve(
+                WriteBuffer::int32Size() * 3 + WriteBuffer::int64Size() +
+                WriteBuffer::wstringSize(cfg->appname) +
+                WriteBuffer::wstringSize(cfg->cmdline) +
+                WriteBuffer::wstringSize(cfg->cwd) +
+                WriteBuffer::wstringSize(cfg->env) +
+                WriteBuffer::wstringSize(wp->spawnDesktopName));
+            packet.putInt32(AgentMsg::StartProcess);
+            packet.putInt64(cfg->winptyFlags);
+            packet.putInt32(process_handle != nullptr);
+            packet.putInt32(thread_handle != nullptr);
+            packet.putWString(cfg->appname);
+            packet.putWString(cfg->cmdline);
+            packet.putWString(cfg->cwd);
+            packet.putWString(cfg->env);
+            packet.putWString(wp->spawnDesktopName);
+            req = startRpc(*wp, packet);
+        }
 
         // Receive reply.
-        auto reply = readPacket(*wp);
+        auto reply = finishRpc(*wp, *req);
+        RpcOperation rpc(*wp);
         const auto result = static_cast<StartProcessResult>(reply.getInt32());
         if (result == StartProcessResult::CreateProcessFailed) {
             const DWORD lastError = reply.getInt32();
@@ -917,51 +1498,474 @@ winpty_spawn(winpty_t *wp,
 /*****************************************************************************
  * winpty agent RPC calls: everything else */
 
+// The caller must hold the mutex.
+static std::shared_ptr<RpcRequest>
+startSetSize(winpty_t &wp, int cols, int rows,
+             winpty_request_callback_t callback=nullptr,
+             void *context=nullptr) {
+    auto packet = newPacket();
+    packet.putInt32(AgentMsg::SetSize);
+    packet.putInt32(cols);
+    packet.putInt32(rows);
+    auto ret = startRpc(wp, packet, callback, context);
+    wp.lastResizeTick = GetTickCount();
+    return ret;
+}
+
+static void finishSetSize(winpty_t &wp, RpcRequest &req) {
+    auto reply = finishRpc(wp, req);
+    RpcOperation rpc(wp);
+    reply.assertEof();
+    rpc.success();
+}
+
+static VOID CALLBACK sendDeferredSetSize(PVOID param, BOOLEAN timerFired) {
+    winpty_t &wp = *static_cast<winpty_t*>(param);
+    LockGuard<Mutex> lock(wp.mutex);
+    if (!wp.resizeDeferred) {
+        return;
+    }
+    wp.resizeDeferred = false;
+    try {
+        // Don't wait for the reply; the next RPC reports a failure.
+        wp.unwaitedResize =
+            startSetSize(wp, wp.deferredCols, wp.deferredRows);
+    } catch (...) {
+        trace("sendDeferredSetSize: resize failed");
+    }
+}
+
+// Defer the resize if the last one was sent less than resizeDebounceMs ago.
+// Returns false if the caller should send it now.  The caller must hold the
+// mutex.
+static bool deferSetSize(winpty_t &wp, int cols, int rows) {
+    const DWORD sinceLast = GetTickCount() - wp.lastResizeTick;
+    if (wp.resizeDebounceMs == 0 || sinceLast >= wp.resizeDebounceMs) {
+        // A deferred size, if any, is stale now.
+        wp.resizeDeferred = false;
+        return false;
+    }
+    wp.deferredCols = cols;
+    wp.deferredRows = rows;
+    if (wp.resizeDeferred) {
+        // The timer is already armed.
+        return true;
+    }
+    if (wp.resizeTimerQueue == nullptr) {
+        wp.resizeTimerQueue = CreateTimerQueue();
+        if (wp.resizeTimerQueue == nullptr) {
+            throwWindowsError(L"CreateTimerQueue failed");
+        }
+    }
+    if (wp.resizeTimer != nullptr) {
+        // The previous one-shot timer has fired.  Don't wait for its
+        // callback, which may be blocked on the mutex.
+        DeleteTimerQueueTimer(wp.resizeTimerQueue, wp.resizeTimer, nullptr);
+        wp.resizeTimer = nullptr;
+    }
+    if (!CreateTimerQueueTimer(&wp.resizeTimer, wp.resizeTimerQueue,
+                               sendDeferredSetSize, &wp,
+                               wp.resizeDebounceMs - sinceLast, 0,
+                               WT_EXECUTEONLYONCE)) {
+        wp.resizeTimer = nullptr;
+        throwWindowsError(L"CreateTimerQueueTimer failed");
+    }
+    wp.resizeDeferred = true;
+    return true;
+}
+
 WINPTY_API BOOL
 winpty_set_size(winpty_t *wp, int cols, int rows,
                 winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && cols > 0 && rows > 0);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            if (deferSetSize(*wp, cols, rows)) {
+                return TRUE;
+            }
+            req = startSetSize(*wp, cols, rows);
+            if (wp->asyncResize) {
+                wp->unwaitedResize = req;
+            }
+        }
+        if (!wp->asyncResize) {
+            finishSetSize(*wp, *req);
+        }
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API winpty_request_t *
+winpty_set_size_async(winpty_t *wp, int cols, int rows,
+                      winpty_request_callback_t callback /*OPTIONAL*/,
+                      void *context,
+                      winpty_error_ptr_t *err /*OPTIONAL*/) {
     API_TRY {
         ASSERT(wp != nullptr && cols > 0 && rows > 0);
         LockGuard<Mutex> lock(wp->mutex);
-        RpcOperation rpc(*wp);
-        auto packet = newPacket();
-        packet.putInt32(AgentMsg::SetSize);
-        packet.putInt32(cols);
-        packet.putInt32(rows);
-        writePacket(*wp, packet);
-        readPacket(*wp).assertEof();
-        rpc.success();
+        return newRequest(*wp, startSetSize(*wp, cols, rows,
+                                            callback, context));
+    } API_CATCH(nullptr)
+}
+
+WINPTY_API BOOL
+winpty_set_size_finish(winpty_request_t *req,
+                       winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(req != nullptr);
+        finishSetSize(*req->wp, *req->rpc);
         return TRUE;
     } API_CATCH(FALSE)
 }
 
+// The caller must hold the mutex.
+static std::shared_ptr<RpcRequest>
+startGetConsoleProcessList(winpty_t &wp,
+                           winpty_request_callback_t callback=nullptr,
+                           void *context=nullptr) {
+    auto packet = newPacket();
+    packet.putInt32(AgentMsg::GetConsoleProcessList);
+    return startRpc(wp, packet, callback, context);
+}
+
+// Decodes a GetConsoleProcessList reply.  The caller must have an
+// RpcOperation in scope.
+static int decodeConsoleProcessList(ReadBuffer &reply, int *processList,
+                                    const int processCount) {
+    auto actualProcessCount = reply.getInt32();
+
+    if (actualProcessCount <= processCount) {
+        for (auto i = 0; i < actualProcessCount; i++) {
+            processList[i] = reply.getInt32();
+        }
+    }
+
+    reply.assertEof();
+    return actualProcessCount;
+}
+
+static int finishGetConsoleProcessList(winpty_t &wp, RpcRequest &req,
+                                       int *processList,
+                                       const int processCount) {
+    auto reply = finishRpc(wp, req);
+    RpcOperation rpc(wp);
+    const int ret = decodeConsoleProcessList(reply, processList, processCount);
+    rpc.success();
+    return ret;
+}
+
 WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
                                 winpty_error_ptr_t *err /*OPTIONAL*/) {
     API_TRY {
         ASSERT(wp != nullptr);
         ASSERT(processList != nullptr);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            req = startGetConsoleProcessList(*wp);
+        }
+        return finishGetConsoleProcessList(*wp, *req, processList,
+                                           processCount);
+    } API_CATCH(0)
+}
+
+WINPTY_API winpty_request_t *
+winpty_get_console_process_list_async(
+        winpty_t *wp,
+        winpty_request_callback_t callback /*OPTIONAL*/,
+        void *context,
+        winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
         LockGuard<Mutex> lock(wp->mutex);
-        RpcOperation rpc(*wp);
-        auto packet = newPacket();
-        packet.putInt32(AgentMsg::GetConsoleProcessList);
-        writePacket(*wp, packet);
-        auto reply = readPacket(*wp);
+        return newRequest(*wp, startGetConsoleProcessList(*wp, callback,
+                                                          context));
+    } API_CATCH(nullptr)
+}
 
-        auto actualProcessCount = reply.getInt32();
+WINPTY_API int
+winpty_get_console_process_list_finish(winpty_request_t *req,
+                                       int *processList,
+                                       const int processCount,
+                                       winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(req != nullptr);
+        ASSERT(processList != nullptr);
+        return finishGetConsoleProcessList(*req->wp, *req->rpc, processList,
+                                           processCount);
+    } API_CATCH(0)
+}
+
+WINPTY_API winpty_batch_t *
+winpty_batch_new(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        std::unique_ptr<winpty_batch_t> batch(new winpty_batch_t);
+        batch->wp = wp;
+        batch->packet = newPacket();
+        batch->packet.putInt32(AgentMsg::Batch);
+        batch->countPos = batch->packet.buf().size();
+        batch->packet.putInt32(0);
+        return batch.release();
+    } API_CATCH(nullptr)
+}
 
-        if (actualProcessCount <= processCount) {
-            for (auto i = 0; i < actualProcessCount; i++) {
-                processList[i] = reply.getInt32();
+WINPTY_API int
+winpty_batch_add_set_size(winpty_batch_t *batch, int cols, int rows,
+                          winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(batch != nullptr && !batch->ran && cols > 0 && rows > 0);
+        const size_t pos = batch->packet.beginBytes();
+        batch->packet.putInt32(AgentMsg::SetSize);
+        batch->packet.putInt32(cols);
+        batch->packet.putInt32(rows);
+        batch->packet.endBytes(pos);
+        batch->types.push_back(AgentMsg::SetSize);
+        return static_cast<int>(batch->types.size()) - 1;
+    } API_CATCH(-1)
+}
+
+WINPTY_API int
+winpty_batch_add_get_console_process_list(
+        winpty_batch_t *batch, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(batch != nullptr && !batch->ran);
+        const size_t pos = batch->packet.beginBytes();
+        batch->packet.putInt32(AgentMsg::GetConsoleProcessList);
+        batch->packet.endBytes(pos);
+        batch->types.push_back(AgentMsg::GetConsoleProcessList);
+        return static_cast<int>(batch->types.size()) - 1;
+    } API_CATCH(-1)
+}
+
+WINPTY_API BOOL
+winpty_batch_run(winpty_batch_t *batch, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(batch != nullptr && !batch->ran);
+        winpty_t &wp = *batch->wp;
+        batch->ran = true;
+        const auto count = static_cast<int32_t>(batch->types.size());
+        batch->packet.replaceInt32(batch->countPos, count);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp.mutex);
+            if (std::find(batch->types.begin(), batch->types.end(),
+                          AgentMsg::SetSize) != batch->types.end()) {
+                // The batch's size supersedes a debounced one.
+                wp.resizeDeferred = false;
+                wp.lastResizeTick = GetTickCount();
             }
+            req = startRpc(wp, batch->packet);
+        }
+        batch->reply.reset(new ReadBuffer(finishRpc(wp, *req)));
+        RpcOperation rpc(wp);
+        ReadBuffer &reply = *batch->reply;
+        if (reply.getInt32() != count) {
+            throwWinptyException(L"Agent RPC error: malformed batch reply");
+        }
+        for (int32_t i = 0; i < count; ++i) {
+            size_t size = 0;
+            const char *const data = reply.getBytes(size);
+            if (batch->types[i] == AgentMsg::SetSize) {
+                ReadBuffer(data, size).assertEof();
+            }
+            batch->results.push_back(std::make_pair(data, size));
         }
-
         reply.assertEof();
         rpc.success();
-        return actualProcessCount;
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API int
+winpty_batch_console_process_list(winpty_batch_t *batch, int index,
+                                  int *processList, const int processCount,
+                                  winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(batch != nullptr && batch->ran && processList != nullptr);
+        ASSERT(index >= 0 &&
+               static_cast<size_t>(index) < batch->results.size() &&
+               batch->types[index] == AgentMsg::GetConsoleProcessList);
+        RpcOperation rpc(*batch->wp);
+        ReadBuffer reply(batch->results[index].first,
+                         batch->results[index].second);
+        const int ret =
+            decodeConsoleProcessList(reply, processList, processCount);
+        rpc.success();
+        return ret;
     } API_CATCH(0)
 }
 
+WINPTY_API void winpty_batch_free(winpty_batch_t *batch) {
+    delete batch;
+}
+
+WINPTY_API LPCWSTR
+winpty_reattach_conout(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            auto packet = newPacket();
+            packet.putInt32(AgentMsg::ReattachConout);
+            req = startRpc(*wp, packet);
+        }
+        auto reply = finishRpc(*wp, *req);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto conoutPipeName = reply.getWString();
+        reply.assertEof();
+        rpc.success();
+        if (wp->conoutRing) {
+            // A read blocked on the old ring keeps it alive until it wakes
+            // and sees that the ring was replaced.
+            std::shared_ptr<ConoutRing> newRing =
+                openConoutRing(conoutPipeName);
+            const std::shared_ptr<ConoutRing> oldRing =
+                std::move(wp->conoutRing);
+            wp->conoutRing = std::move(newRing);
+            SetEvent(oldRing->dataEvent.get());
+            // The caller uses winpty_conout_read, but NULL means failure.
+            return L"";
+        }
+        wp->conoutPipeName = std::move(conoutPipeName);
+        return wp->conoutPipeName.c_str();
+    } API_CATCH(nullptr)
+}
+
+WINPTY_API winpty_screen_snapshot_t *
+winpty_get_screen_snapshot(winpty_t *wp, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            auto packet = newPacket();
+            packet.putInt32(AgentMsg::GetScreenSnapshot);
+            req = startRpc(*wp, packet);
+        }
+        std::unique_ptr<winpty_screen_snapshot_t> snapshot(
+            new winpty_screen_snapshot_t(finishRpc(*wp, *req)));
+        RpcOperation rpc(*wp);
+        snapshot->data = snapshot->packet.getBytes(snapshot->size);
+        snapshot->packet.assertEof();
+        rpc.success();
+        return snapshot.release();
+    } API_CATCH(nullptr)
+}
+
+WINPTY_API const void *
+winpty_screen_snapshot_data(winpty_screen_snapshot_t *snapshot, DWORD *size) {
+    ASSERT(snapshot != nullptr && size != nullptr);
+    *size = static_cast<DWORD>(snapshot->size);
+    return snapshot->data;
+}
+
+WINPTY_API void winpty_screen_snapshot_free(winpty_screen_snapshot_t *snapshot) {
+    delete snapshot;
+}
+
+WINPTY_API BOOL
+winpty_save_startup_timeline(winpty_t *wp, LPCWSTR path,
+                             winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && path != nullptr);
+        if (!wp->startupTimeline.enabled()) {
+            throwWinptyException(
+                L"The startup timeline was not recorded "
+                L"(set WINPTY_DEBUG=startup_timeline before winpty_open)");
+        }
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            auto packet = newPacket();
+            packet.putInt32(AgentMsg::GetStartupTimeline);
+            req = startRpc(*wp, packet);
+        }
+        auto reply = finishRpc(*wp, *req);
+        std::vector<StartupTimelineEvent> agentEvents;
+        {
+            RpcOperation rpc(*wp);
+            const int32_t count = reply.getInt32();
+            for (int32_t i = 0; i < count; ++i) {
+                StartupTimelineEvent event;
+                size_t nameSize = 0;
+                const char *const name = reply.getBytes(nameSize);
+                event.name.assign(name, nameSize);
+                event.pid = static_cast<uint32_t>(reply.getInt32());
+                event.tid = static_cast<uint32_t>(reply.getInt32());
+                event.start = reply.getInt64();
+                event.end = reply.getInt64();
+                agentEvents.push_back(std::move(event));
+            }
+            reply.assertEof();
+            rpc.success();
+        }
+
+        StartupTimeline merged;
+        merged.append(wp->startupTimeline.events());
+        merged.append(agentEvents);
+        merged.dumpToTrace();
+        const std::string json = merged.chromeTraceJson();
+
+        const HANDLE h = CreateFileW(path, GENERIC_WRITE, 0, nullptr,
+                                     CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                     nullptr);
+        if (h == INVALID_HANDLE_VALUE) {
+            throwWindowsError(L"CreateFileW failed for the timeline file");
+        }
+        OwnedHandle file(h);
+        DWORD actual = 0;
+        if (!WriteFile(file.get(), json.data(), json.size(), &actual,
+                       nullptr) || actual != json.size()) {
+            throwWindowsError(L"WriteFile failed for the timeline file");
+        }
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_get_stats(winpty_t *wp, const int *ids, UINT64 *values, int count,
+                 winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && count >= 0);
+        ASSERT(count == 0 || (ids != nullptr && values != nullptr));
+        std::shared_ptr<RpcRequest> req;
+        {
+            LockGuard<Mutex> lock(wp->mutex);
+            auto packet = newPacket();
+            packet.putInt32(AgentMsg::GetStats);
+            req = startRpc(*wp, packet);
+        }
+        auto reply = finishRpc(*wp, *req);
+        std::vector<std::pair<int, UINT64>> agentStats;
+        {
+            RpcOperation rpc(*wp);
+            const int32_t agentCount = reply.getInt32();
+            for (int32_t i = 0; i < agentCount; ++i) {
+                const int id = reply.getInt32();
+                const UINT64 value = static_cast<UINT64>(reply.getInt64());
+                agentStats.push_back(std::make_pair(id, value));
+            }
+            reply.assertEof();
+            rpc.success();
+        }
+        for (int i = 0; i < count; ++i) {
+            values[i] = 0;
+            for (const auto &stat : agentStats) {
+                if (stat.first == ids[i]) {
+                    values[i] = stat.second;
+                }
+            }
+        }
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
 WINPTY_API void winpty_free(winpty_t *wp) {
     // At least in principle, CloseHandle can fail, so this deletion can
     // fail.  It won't throw an exception, but maybe there's an error that
@@ -21,12 +21,26 @@
 #ifndef WINPTY_SHARED_AGENT_MSG_H
 #define WINPTY_SHARED_AGENT_MSG_H
 
+#include <stdint.h>
+
+// Every packet on the control pipe starts with a uint64_t size, which counts
+// the whole packet, and a uint32_t request ID.  The client numbers its
+// requests, and the agent copies each request's ID into its reply, so the
+// client can have several requests in flight.  Packets that the agent sends
+// unprompted (e.g. the pipe names at startup) use kAgentMsgNoRequestId.
+const uint32_t kAgentMsgNoRequestId = 0;
+
 struct AgentMsg
 {
     enum Type {
         StartProcess,
         SetSize,
         GetConsoleProcessList,
+        ReattachConout,
+        GetScreenSnapshot,
+        GetStartupTimeline,
+        Batch,
+        GetStats,
     };
 };
 
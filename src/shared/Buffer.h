@@ -30,11 +30,14 @@
 #include <string>
 
 #include "WinptyException.h"
+#include "WireFormat.h"
 
-class WriteBuffer {
-private:
-    std::vector<char> m_buf;
+static_assert(sizeof(wchar_t) == 2, "wchar_t must be UTF-16");
 
+// Packets are encoded with WireFormat.  These classes add wchar_t
+// convenience functions, and ReadBuffer throws on a decoding error.
+
+class WriteBuffer : public WireWriter {
 public:
     WriteBuffer() {}
 
@@ -45,17 +48,17 @@ public:
         replaceRawData(pos, &t, sizeof(t));
     }
 
-    void putRawData(const void *data, size_t len);
-    void replaceRawData(size_t pos, const void *data, size_t len);
-    void putInt32(int32_t i);
-    void putInt64(int64_t i);
-    void putWString(const wchar_t *str, size_t len);
+    // len is in characters, excluding NUL, i.e. the number of wchar_t
+    // elements
+    void putWString(const wchar_t *str, size_t len) { putString16(str, len); }
     void putWString(const wchar_t *str)         { putWString(str, wcslen(str)); }
     void putWString(const std::wstring &str)    { putWString(str.data(), str.size()); }
-    std::vector<char> &buf()                    { return m_buf; }
+    static size_t wstringSize(const std::wstring &str) {
+        return string16Size(str.size());
+    }
 
     // MSVC 2013 does not generate these automatically, so help it out.
-    WriteBuffer(WriteBuffer &&other) : m_buf(std::move(other.m_buf)) {}
+    WriteBuffer(WriteBuffer &&other) { m_buf = std::move(other.m_buf); }
     WriteBuffer &operator=(WriteBuffer &&other) {
         m_buf = std::move(other.m_buf);
         return *this;
@@ -72,10 +75,24 @@ public:
 
 private:
     std::vector<char> m_buf;
-    size_t m_off = 0;
+    // Decodes either m_buf's contents or a borrowed span.
+    WireReader m_reader;
+
+    void check() {
+        if (!m_reader.ok()) {
+            throwDecodeError();
+        }
+    }
+    void throwDecodeError();
 
 public:
-    explicit ReadBuffer(std::vector<char> &&buf) : m_buf(std::move(buf)) {}
+    explicit ReadBuffer(std::vector<char> &&buf) :
+        m_buf(std::move(buf)), m_reader(m_buf.data(), m_buf.size()) {}
+
+    // Decodes bytes owned by the caller without copying them.  The bytes
+    // must outlive the ReadBuffer.
+    ReadBuffer(const char *data, size_t size) :
+        m_reader(data, size) {}
 
     template <typename T> T getRawValue() {
         T ret = {};
@@ -83,18 +100,40 @@ public:
         return ret;
     }
 
-    void getRawData(void *data, size_t len);
-    int32_t getInt32();
-    int64_t getInt64();
+    void getRawData(void *data, size_t len) {
+        m_reader.getRawData(data, len);
+        check();
+    }
+    int32_t getInt32()      { const auto ret = m_reader.getInt32(); check(); return ret; }
+    int64_t getInt64()      { const auto ret = m_reader.getInt64(); check(); return ret; }
     std::wstring getWString();
-    void assertEof();
+    // Returns a view of a string in the buffer, valid for the ReadBuffer's
+    // lifetime (or the borrowed span's).  Nothing is allocated or copied.
+    WireString16 getWStringView() {
+        const auto ret = m_reader.getString16();
+        check();
+        return ret;
+    }
+    // Returns a pointer into the buffer, valid for the ReadBuffer's lifetime
+    // (or the borrowed span's).
+    const char *getBytes(size_t &lenOut) {
+        const auto ret = m_reader.getBytes(lenOut);
+        check();
+        return ret;
+    }
+    void assertEof() {
+        if (!m_reader.atEnd()) {
+            throwDecodeError();
+        }
+    }
 
     // MSVC 2013 does not generate these automatically, so help it out.
+    // Moving a vector keeps its heap storage, so the reader stays valid.
     ReadBuffer(ReadBuffer &&other) :
-        m_buf(std::move(other.m_buf)), m_off(other.m_off) {}
+        m_buf(std::move(other.m_buf)), m_reader(other.m_reader) {}
     ReadBuffer &operator=(ReadBuffer &&other) {
         m_buf = std::move(other.m_buf);
-        m_off = other.m_off;
+        m_reader = other.m_reader;
         return *this;
     }
 };
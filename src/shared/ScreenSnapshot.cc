@@ -0,0 +1,99 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "ScreenSnapshot.h"
+
+ScreenSnapshotWriter::ScreenSnapshotWriter(
+        std::vector<char> &out,
+        const ScreenSnapshotHeader &header) :
+    m_out(out)
+{
+    ASSERT(header.cols >= 0 && header.rows >= 0);
+    m_cellLimit = static_cast<size_t>(header.cols) * header.rows;
+    m_headerPos = m_out.size();
+    m_cellsPos = m_headerPos + sizeof(header);
+    m_out.resize(m_cellsPos + m_cellLimit * sizeof(uint16_t));
+    memcpy(&m_out[m_headerPos], &header, sizeof(header));
+}
+
+void ScreenSnapshotWriter::finish()
+{
+    ASSERT(m_cellCount == m_cellLimit);
+    const uint32_t runCount = m_runs.size();
+    memcpy(&m_out[m_headerPos + offsetof(ScreenSnapshotHeader, attrRunCount)],
+           &runCount, sizeof(runCount));
+    const char *const runs = reinterpret_cast<const char*>(m_runs.data());
+    m_out.insert(m_out.end(), runs,
+                 runs + m_runs.size() * sizeof(ScreenSnapshotAttrRun));
+}
+
+bool ScreenSnapshotReader::parse(const void *data, size_t size)
+{
+    const char *const bytes = reinterpret_cast<const char*>(data);
+    if (size < sizeof(m_header)) {
+        return false;
+    }
+    memcpy(&m_header, bytes, sizeof(m_header));
+    if (m_header.magic != kScreenSnapshotMagic ||
+            m_header.version != kScreenSnapshotVersion ||
+            m_header.headerSize < sizeof(m_header) ||
+            m_header.headerSize > size ||
+            m_header.cellFormat != kScreenSnapshotUtf16Cells ||
+            m_header.cols < 0 || m_header.rows < 0) {
+        return false;
+    }
+    const uint64_t cellCount =
+        static_cast<uint64_t>(m_header.cols) * m_header.rows;
+    const uint64_t runsPos =
+        m_header.headerSize + cellCount * sizeof(uint16_t);
+    const uint64_t endPos =
+        runsPos + static_cast<uint64_t>(m_header.attrRunCount) *
+            sizeof(ScreenSnapshotAttrRun);
+    if (endPos != size) {
+        return false;
+    }
+    m_cells = bytes + m_header.headerSize;
+    m_attributes.clear();
+    m_attributes.reserve(cellCount);
+    for (uint32_t i = 0; i < m_header.attrRunCount; ++i) {
+        ScreenSnapshotAttrRun run;
+        memcpy(&run, bytes + runsPos + i * sizeof(run), sizeof(run));
+        if (run.length > cellCount - m_attributes.size()) {
+            return false;
+        }
+        m_attributes.insert(m_attributes.end(), run.length, run.attributes);
+    }
+    return m_attributes.size() == cellCount;
+}
+
+uint16_t ScreenSnapshotReader::cellChar(int row, int col) const
+{
+    ASSERT(row >= 0 && row < m_header.rows && col >= 0 && col < m_header.cols);
+    uint16_t ret = 0;
+    memcpy(&ret, m_cells + (row * m_header.cols + col) * sizeof(ret),
+           sizeof(ret));
+    return ret;
+}
+
+uint16_t ScreenSnapshotReader::cellAttributes(int row, int col) const
+{
+    ASSERT(row >= 0 && row < m_header.rows && col >= 0 && col < m_header.cols);
+    return m_attributes[row * m_header.cols + col];
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef WINPTY_SHARED_SCREEN_SNAPSHOT_H
+#define WINPTY_SHARED_SCREEN_SNAPSHOT_H
+
+// The binary screen snapshot returned by winpty_get_screen_snapshot.  The
+// layout is documented in winpty.h.  This module doesn't depend on
+// windows.h, so it can be tested anywhere.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "WinptyAssert.h"
+
+const uint32_t kScreenSnapshotMagic = 0x4E535057; // "WPSN"
+const uint32_t kScreenSnapshotVersion = 1;
+const uint32_t kScreenSnapshotUtf16Cells = 1;
+
+struct ScreenSnapshotHeader {
+    uint32_t magic = kScreenSnapshotMagic;
+    uint32_t version = kScreenSnapshotVersion;
+    uint32_t headerSize = sizeof(ScreenSnapshotHeader);
+    uint32_t cellFormat = kScreenSnapshotUtf16Cells;
+    int32_t cols = 0;
+    int32_t rows = 0;
+    int32_t windowLeft = 0;
+    int32_t windowTop = 0;
+    int32_t bufferCols = 0;
+    int32_t bufferRows = 0;
+    int32_t cursorX = 0;
+    int32_t cursorY = 0;
+    int32_t cursorVisible = 0;
+    uint32_t attrRunCount = 0;
+};
+
+struct ScreenSnapshotAttrRun {
+    uint32_t length;
+    uint16_t attributes;
+    uint16_t reserved;
+};
+
+// Appends a snapshot to a byte vector.  Call putCell once for each of the
+// header's cols * rows cells, in row-major order, then call finish.
+class ScreenSnapshotWriter {
+public:
+    ScreenSnapshotWriter(std::vector<char> &out,
+                         const ScreenSnapshotHeader &header);
+    void putCell(uint16_t ch, uint16_t attributes) {
+        ASSERT(m_cellCount < m_cellLimit);
+        memcpy(&m_out[m_cellsPos + m_cellCount * sizeof(ch)], &ch, sizeof(ch));
+        m_cellCount++;
+        if (!m_runs.empty() && m_runs.back().attributes == attributes) {
+            m_runs.back().length++;
+        } else {
+            ScreenSnapshotAttrRun run = { 1, attributes, 0 };
+            m_runs.push_back(run);
+        }
+    }
+    void finish();
+
+private:
+    std::vector<char> &m_out;
+    size_t m_headerPos;
+    size_t m_cellsPos;
+    size_t m_cellCount = 0;
+    size_t m_cellLimit;
+    std::vector<ScreenSnapshotAttrRun> m_runs;
+};
+
+// Validates a snapshot and provides access to its cells.  The snapshot bytes
+// must outlive the reader.
+class ScreenSnapshotReader {
+public:
+    // Returns false if the blob is malformed.
+    bool parse(const void *data, size_t size);
+    const ScreenSnapshotHeader &header() const { return m_header; }
+    uint16_t cellChar(int row, int col) const;
+    uint16_t cellAttributes(int row, int col) const;
+
+private:
+    ScreenSnapshotHeader m_header;
+    const char *m_cells = nullptr;
+    // Expanded from the attribute runs, one entry per cell.
+    std::vector<uint16_t> m_attributes;
+};
+
+#endif // WINPTY_SHARED_SCREEN_SNAPSHOT_H
@@ -0,0 +1,156 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Encode a simulated console window as a screen snapshot and decode it again.
+// This test doesn't need Windows.  Build it with ScreenSnapshot.cc.
+
+#include "ScreenSnapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "UnitTest.h"
+
+struct SimulatedCell {
+    uint16_t ch;
+    uint16_t attr;
+};
+
+// A console window with a prompt, some colored output, and a full-width
+// character pair.
+static std::vector<SimulatedCell> simulateConsole(int cols, int rows)
+{
+    std::vector<SimulatedCell> ret(cols * rows);
+    for (auto &cell : ret) {
+        cell.ch = ' ';
+        cell.attr = 7;
+    }
+    const char *const lines[] = {
+        "Microsoft Windows [Version 10.0.14393]",
+        "",
+        "C:\\>dir /b",
+        "file.txt",
+    };
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; lines[row][col] != '\0'; ++col) {
+            ret[row * cols + col].ch = lines[row][col];
+        }
+    }
+    for (int col = 0; col < 8; ++col) {
+        ret[3 * cols + col].attr = 0x0A;
+    }
+    ret[4 * cols + 0].ch = 0x4E2D;
+    ret[4 * cols + 0].attr = 7 | 0x100;
+    ret[4 * cols + 1].ch = 0x4E2D;
+    ret[4 * cols + 1].attr = 7 | 0x200;
+    return ret;
+}
+
+static std::vector<char> encode(const std::vector<SimulatedCell> &cells,
+                                int cols, int rows)
+{
+    std::vector<char> out;
+    out.push_back('x'); // Make sure the blob needn't start aligned.
+    ScreenSnapshotHeader header;
+    header.cols = cols;
+    header.rows = rows;
+    header.windowLeft = 0;
+    header.windowTop = 100;
+    header.bufferCols = cols;
+    header.bufferRows = 3000;
+    header.cursorX = 4;
+    header.cursorY = 2;
+    header.cursorVisible = 1;
+    ScreenSnapshotWriter writer(out, header);
+    for (const auto &cell : cells) {
+        writer.putCell(cell.ch, cell.attr);
+    }
+    writer.finish();
+    out.erase(out.begin());
+    return out;
+}
+
+static void testRoundTrip()
+{
+    const int cols = 80;
+    const int rows = 25;
+    const auto cells = simulateConsole(cols, rows);
+    const auto blob = encode(cells, cols, rows);
+
+    ScreenSnapshotReader reader;
+    CHECK(reader.parse(blob.data(), blob.size()));
+    const auto &header = reader.header();
+    CHECK(header.headerSize == 56);
+    CHECK(header.cols == cols && header.rows == rows);
+    CHECK(header.windowTop == 100 && header.bufferRows == 3000);
+    CHECK(header.cursorX == 4 && header.cursorY == 2 && header.cursorVisible);
+    // 7, green, 7, lead byte, trail byte, 7
+    CHECK(header.attrRunCount == 6);
+    CHECK(blob.size() == 56 + cols * rows * 2 + 6 * 8);
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < cols; ++col) {
+            const auto &cell = cells[row * cols + col];
+            CHECK(reader.cellChar(row, col) == cell.ch);
+            CHECK(reader.cellAttributes(row, col) == cell.attr);
+        }
+    }
+}
+
+static void testEmpty()
+{
+    std::vector<char> out;
+    ScreenSnapshotHeader header;
+    ScreenSnapshotWriter writer(out, header);
+    writer.finish();
+    ScreenSnapshotReader reader;
+    CHECK(reader.parse(out.data(), out.size()));
+    CHECK(reader.header().cols == 0 && reader.header().rows == 0);
+}
+
+static void testMalformed()
+{
+    const int cols = 10;
+    const int rows = 5;
+    const auto blob = encode(simulateConsole(cols, rows), cols, rows);
+    ScreenSnapshotReader reader;
+    CHECK(!reader.parse(blob.data(), blob.size() - 1));
+    CHECK(!reader.parse(blob.data(), 10));
+    auto bad = blob;
+    bad[0] ^= 1;
+    CHECK(!reader.parse(bad.data(), bad.size()));
+    // Attribute runs that cover too many cells.
+    bad = blob;
+    ScreenSnapshotAttrRun run;
+    memcpy(&run, &bad[bad.size() - sizeof(run)], sizeof(run));
+    run.length += 1;
+    memcpy(&bad[bad.size() - sizeof(run)], &run, sizeof(run));
+    CHECK(!reader.parse(bad.data(), bad.size()));
+}
+
+int main()
+{
+    testRoundTrip();
+    testEmpty();
+    testMalformed();
+    return unitTestResult();
+}
@@ -0,0 +1,155 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "SpscRing.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+// The read and write positions are free-running counters; the difference is
+// the number of unread bytes.  Each counter is only stored by one side, and
+// they live on separate cache lines to avoid false sharing.  A 32-bit atomic
+// is lock-free (and therefore address-free across processes) everywhere we
+// care about.
+struct SpscRing::Header {
+    uint32_t magic;
+    uint32_t capacity;
+    char pad1[56];
+    std::atomic<uint32_t> writePos;
+    std::atomic<uint32_t> closed;
+    char pad2[56];
+    std::atomic<uint32_t> readPos;
+    char pad3[60];
+};
+
+namespace {
+
+const uint32_t kRingMagic = 0x474E5257; // "WRNG"
+
+static bool isPowerOfTwo(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+} // anonymous namespace
+
+size_t SpscRing::memorySize(uint32_t capacity) {
+    return sizeof(Header) + capacity;
+}
+
+bool SpscRing::create(void *memory, size_t size, uint32_t capacity) {
+    if (!isPowerOfTwo(capacity) || capacity > 0x80000000u ||
+            size < memorySize(capacity)) {
+        return false;
+    }
+    m_header = new (memory) Header;
+    m_header->magic = kRingMagic;
+    m_header->capacity = capacity;
+    m_header->writePos.store(0, std::memory_order_relaxed);
+    m_header->closed.store(0, std::memory_order_relaxed);
+    m_header->readPos.store(0, std::memory_order_relaxed);
+    m_data = reinterpret_cast<char*>(memory) + sizeof(Header);
+    m_capacity = capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+bool SpscRing::attach(void *memory, size_t size) {
+    if (size < sizeof(Header)) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    Header *const header = reinterpret_cast<Header*>(memory);
+    if (header->magic != kRingMagic || !isPowerOfTwo(header->capacity) ||
+            size < memorySize(header->capacity)) {
+        return false;
+    }
+    m_header = header;
+    m_data = reinterpret_cast<char*>(memory) + sizeof(Header);
+    m_capacity = header->capacity;
+    return true;
+}
+
+size_t SpscRing::writable() const {
+    const uint32_t w = m_header->writePos.load(std::memory_order_relaxed);
+    const uint32_t r = m_header->readPos.load(std::memory_order_acquire);
+    return inBounds(w, r) ? m_capacity - (w - r) : 0;
+}
+
+size_t SpscRing::write(const void *data, size_t size) {
+    const uint32_t w = m_header->writePos.load(std::memory_order_relaxed);
+    const uint32_t r = m_header->readPos.load(std::memory_order_acquire);
+    if (!inBounds(w, r)) {
+        m_broken = true;
+        return 0;
+    }
+    const size_t amount = std::min<size_t>(size, m_capacity - (w - r));
+    if (amount == 0) {
+        return 0;
+    }
+    const char *const src = reinterpret_cast<const char*>(data);
+    const uint32_t offset = w & (m_capacity - 1);
+    const size_t first = std::min<size_t>(amount, m_capacity - offset);
+    memcpy(m_data + offset, src, first);
+    memcpy(m_data, src + first, amount - first);
+    m_header->writePos.store(w + static_cast<uint32_t>(amount),
+                             std::memory_order_release);
+    return amount;
+}
+
+void SpscRing::close() {
+    m_header->closed.store(1, std::memory_order_release);
+}
+
+size_t SpscRing::readable() const {
+    const uint32_t w = m_header->writePos.load(std::memory_order_acquire);
+    const uint32_t r = m_header->readPos.load(std::memory_order_relaxed);
+    return inBounds(w, r) ? w - r : 0;
+}
+
+size_t SpscRing::read(void *data, size_t size) {
+    const uint32_t w = m_header->writePos.load(std::memory_order_acquire);
+    const uint32_t r = m_header->readPos.load(std::memory_order_relaxed);
+    if (!inBounds(w, r)) {
+        m_broken = true;
+        return 0;
+    }
+    const size_t amount = std::min<size_t>(size, w - r);
+    if (amount == 0) {
+        return 0;
+    }
+    char *const dst = reinterpret_cast<char*>(data);
+    const uint32_t offset = r & (m_capacity - 1);
+    const size_t first = std::min<size_t>(amount, m_capacity - offset);
+    memcpy(dst, m_data + offset, first);
+    memcpy(dst + first, m_data, amount - first);
+    m_header->readPos.store(r + static_cast<uint32_t>(amount),
+                            std::memory_order_release);
+    return amount;
+}
+
+// The writer closes the ring after its last write, so once the reader sees
+// the flag, a subsequent readable() check is final.  A broken ring reads as
+// closed and empty.
+bool SpscRing::isClosed() const {
+    return m_broken ||
+        m_header->closed.load(std::memory_order_acquire) != 0;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef WINPTY_SHARED_SPSC_RING_H
+#define WINPTY_SHARED_SPSC_RING_H
+
+// A single-producer, single-consumer byte ring that lives in a block of
+// memory shared between two processes (e.g. a file mapping).  The ring itself
+// never blocks; the owner of each end is responsible for waking up the other
+// end (e.g. with events) after making progress.
+//
+// The read and write positions are in the shared block, so either process
+// can corrupt them.  A ring whose positions are more than a full ring apart
+// is broken.  Neither side copies anything through it, and the reader sees
+// it as closed.
+//
+// This module doesn't depend on windows.h, so it can be tested anywhere.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+class SpscRing {
+public:
+    // Returns the size of the shared block needed for a ring with the given
+    // data capacity, which must be a power of two.
+    static size_t memorySize(uint32_t capacity);
+
+    // The writer formats the block.  The reader attaches to it and validates
+    // the header.  Both return false on failure.
+    bool create(void *memory, size_t memorySize, uint32_t capacity);
+    bool attach(void *memory, size_t memorySize);
+
+    uint32_t capacity() const { return m_capacity; }
+
+    // Writer side.  Returns the number of bytes accepted, which is less than
+    // `size` if the ring is full or broken.
+    size_t write(const void *data, size_t size);
+    size_t writable() const;
+    void close();
+
+    // Reader side.  Returns the number of bytes copied.
+    size_t read(void *data, size_t size);
+    size_t readable() const;
+    bool isClosed() const;
+
+    // Set once read or write has found the positions out of bounds.
+    bool isBroken() const { return m_broken; }
+
+private:
+    bool inBounds(uint32_t w, uint32_t r) const { return w - r <= m_capacity; }
+
+    struct Header;
+    Header *m_header = nullptr;
+    char *m_data = nullptr;
+    uint32_t m_capacity = 0;
+    bool m_broken = false;
+};
+
+#endif // WINPTY_SHARED_SPSC_RING_H
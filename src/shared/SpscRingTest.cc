@@ -0,0 +1,218 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Correctness and throughput tests for SpscRing, using POSIX shared memory
+// and two processes.  Build on Linux (or Cygwin) with SpscRing.cc:
+//
+//     g++ -std=c++11 -O2 SpscRingTest.cc SpscRing.cc -o SpscRingTest -lrt
+
+#include "SpscRing.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "UnitTest.h"
+
+static double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The byte stream is a function of its offset, so the reader can verify it
+// without the writer's help.
+static inline char patternByte(uint64_t offset) {
+    return static_cast<char>((offset * 2654435761u) >> 13);
+}
+
+static void testSingleProcess() {
+    const uint32_t kCapacity = 16;
+    std::vector<char> memory(SpscRing::memorySize(kCapacity));
+    SpscRing writer;
+    SpscRing reader;
+    CHECK(!writer.create(memory.data(), memory.size(), 12));
+    CHECK(!writer.create(memory.data(), memory.size() - 1, kCapacity));
+    CHECK(writer.create(memory.data(), memory.size(), kCapacity));
+    CHECK(reader.attach(memory.data(), memory.size()));
+    CHECK(reader.capacity() == kCapacity);
+
+    char buf[64];
+    CHECK(reader.read(buf, sizeof(buf)) == 0);
+    CHECK(writer.write("0123456789", 10) == 10);
+    CHECK(writer.writable() == 6);
+    CHECK(writer.write("abcdefghij", 10) == 6);
+    CHECK(writer.write("x", 1) == 0);
+    CHECK(reader.readable() == 16);
+    CHECK(reader.read(buf, 12) == 12);
+    CHECK(memcmp(buf, "0123456789ab", 12) == 0);
+
+    // This write wraps around the end of the data area.
+    CHECK(writer.write("ABCDEFGH", 8) == 8);
+    CHECK(reader.read(buf, sizeof(buf)) == 12);
+    CHECK(memcmp(buf, "cdefABCDEFGH", 12) == 0);
+
+    CHECK(!reader.isClosed());
+    writer.close();
+    CHECK(reader.isClosed() && reader.readable() == 0);
+
+    // A reader rejects memory that was never formatted.
+    std::vector<char> garbage(memory.size(), 'z');
+    CHECK(!reader.attach(garbage.data(), garbage.size()));
+}
+
+// The other process can write anything to the positions.  This overwrites
+// one, at its offset in the shared header (writePos at 64, readPos at 128).
+static void corruptPosition(std::vector<char> &memory, size_t offset,
+                            uint32_t value) {
+    memcpy(&memory[offset], &value, sizeof(value));
+}
+
+static void testCorruptPositions() {
+    const uint32_t kCapacity = 16;
+    const size_t kWritePos = 64;
+    const size_t kReadPos = 128;
+    char buf[64];
+    {
+        // A write position more than a ring ahead would make read copy past
+        // the data area.
+        std::vector<char> memory(SpscRing::memorySize(kCapacity));
+        SpscRing writer;
+        SpscRing reader;
+        CHECK(writer.create(memory.data(), memory.size(), kCapacity));
+        CHECK(reader.attach(memory.data(), memory.size()));
+        CHECK(writer.write("0123", 4) == 4);
+        corruptPosition(memory, kWritePos, 1000);
+        CHECK(reader.readable() == 0);
+        CHECK(!reader.isBroken());
+        CHECK(reader.read(buf, sizeof(buf)) == 0);
+        CHECK(reader.isBroken() && reader.isClosed());
+    }
+    {
+        // A read position past the write position would make the free space
+        // wrap around to nearly 4 GB.
+        std::vector<char> memory(SpscRing::memorySize(kCapacity));
+        SpscRing writer;
+        SpscRing reader;
+        CHECK(writer.create(memory.data(), memory.size(), kCapacity));
+        CHECK(reader.attach(memory.data(), memory.size()));
+        CHECK(writer.write("0123", 4) == 4);
+        corruptPosition(memory, kReadPos, 8);
+        CHECK(writer.writable() == 0);
+        CHECK(writer.write("x", 1) == 0);
+        CHECK(writer.isBroken());
+    }
+}
+
+// Stream `total` bytes from a child process to this process in chunks of
+// varying size, verifying every byte.  Returns the throughput in MB/s.
+static double testTwoProcesses(uint32_t capacity, uint64_t total) {
+    char name[64];
+    snprintf(name, sizeof(name), "/winpty-spsc-test-%d", (int)getpid());
+    const size_t size = SpscRing::memorySize(capacity);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    CHECK(fd >= 0);
+    CHECK(ftruncate(fd, size) == 0);
+    void *const memory =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHECK(memory != MAP_FAILED);
+    close(fd);
+    shm_unlink(name);
+
+    SpscRing ring;
+    CHECK(ring.create(memory, size, capacity));
+
+    const double start = nowSeconds();
+    const pid_t child = fork();
+    if (child == 0) {
+        std::vector<char> chunk(64 * 1024);
+        uint64_t offset = 0;
+        unsigned int seed = 1;
+        while (offset < total) {
+            const size_t want = std::min<uint64_t>(
+                1 + rand_r(&seed) % chunk.size(), total - offset);
+            for (size_t i = 0; i < want; ++i) {
+                chunk[i] = patternByte(offset + i);
+            }
+            size_t done = 0;
+            while (done < want) {
+                const size_t amt = ring.write(&chunk[done], want - done);
+                if (amt == 0) {
+                    sched_yield();
+                }
+                done += amt;
+            }
+            offset += want;
+        }
+        ring.close();
+        _exit(0);
+    }
+
+    SpscRing reader;
+    CHECK(reader.attach(memory, size));
+    std::vector<char> buf(48 * 1024);
+    uint64_t offset = 0;
+    uint64_t mismatches = 0;
+    while (true) {
+        const size_t amt = reader.read(buf.data(), buf.size());
+        if (amt == 0) {
+            if (reader.isClosed() && reader.readable() == 0) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < amt; ++i) {
+            if (buf[i] != patternByte(offset + i)) {
+                ++mismatches;
+            }
+        }
+        offset += amt;
+    }
+    const double elapsed = nowSeconds() - start;
+    int status = 0;
+    waitpid(child, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(offset == total);
+    CHECK(mismatches == 0);
+    munmap(memory, size);
+    return total / elapsed / (1024.0 * 1024.0);
+}
+
+int main() {
+    testSingleProcess();
+    testCorruptPositions();
+    const uint64_t kTotal = 512ull * 1024 * 1024;
+    const uint32_t capacities[] = { 4096, 64 * 1024, 1024 * 1024 };
+    for (uint32_t capacity : capacities) {
+        const double mbps = testTwoProcesses(capacity, kTotal);
+        printf("capacity %7u: %8.1f MB/s\n", capacity, mbps);
+    }
+    return unitTestResult();
+}
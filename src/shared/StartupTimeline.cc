@@ -0,0 +1,165 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "StartupTimeline.h"
+
+#include <windows.h>
+
+#include <algorithm>
+
+#include "DebugClient.h"
+#include "winpty_snprintf.h"
+
+namespace {
+
+double ticksPerMicrosecond() {
+    static double freq = 0.0;
+    if (freq == 0.0) {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        freq = static_cast<double>(value.QuadPart) / 1e6;
+    }
+    return freq;
+}
+
+std::vector<StartupTimelineEvent>
+sortedByStart(const std::vector<StartupTimelineEvent> &events) {
+    std::vector<StartupTimelineEvent> ret = events;
+    std::stable_sort(ret.begin(), ret.end(),
+        [](const StartupTimelineEvent &a, const StartupTimelineEvent &b) {
+            return a.start < b.start;
+        });
+    return ret;
+}
+
+void appendJsonString(std::string &out, const std::string &str) {
+    out.push_back('"');
+    for (char ch : str) {
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            char buf[8];
+            winpty_snprintf(buf, "\\u%04x",
+                            static_cast<unsigned int>(
+                                static_cast<unsigned char>(ch)));
+            out.append(buf);
+        } else {
+            out.push_back(ch);
+        }
+    }
+    out.push_back('"');
+}
+
+} // anonymous namespace
+
+StartupTimeline::StartupTimeline() :
+    m_enabled(hasDebugFlag("startup_timeline"))
+{
+}
+
+int64_t StartupTimeline::now() {
+    LARGE_INTEGER ret;
+    QueryPerformanceCounter(&ret);
+    return ret.QuadPart;
+}
+
+void StartupTimeline::add(const char *name, int64_t start, int64_t end) {
+    StartupTimelineEvent event;
+    event.name = name;
+    event.pid = GetCurrentProcessId();
+    event.tid = GetCurrentThreadId();
+    event.start = start;
+    event.end = end;
+    m_events.push_back(std::move(event));
+}
+
+void StartupTimeline::append(const std::vector<StartupTimelineEvent> &events) {
+    m_events.insert(m_events.end(), events.begin(), events.end());
+}
+
+// Writes the merged timeline to the trace output, one phase per line, with
+// times in milliseconds relative to the earliest phase.
+void StartupTimeline::dumpToTrace() const {
+    if (m_events.empty()) {
+        return;
+    }
+    const auto events = sortedByStart(m_events);
+    const int64_t base = events.front().start;
+    const double freq = ticksPerMicrosecond() * 1000.0;
+    for (const auto &event : events) {
+        trace("startup timeline: pid %u: %9.3f ms  %8.3f ms  %s",
+              static_cast<unsigned int>(event.pid),
+              (event.start - base) / freq,
+              (event.end - event.start) / freq,
+              event.name.c_str());
+    }
+}
+
+// Formats the timeline in the Chrome trace event format, which
+// chrome://tracing and Perfetto can load.  Each phase is a complete ("X")
+// event, and each process is labeled with a metadata ("M") event.  This is
+// called from libwinpty, so any other process is the agent.
+std::string StartupTimeline::chromeTraceJson() const {
+    const auto events = sortedByStart(m_events);
+    const int64_t base = events.empty() ? 0 : events.front().start;
+    const double freq = ticksPerMicrosecond();
+    const uint32_t selfPid = GetCurrentProcessId();
+    std::vector<uint32_t> pids;
+    std::string ret = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &event : events) {
+        if (std::find(pids.begin(), pids.end(), event.pid) == pids.end()) {
+            pids.push_back(event.pid);
+        }
+        ret.append(first ? "\n" : ",\n");
+        first = false;
+        ret.append("{\"ph\":\"X\",\"name\":");
+        appendJsonString(ret, event.name);
+        char buf[128];
+        winpty_snprintf(buf,
+            "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            static_cast<unsigned int>(event.pid),
+            static_cast<unsigned int>(event.tid),
+            (event.start - base) / freq,
+            (event.end - event.start) / freq);
+        ret.append(",");
+        ret.append(buf);
+    }
+    for (uint32_t pid : pids) {
+        char buf[128];
+        winpty_snprintf(buf,
+            "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}",
+            static_cast<unsigned int>(pid),
+            pid == selfPid ? "libwinpty" : "winpty-agent");
+        ret.append(first ? "\n" : ",\n");
+        first = false;
+        ret.append(buf);
+    }
+    ret.append("\n]}\n");
+    return ret;
+}
+
+StartupTimeline &processStartupTimeline() {
+    static StartupTimeline timeline;
+    return timeline;
+}
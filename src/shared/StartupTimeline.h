@@ -0,0 +1,86 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Records the phases of winpty_open and agent startup, for the
+// startup_timeline debug flag (WINPTY_DEBUG=startup_timeline).  Timestamps
+// are QueryPerformanceCounter ticks, which are comparable across processes
+// on one machine, so libwinpty can merge the agent's events with its own.
+
+#ifndef WINPTY_SHARED_STARTUP_TIMELINE_H
+#define WINPTY_SHARED_STARTUP_TIMELINE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct StartupTimelineEvent {
+    std::string name;
+    uint32_t pid;
+    uint32_t tid;
+    int64_t start;
+    int64_t end;
+};
+
+class StartupTimeline {
+public:
+    StartupTimeline();
+    bool enabled() const { return m_enabled; }
+    static int64_t now();
+    void add(const char *name, int64_t start, int64_t end);
+    void append(const std::vector<StartupTimelineEvent> &events);
+    const std::vector<StartupTimelineEvent> &events() const { return m_events; }
+    void dumpToTrace() const;
+    std::string chromeTraceJson() const;
+
+private:
+    bool m_enabled;
+    std::vector<StartupTimelineEvent> m_events;
+};
+
+// The agent records into a single timeline for the process.  libwinpty keeps
+// one per winpty_t instead.
+StartupTimeline &processStartupTimeline();
+
+// Records the lifetime of the scope as one event.
+class StartupTimelineScope {
+public:
+    StartupTimelineScope(StartupTimeline &timeline, const char *name) :
+        m_timeline(timeline.enabled() ? &timeline : nullptr),
+        m_name(name),
+        m_start(m_timeline != nullptr ? StartupTimeline::now() : 0)
+    {
+    }
+    ~StartupTimelineScope() {
+        if (m_timeline != nullptr) {
+            m_timeline->add(m_name, m_start, StartupTimeline::now());
+        }
+    }
+    StartupTimelineScope(const StartupTimelineScope &other) = delete;
+    StartupTimelineScope &operator=(const StartupTimelineScope &other) = delete;
+
+private:
+    StartupTimeline *m_timeline;
+    const char *m_name;
+    int64_t m_start;
+};
+
+#endif // WINPTY_SHARED_STARTUP_TIMELINE_H
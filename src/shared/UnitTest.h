@@ -0,0 +1,66 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef WINPTY_SHARED_UNIT_TEST_H
+#define WINPTY_SHARED_UNIT_TEST_H
+
+// Scaffolding for the standalone unit tests (the *Test.cc programs next to
+// the code they test).  Include it only from the file with main(), because
+// it defines the failure count and the assertion hooks that WinptyAssert.h
+// declares.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do {                                                            \
+        if (!(cond)) {                                              \
+            printf("error: %s:%d: %s\n", __FILE__, __LINE__, #cond);\
+            ++g_failures;                                           \
+        }                                                           \
+    } while(0)
+
+// Prints the result and returns the exit code for main.
+static int unitTestResult() {
+    if (g_failures != 0) {
+        printf("%d failure(s)\n", g_failures);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
+
+// The code under test may assert.  There is no debug server to report to,
+// so print the failure.
+#ifdef WINPTY_AGENT_ASSERT
+void agentShutdown() {}
+void agentAssertFail(const char *file, int line, const char *cond) {
+    printf("Assertion failed: %s, %s:%d\n", cond, file, line);
+    abort();
+}
+#else
+void assertTrace(const char *file, int line, const char *cond) {
+    printf("Assertion failed: %s, %s:%d\n", cond, file, line);
+}
+#endif
+
+#endif // WINPTY_SHARED_UNIT_TEST_H
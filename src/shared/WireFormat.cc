@@ -0,0 +1,165 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "WireFormat.h"
+
+#include "WinptyAssert.h"
+
+char *WireWriter::append(size_t len) {
+    const size_t pos = m_buf.size();
+    m_buf.resize(pos + len);
+    return m_buf.data() + pos;
+}
+
+void WireWriter::replaceRawData(size_t pos, const void *data, size_t len) {
+    ASSERT(pos <= m_buf.size() && len <= m_buf.size() - pos);
+    memcpy(&m_buf[pos], data, len);
+}
+
+void WireWriter::putInt32(int32_t i) {
+    char *const p = append(int32Size());
+    p[0] = static_cast<char>(WireTag::Int32);
+    memcpy(p + 1, &i, 4);
+}
+
+void WireWriter::putInt64(int64_t i) {
+    char *const p = append(int64Size());
+    p[0] = static_cast<char>(WireTag::Int64);
+    memcpy(p + 1, &i, 8);
+}
+
+void WireWriter::putString16(const void *chars, size_t count) {
+    ASSERT(count <= UINT32_MAX / 2);
+    const uint32_t count32 = static_cast<uint32_t>(count);
+    char *const p = append(string16Size(count));
+    p[0] = static_cast<char>(WireTag::String16);
+    memcpy(p + 1, &count32, 4);
+    if (count > 0) {
+        memcpy(p + 5, chars, count * 2);
+    }
+}
+
+void WireWriter::putBytes(const void *data, size_t len) {
+    ASSERT(len <= UINT32_MAX);
+    const uint32_t len32 = static_cast<uint32_t>(len);
+    char *const p = append(bytesSize(len));
+    p[0] = static_cast<char>(WireTag::Bytes);
+    memcpy(p + 1, &len32, 4);
+    if (len > 0) {
+        memcpy(p + 5, data, len);
+    }
+}
+
+void WireWriter::replaceInt32(size_t pos, int32_t i) {
+    ASSERT(pos < m_buf.size() &&
+           m_buf[pos] == static_cast<char>(WireTag::Int32));
+    replaceRawData(pos + 1, &i, 4);
+}
+
+size_t WireWriter::beginBytes() {
+    const size_t pos = m_buf.size();
+    char *const p = append(bytesSize(0));
+    p[0] = static_cast<char>(WireTag::Bytes);
+    memset(p + 1, 0, 4);
+    return pos;
+}
+
+void WireWriter::endBytes(size_t pos) {
+    ASSERT(pos < m_buf.size() &&
+           m_buf[pos] == static_cast<char>(WireTag::Bytes));
+    const size_t len = m_buf.size() - pos - bytesSize(0);
+    ASSERT(len <= UINT32_MAX);
+    const uint32_t len32 = static_cast<uint32_t>(len);
+    replaceRawData(pos + 1, &len32, 4);
+}
+
+// Returns a pointer to the next len bytes and skips them, or returns nullptr
+// and fails if there aren't enough bytes.
+const char *WireReader::take(size_t len) {
+    if (m_failed || len > m_size - m_off) {
+        m_failed = true;
+        return nullptr;
+    }
+    const char *const ret = m_data + m_off;
+    m_off += len;
+    return ret;
+}
+
+bool WireReader::expectTag(WireTag tag) {
+    const char *const p = take(1);
+    if (p == nullptr || static_cast<uint8_t>(*p) != static_cast<uint8_t>(tag)) {
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool WireReader::getRawData(void *data, size_t len) {
+    const char *const p = take(len);
+    if (p == nullptr) {
+        memset(data, 0, len);
+        return false;
+    }
+    memcpy(data, p, len);
+    return true;
+}
+
+int32_t WireReader::getInt32() {
+    int32_t ret = 0;
+    if (expectTag(WireTag::Int32)) {
+        getRawData(&ret, sizeof(ret));
+    }
+    return ret;
+}
+
+int64_t WireReader::getInt64() {
+    int64_t ret = 0;
+    if (expectTag(WireTag::Int64)) {
+        getRawData(&ret, sizeof(ret));
+    }
+    return ret;
+}
+
+WireString16 WireReader::getString16() {
+    uint32_t count = 0;
+    if (!expectTag(WireTag::String16) || !getRawData(&count, sizeof(count))) {
+        return WireString16();
+    }
+    if (count > SIZE_MAX / 2) {
+        m_failed = true;
+        return WireString16();
+    }
+    const char *const p = take(static_cast<size_t>(count) * 2);
+    return p != nullptr ? WireString16(p, count) : WireString16();
+}
+
+const char *WireReader::getBytes(size_t &lenOut) {
+    lenOut = 0;
+    uint32_t len = 0;
+    if (!expectTag(WireTag::Bytes) || !getRawData(&len, sizeof(len))) {
+        return nullptr;
+    }
+    const char *const p = take(len);
+    if (p != nullptr) {
+        lenOut = len;
+    }
+    return p;
+}
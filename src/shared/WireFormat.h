@@ -0,0 +1,134 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef WINPTY_SHARED_WIRE_FORMAT_H
+#define WINPTY_SHARED_WIRE_FORMAT_H
+
+// The encoding of the fields of an agent RPC packet.  Each field is a one-byte
+// tag followed by its value.  Integers are little-endian, and strings are
+// UTF-16 with a 32-bit length in code units.  Nothing is padded, so the
+// decoder never assumes that a field is aligned.
+//
+// The encoder appends to a single vector and can reserve room for a whole
+// packet up front.  The decoder hands out views into the packet rather than
+// copies, and it never allocates.
+//
+// This module doesn't depend on windows.h, so it can be tested anywhere.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+// Bump this whenever the encoding changes.  The agent sends it at startup, and
+// libwinpty refuses to talk to an agent that uses another version.
+const int32_t kWireFormatVersion = 2;
+
+enum class WireTag : uint8_t { Int32 = 1, Int64, String16, Bytes };
+
+// A UTF-16 string inside a packet.  It is valid as long as the packet.
+class WireString16 {
+public:
+    WireString16() {}
+    WireString16(const char *bytes, size_t count) :
+        m_bytes(bytes), m_count(count) {}
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    // The characters mightn't be aligned, so copy them out instead of
+    // casting the pointer.  dst must have room for size() code units.
+    void copyTo(void *dst) const { memcpy(dst, m_bytes, m_count * 2); }
+    const char *bytes() const { return m_bytes; }
+private:
+    const char *m_bytes = nullptr;
+    size_t m_count = 0;
+};
+
+class WireWriter {
+public:
+    // Sizes of encoded fields, for reserving room for a packet.
+    static size_t int32Size() { return 1 + 4; }
+    static size_t int64Size() { return 1 + 8; }
+    static size_t string16Size(size_t count) { return 1 + 4 + count * 2; }
+    static size_t bytesSize(size_t len) { return 1 + 4 + len; }
+
+    void reserve(size_t extra) { m_buf.reserve(m_buf.size() + extra); }
+
+    // Grows the packet by len bytes and returns a pointer to the new bytes,
+    // which the caller fills in.  The pointer is valid until the packet
+    // grows again.
+    char *append(size_t len);
+
+    void putRawData(const void *data, size_t len) {
+        if (len > 0) {
+            memcpy(append(len), data, len);
+        }
+    }
+    void replaceRawData(size_t pos, const void *data, size_t len);
+    void putInt32(int32_t i);
+    void putInt64(int64_t i);
+    // count is in UTF-16 code units.
+    void putString16(const void *chars, size_t count);
+    void putBytes(const void *data, size_t len);
+
+    // Overwrites the value of the Int32 field that was written at pos.
+    void replaceInt32(size_t pos, int32_t i);
+
+    // Encodes the fields written between these calls as one Bytes field,
+    // in place.  beginBytes returns the position to pass to endBytes.
+    size_t beginBytes();
+    void endBytes(size_t pos);
+
+    std::vector<char> &buf()                    { return m_buf; }
+    const std::vector<char> &buf() const        { return m_buf; }
+
+protected:
+    std::vector<char> m_buf;
+};
+
+// Decodes a packet in place.  After the first error, every call fails and
+// returns a zero value, so the caller can check ok() once after decoding
+// several fields.
+class WireReader {
+public:
+    WireReader() {}
+    WireReader(const char *data, size_t size) : m_data(data), m_size(size) {}
+
+    bool ok() const { return !m_failed; }
+    bool atEnd() const { return m_off == m_size; }
+
+    bool getRawData(void *data, size_t len);
+    int32_t getInt32();
+    int64_t getInt64();
+    WireString16 getString16();
+    const char *getBytes(size_t &lenOut);
+
+private:
+    const char *take(size_t len);
+    bool expectTag(WireTag tag);
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_off = 0;
+    bool m_failed = false;
+};
+
+#endif // WINPTY_SHARED_WIRE_FORMAT_H
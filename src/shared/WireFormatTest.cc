@@ -0,0 +1,435 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Fuzz and benchmark the RPC wire format.  The benchmark encodes and decodes
+// StartProcess packets with large environment blocks, using WireFormat and
+// a copy of the previous codec (tagged fields appended one at a time with
+// vector::insert, 64-bit string lengths, and a std::wstring per decoded
+// string, copied again into a NUL-terminated vector by the agent).  Build on
+// Linux with WireFormat.cc, ideally once with sanitizers for the fuzzing:
+//
+//     g++ -std=c++11 -O2 WireFormatTest.cc WireFormat.cc -o WireFormatTest
+//     g++ -std=c++11 -g -fsanitize=address,undefined
+//         WireFormatTest.cc WireFormat.cc -o WireFormatTest
+
+#include "WireFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "UnitTest.h"
+
+static double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef std::u16string String16;
+
+struct StartProcessArgs {
+    int64_t flags = 0;
+    int32_t wantProcess = 0;
+    int32_t wantThread = 0;
+    String16 strings[5]; // program, cmdline, cwd, env, desktop
+};
+
+static String16 toString16(const char *str) {
+    return String16(str, str + strlen(str));
+}
+
+// An environment block with `count` variables of about 90 characters each.
+static String16 makeEnvBlock(int count) {
+    String16 ret;
+    for (int i = 0; i < count; ++i) {
+        char var[128];
+        snprintf(var, sizeof(var),
+                 "VARIABLE_%05d=C:\\Program Files\\Some Application\\bin;"
+                 "C:\\Users\\someone\\AppData\\Local", i);
+        ret += toString16(var);
+        ret.push_back(u'\0');
+    }
+    ret.push_back(u'\0');
+    return ret;
+}
+
+static StartProcessArgs makeArgs(int envCount) {
+    StartProcessArgs ret;
+    ret.flags = 1;
+    ret.wantProcess = 1;
+    ret.strings[0] = toString16("C:\\Windows\\System32\\cmd.exe");
+    ret.strings[1] = toString16("cmd.exe /k echo hello");
+    ret.strings[2] = toString16("C:\\Users\\someone");
+    ret.strings[3] = makeEnvBlock(envCount);
+    ret.strings[4] = toString16("WinSta0\\Default");
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// WireFormat
+
+static void encodeStartProcess(const StartProcessArgs &args,
+                               std::vector<char> &out) {
+    WireWriter writer;
+    size_t size = sizeof(uint64_t) + sizeof(uint32_t) +
+        WireWriter::int32Size() * 3 + WireWriter::int64Size();
+    for (const auto &str : args.strings) {
+        size += WireWriter::string16Size(str.size());
+    }
+    writer.reserve(size);
+    writer.putRawData("\0\0\0\0\0\0\0\0\0\0\0\0", 12); // size, request ID
+    writer.putInt32(0); // AgentMsg::StartProcess
+    writer.putInt64(args.flags);
+    writer.putInt32(args.wantProcess);
+    writer.putInt32(args.wantThread);
+    for (const auto &str : args.strings) {
+        writer.putString16(str.data(), str.size());
+    }
+    const uint64_t total = writer.buf().size();
+    writer.replaceRawData(0, &total, sizeof(total));
+    out.swap(writer.buf());
+}
+
+// Decodes the packet the way the agent does, into one NUL-separated
+// buffer.  Returns false on a decoding error.
+static bool decodeStartProcess(const char *data, size_t size,
+                               std::vector<char16_t> &stringBuf,
+                               StartProcessArgs *argsOut=nullptr) {
+    WireReader reader(data, size);
+    uint64_t total = 0;
+    uint32_t requestId = 0;
+    reader.getRawData(&total, sizeof(total));
+    reader.getRawData(&requestId, sizeof(requestId));
+    reader.getInt32();
+    const int64_t flags = reader.getInt64();
+    const int32_t wantProcess = reader.getInt32();
+    const int32_t wantThread = reader.getInt32();
+    WireString16 strings[5];
+    size_t totalChars = 0;
+    for (auto &str : strings) {
+        str = reader.getString16();
+        totalChars += str.size() + 1;
+    }
+    if (!reader.ok() || !reader.atEnd()) {
+        return false;
+    }
+    // Every view must lie within the packet.
+    for (const auto &str : strings) {
+        CHECK(str.empty() ||
+              (str.bytes() >= data &&
+               str.bytes() + str.size() * 2 <= data + size));
+    }
+    stringBuf.resize(totalChars);
+    char16_t *pos = stringBuf.data();
+    for (const auto &str : strings) {
+        str.copyTo(pos);
+        pos += str.size();
+        *pos++ = u'\0';
+    }
+    if (argsOut != nullptr) {
+        argsOut->flags = flags;
+        argsOut->wantProcess = wantProcess;
+        argsOut->wantThread = wantThread;
+        pos = stringBuf.data();
+        for (size_t i = 0; i < 5; ++i) {
+            argsOut->strings[i].assign(pos, strings[i].size());
+            pos += strings[i].size() + 1;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The previous codec, for comparison
+
+namespace legacy {
+
+enum class Piece : uint8_t { Int32, Int64, WString, Bytes };
+
+static void putRawData(std::vector<char> &buf, const void *data, size_t len) {
+    const auto p = reinterpret_cast<const char*>(data);
+    buf.insert(buf.end(), p, p + len);
+}
+
+template <typename T> void putRawValue(std::vector<char> &buf, const T &t) {
+    putRawData(buf, &t, sizeof(t));
+}
+
+static void putString(std::vector<char> &buf, const String16 &str) {
+    putRawValue(buf, Piece::WString);
+    putRawValue(buf, static_cast<uint64_t>(str.size()));
+    putRawData(buf, str.data(), str.size() * 2);
+}
+
+static void encodeStartProcess(const StartProcessArgs &args,
+                               std::vector<char> &out) {
+    std::vector<char> buf;
+    putRawValue<uint64_t>(buf, 0);
+    putRawValue<uint32_t>(buf, 0);
+    putRawValue(buf, Piece::Int32);
+    putRawValue<int32_t>(buf, 0);
+    putRawValue(buf, Piece::Int64);
+    putRawValue(buf, args.flags);
+    putRawValue(buf, Piece::Int32);
+    putRawValue(buf, args.wantProcess);
+    putRawValue(buf, Piece::Int32);
+    putRawValue(buf, args.wantThread);
+    for (const auto &str : args.strings) {
+        putString(buf, str);
+    }
+    const uint64_t total = buf.size();
+    std::copy(reinterpret_cast<const char*>(&total),
+              reinterpret_cast<const char*>(&total) + sizeof(total),
+              &buf[0]);
+    out.swap(buf);
+}
+
+class Reader {
+public:
+    Reader(const char *data, size_t size) : m_data(data), m_size(size) {}
+    bool getRawData(void *data, size_t len) {
+        if (len > m_size - m_off) {
+            return false;
+        }
+        std::copy(m_data + m_off, m_data + m_off + len,
+                  reinterpret_cast<char*>(data));
+        m_off += len;
+        return true;
+    }
+    bool getString(String16 &out) {
+        Piece piece;
+        uint64_t len = 0;
+        if (!getRawData(&piece, 1) || piece != Piece::WString ||
+                !getRawData(&len, sizeof(len)) || len > (m_size - m_off) / 2) {
+            return false;
+        }
+        out.resize(len);
+        return len == 0 || getRawData(&out[0], len * 2);
+    }
+    bool atEnd() const { return m_off == m_size; }
+private:
+    const char *m_data;
+    size_t m_size;
+    size_t m_off = 0;
+};
+
+static bool decodeStartProcess(const char *data, size_t size) {
+    Reader reader(data, size);
+    char header[12 + 5 + 9 + 5 + 5];
+    if (!reader.getRawData(header, sizeof(header))) {
+        return false;
+    }
+    String16 strings[5];
+    for (auto &str : strings) {
+        if (!reader.getString(str)) {
+            return false;
+        }
+    }
+    // The agent then copied each string into a NUL-terminated vector.
+    std::vector<char16_t> copies[5];
+    for (size_t i = 0; i < 5; ++i) {
+        copies[i].assign(strings[i].begin(), strings[i].end());
+        copies[i].push_back(u'\0');
+    }
+    return reader.atEnd();
+}
+
+} // namespace legacy
+
+///////////////////////////////////////////////////////////////////////////
+// Tests
+
+static void testRoundTrip() {
+    const StartProcessArgs args = makeArgs(300);
+    std::vector<char> packet;
+    encodeStartProcess(args, packet);
+    // Decode from an odd address so that the strings are misaligned.
+    std::vector<char> shifted(packet.size() + 1);
+    memcpy(&shifted[1], packet.data(), packet.size());
+    std::vector<char16_t> stringBuf;
+    StartProcessArgs decoded;
+    CHECK(decodeStartProcess(&shifted[1], packet.size(), stringBuf,
+                             &decoded));
+    CHECK(decoded.flags == args.flags);
+    CHECK(decoded.wantProcess == 1 && decoded.wantThread == 0);
+    for (size_t i = 0; i < 5; ++i) {
+        CHECK(decoded.strings[i] == args.strings[i]);
+    }
+    // Every truncation fails cleanly.
+    for (size_t len = 0; len < packet.size(); len += 7) {
+        CHECK(!decodeStartProcess(packet.data(), len, stringBuf));
+    }
+}
+
+static void testFieldErrors() {
+    WireWriter writer;
+    writer.putInt32(-5);
+    writer.putInt64(INT64_MIN);
+    writer.putBytes("abc", 3);
+    writer.putString16(u"", 0);
+    const auto &buf = writer.buf();
+    WireReader reader(buf.data(), buf.size());
+    CHECK(reader.getInt32() == -5);
+    CHECK(reader.getInt64() == INT64_MIN);
+    size_t len = 0;
+    const char *const bytes = reader.getBytes(len);
+    CHECK(len == 3 && memcmp(bytes, "abc", 3) == 0);
+    CHECK(reader.getString16().empty());
+    CHECK(reader.ok() && reader.atEnd());
+
+    // Nested Bytes fields are encoded in place.
+    WireWriter nested;
+    nested.putInt32(0);
+    const size_t outer = nested.beginBytes();
+    nested.putInt32(7);
+    const size_t inner = nested.beginBytes();
+    nested.putInt64(-9);
+    nested.endBytes(inner);
+    nested.endBytes(outer);
+    const size_t empty = nested.beginBytes();
+    nested.endBytes(empty);
+    nested.replaceInt32(0, 2);
+    WireReader nestedReader(nested.buf().data(), nested.buf().size());
+    CHECK(nestedReader.getInt32() == 2);
+    size_t outerLen = 0;
+    const char *const outerData = nestedReader.getBytes(outerLen);
+    CHECK(nestedReader.getBytes(len) != nullptr && len == 0);
+    CHECK(nestedReader.ok() && nestedReader.atEnd());
+    WireReader outerReader(outerData, outerLen);
+    CHECK(outerReader.getInt32() == 7);
+    const char *const innerData = outerReader.getBytes(len);
+    CHECK(outerReader.ok() && outerReader.atEnd());
+    WireReader innerReader(innerData, len);
+    CHECK(innerReader.getInt64() == -9 && innerReader.atEnd());
+
+    // A tag mismatch fails, and the failure is sticky.
+    WireReader bad(buf.data(), buf.size());
+    CHECK(bad.getInt64() == 0);
+    CHECK(!bad.ok());
+    CHECK(bad.getInt32() == 0 && !bad.ok());
+
+    // A huge string length fails without reading past the end.
+    WireWriter huge;
+    huge.putString16(u"xy", 2);
+    const uint32_t count = 0xFFFFFFFF;
+    huge.replaceRawData(1, &count, sizeof(count));
+    WireReader hugeReader(huge.buf().data(), huge.buf().size());
+    CHECK(hugeReader.getString16().empty() && !hugeReader.ok());
+}
+
+// Mutate valid packets and decode them.  A decode must either fail cleanly
+// or produce views inside the packet (checked in decodeStartProcess).  Run
+// this under the sanitizers to catch out-of-bounds reads.
+static void testFuzz(int iterations) {
+    std::mt19937 rng(12345);
+    std::vector<char> original;
+    encodeStartProcess(makeArgs(20), original);
+    std::vector<char16_t> stringBuf;
+    int accepted = 0;
+    for (int i = 0; i < iterations; ++i) {
+        std::vector<char> packet = original;
+        const int mutations = 1 + rng() % 8;
+        for (int j = 0; j < mutations; ++j) {
+            const size_t pos = rng() % packet.size();
+            switch (rng() % 4) {
+            case 0:
+                packet[pos] ^= static_cast<char>(1 << (rng() % 8));
+                break;
+            case 1:
+                packet[pos] = static_cast<char>(rng());
+                break;
+            case 2:
+                packet.resize(pos + 1);
+                break;
+            case 3:
+                packet.insert(packet.begin() + pos, static_cast<char>(rng()));
+                break;
+            }
+        }
+        // Copy into an exactly-sized heap block so ASan sees overreads.
+        std::unique_ptr<char[]> exact(new char[packet.size()]);
+        memcpy(exact.get(), packet.data(), packet.size());
+        if (decodeStartProcess(exact.get(), packet.size(), stringBuf)) {
+            ++accepted;
+        }
+        legacy::decodeStartProcess(exact.get(), packet.size());
+    }
+    printf("fuzz: %d iterations, %d mutated packets still decoded\n",
+           iterations, accepted);
+}
+
+static void benchmark(int envCount) {
+    const StartProcessArgs args = makeArgs(envCount);
+    std::vector<char> packet;
+    encodeStartProcess(args, packet);
+    const double mb = packet.size() / (1024.0 * 1024.0);
+    const int iterations = std::max(20, static_cast<int>(2000 / mb));
+    std::vector<char16_t> stringBuf;
+
+    double start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        encodeStartProcess(args, packet);
+    }
+    const double newEncode = nowSeconds() - start;
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        CHECK(decodeStartProcess(packet.data(), packet.size(), stringBuf));
+    }
+    const double newDecode = nowSeconds() - start;
+
+    std::vector<char> legacyPacket;
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        legacy::encodeStartProcess(args, legacyPacket);
+    }
+    const double oldEncode = nowSeconds() - start;
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        CHECK(legacy::decodeStartProcess(legacyPacket.data(),
+                                         legacyPacket.size()));
+    }
+    const double oldDecode = nowSeconds() - start;
+
+    const double total = mb * iterations;
+    printf("env %5d vars (%7.1f KB packet): "
+           "encode %7.0f -> %7.0f MB/s, decode %7.0f -> %7.0f MB/s\n",
+           envCount, packet.size() / 1024.0,
+           total / oldEncode, total / newEncode,
+           total / oldDecode, total / newDecode);
+}
+
+int main() {
+    testRoundTrip();
+    testFieldErrors();
+    testFuzz(200000);
+    benchmark(30);
+    benchmark(300);
+    benchmark(3000);
+    return unitTestResult();
+}
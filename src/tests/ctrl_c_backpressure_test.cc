@@ -0,0 +1,178 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// With an input queue limit, input that doesn't fit in the queue stays in
+// the CONIN pipe.  Check that a Ctrl-C written behind a paste that fills the
+// queue still reaches a console program that isn't reading its input.  Also
+// check that a 0x03 that is part of ESC ^C (Alt+Ctrl+C) or of a bracketed
+// paste isn't sent as Ctrl-C, even when the paste marker is split between
+// the agent's decoder and the pipe.
+
+#include <windows.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#include "../include/winpty.h"
+
+static HANDLE g_ctrlCEvent;
+
+static BOOL WINAPI ctrlHandler(DWORD type) {
+    if (type == CTRL_C_EVENT) {
+        SetEvent(g_ctrlCEvent);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void writeAll(HANDLE handle, const std::string &data) {
+    DWORD amount = 0;
+    BOOL ret = WriteFile(handle, data.data(), data.size(), &amount, nullptr);
+    assert(ret && amount == data.size());
+}
+
+// Read until the text appears, or with no text, until the pipe closes.
+static void readUntil(HANDLE handle, const char *text) {
+    std::string content;
+    char buf[1024];
+    while (text == nullptr || content.find(text) == std::string::npos) {
+        DWORD amount = 0;
+        BOOL ret = ReadFile(handle, buf, sizeof(buf), &amount, nullptr);
+        if (!ret || amount == 0) {
+            break;
+        }
+        content.append(buf, amount);
+    }
+}
+
+// Runs the child in a new agent, writes the chunks to CONIN, and returns
+// whether the child got a Ctrl-C within waitMs.  An escapeTimeoutMs of 0
+// keeps the agent's default.
+static bool childGotCtrlC(const std::vector<std::string> &chunks,
+                          const wchar_t *waitMs,
+                          DWORD escapeTimeoutMs) {
+    wchar_t program[1024];
+    wchar_t cmdline[1024];
+    GetModuleFileNameW(nullptr, program, 1024);
+    // See trivial_test.cc for why this doesn't use swprintf.
+    cmdline[0] = L'\0';
+    wcscat(cmdline, L"\"");
+    wcscat(cmdline, program);
+    wcscat(cmdline, L"\" CHILD ");
+    wcscat(cmdline, waitMs);
+
+    auto agentCfg = winpty_config_new(0, nullptr);
+    assert(agentCfg != nullptr);
+    winpty_config_set_input_queue_limit(agentCfg, 16);
+    if (escapeTimeoutMs != 0) {
+        winpty_config_set_escape_timeout(agentCfg, escapeTimeoutMs);
+    }
+    auto pty = winpty_open(agentCfg, nullptr);
+    assert(pty != nullptr);
+    winpty_config_free(agentCfg);
+
+    HANDLE conin = CreateFileW(
+        winpty_conin_name(pty),
+        GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    HANDLE conout = CreateFileW(
+        winpty_conout_name(pty),
+        GENERIC_READ, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    assert(conin != INVALID_HANDLE_VALUE);
+    assert(conout != INVALID_HANDLE_VALUE);
+
+    auto spawnCfg = winpty_spawn_config_new(
+            WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN, program, cmdline,
+            nullptr, nullptr, nullptr);
+    assert(spawnCfg != nullptr);
+    HANDLE process = nullptr;
+    BOOL spawnSuccess = winpty_spawn(
+        pty, spawnCfg, &process, nullptr, nullptr, nullptr);
+    assert(spawnSuccess && process != nullptr);
+    winpty_spawn_config_free(spawnCfg);
+
+    readUntil(conout, "READY");
+    for (const auto &chunk : chunks) {
+        writeAll(conin, chunk);
+    }
+    readUntil(conout, nullptr);
+
+    DWORD exitCode = 0;
+    assert(WaitForSingleObject(process, 20000) == WAIT_OBJECT_0);
+    assert(GetExitCodeProcess(process, &exitCode));
+    CloseHandle(process);
+    CloseHandle(conin);
+    CloseHandle(conout);
+    winpty_free(pty);
+    return exitCode == 42;
+}
+
+static int parentTest() {
+    // The paste is far more than 16 records, but it still fits in the
+    // agent's read buffer, so the input behind it reaches the agent too.
+    const std::string paste(32 * 1024, 'x');
+    int failures = 0;
+
+    if (!childGotCtrlC({ paste, "\x03" }, L"10000", 0)) {
+        printf("error: the child did not receive Ctrl-C\n");
+        ++failures;
+    }
+    if (childGotCtrlC({ paste, "\x1B\x03" }, L"3000", 0)) {
+        printf("error: ESC ^C was sent as Ctrl-C\n");
+        ++failures;
+    }
+    // The decoder holds the incomplete ESC [ 2 0 while the queue is full.
+    // The long escape timeout keeps it from being flushed as keys.
+    if (childGotCtrlC({ paste + "\x1B[20", "0~\x03\x1B[201~" },
+                      L"3000", 5000)) {
+        printf("error: a Ctrl-C in a bracketed paste was sent as Ctrl-C\n");
+        ++failures;
+    }
+
+    if (failures > 0) {
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
+
+static int childTest(DWORD waitMs) {
+    g_ctrlCEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    SetConsoleCtrlHandler(nullptr, FALSE);
+    SetConsoleCtrlHandler(ctrlHandler, TRUE);
+    printf("READY\n");
+    fflush(stdout);
+    // Never read the input, so the agent's injection queue stays full.
+    if (WaitForSingleObject(g_ctrlCEvent, waitMs) == WAIT_OBJECT_0) {
+        return 42;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        return parentTest();
+    } else {
+        return childTest(atoi(argv[2]));
+    }
+}
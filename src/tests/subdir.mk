@@ -23,6 +23,82 @@ build/%.exe : src/tests/%.cc build/winpty.dll
 	@$(MINGW_CXX) $(MINGW_CXXFLAGS) $(MINGW_LDFLAGS) -o $@ $^
 
 TEST_PROGRAMS = \
+        build/ctrl_c_backpressure_test.exe \
         build/trivial_test.exe
 
 -include $(TEST_PROGRAMS:.exe=.d)
+
+# Unit tests for the modules that don't need Windows.  Like the input table
+# generator, they're built with the host compiler and run on the build
+# machine.  The build/host object rule is in src/agent/subdir.mk.
+
+HOST_TEST_PROGRAMS = \
+	build/host/AgentPoolTest \
+	build/host/ChunkedByteQueueTest \
+	build/host/CompactingByteBufferTest \
+	build/host/InOrderIoQueueTest \
+	build/host/InputDfaTest \
+	build/host/InputMapTest \
+	build/host/LatencyHistogramTest \
+	build/host/OutputBackpressureTest \
+	build/host/PlainTextDecoderTest \
+	build/host/ScreenSnapshotTest \
+	build/host/ScrollbackHistoryTest \
+	build/host/SpscRingTest \
+	build/host/TimerQueueTest \
+	build/host/WireFormatTest
+
+build/host/AgentPoolTest : \
+	build/host/libwinpty/AgentPoolTest.o \
+	build/host/libwinpty/AgentPool.o
+build/host/ChunkedByteQueueTest : \
+	build/host/agent/ChunkedByteQueueTest.o \
+	build/host/agent/ChunkedByteQueue.o
+build/host/CompactingByteBufferTest : \
+	build/host/agent/CompactingByteBufferTest.o
+build/host/InOrderIoQueueTest : \
+	build/host/agent/InOrderIoQueueTest.o \
+	build/host/agent/InOrderIoQueue.o \
+	build/host/agent/ChunkedByteQueue.o
+build/host/InputDfaTest : \
+	build/host/agent/InputDfaTest.o \
+	build/host/agent/DefaultInputMap.o \
+	build/host/agent/InputDfa.o \
+	build/host/agent/InputMap.o
+build/host/InputMapTest : \
+	build/host/agent/InputMapTest.o \
+	build/host/agent/InputMap.o
+build/host/LatencyHistogramTest : \
+	build/host/agent/LatencyHistogramTest.o
+build/host/OutputBackpressureTest : \
+	build/host/agent/OutputBackpressureTest.o \
+	build/host/agent/ScrollbackHistory.o
+build/host/PlainTextDecoderTest : \
+	build/host/agent/PlainTextDecoderTest.o \
+	build/host/agent/PlainTextDecoder.o
+build/host/ScreenSnapshotTest : \
+	build/host/shared/ScreenSnapshotTest.o \
+	build/host/shared/ScreenSnapshot.o
+build/host/ScrollbackHistoryTest : \
+	build/host/agent/ScrollbackHistoryTest.o \
+	build/host/agent/ScrollbackHistory.o
+build/host/SpscRingTest : \
+	build/host/shared/SpscRingTest.o \
+	build/host/shared/SpscRing.o
+build/host/TimerQueueTest : \
+	build/host/agent/TimerQueueTest.o \
+	build/host/agent/TimerQueue.o
+build/host/WireFormatTest : \
+	build/host/shared/WireFormatTest.o \
+	build/host/shared/WireFormat.o
+
+build/host/AgentPoolTest : HOST_TEST_LDFLAGS := -pthread
+build/host/SpscRingTest : HOST_TEST_LDFLAGS := -lrt
+
+$(HOST_TEST_PROGRAMS) :
+	$(info Linking $@)
+	@$(HOST_CXX) -o $@ $^ $(HOST_TEST_LDFLAGS)
+
+TEST_PROGRAMS += $(HOST_TEST_PROGRAMS)
+
+-include $(wildcard build/host/*/*.d)
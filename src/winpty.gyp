@@ -29,8 +29,29 @@
         {
             'target_name' : 'winpty-agent',
             'type' : 'executable',
+            'dependencies' : [
+                'winpty-gen-input-tables',
+            ],
             'include_dirs' : [
                 'include',
+                '<(SHARED_INTERMEDIATE_DIR)',
+            ],
+            'actions' : [
+                {
+                    # Generate the default input map and its DFA as static
+                    # tables.
+                    'action_name' : 'gen-input-tables',
+                    'inputs' : [
+                        '<(PRODUCT_DIR)/winpty-gen-input-tables<(EXECUTABLE_SUFFIX)',
+                    ],
+                    'outputs' : [
+                        '<(SHARED_INTERMEDIATE_DIR)/DefaultInputTables.h',
+                    ],
+                    'action' : [
+                        '<(PRODUCT_DIR)/winpty-gen-input-tables<(EXECUTABLE_SUFFIX)',
+                        '<(SHARED_INTERMEDIATE_DIR)/DefaultInputTables.h',
+                    ],
+                },
             ],
             'defines' : [
                 'WINPTY_AGENT_ASSERT',
@@ -52,6 +73,10 @@
                 'agent/Agent.cc',
                 'agent/AgentCreateDesktop.h',
                 'agent/AgentCreateDesktop.cc',
+                'agent/CharInfo.h',
+                'agent/ChunkedByteQueue.cc',
+                'agent/ChunkedByteQueue.h',
+                'agent/CompactingByteBuffer.h',
                 'agent/ConsoleFont.cc',
                 'agent/ConsoleFont.h',
                 'agent/ConsoleInput.cc',
@@ -63,24 +88,36 @@
                 'agent/Coord.h',
                 'agent/DebugShowInput.h',
                 'agent/DebugShowInput.cc',
-                'agent/DefaultInputMap.h',
-                'agent/DefaultInputMap.cc',
                 'agent/DsrSender.h',
                 'agent/EventLoop.h',
                 'agent/EventLoop.cc',
+                'agent/InOrderIoQueue.cc',
+                'agent/InOrderIoQueue.h',
+                'agent/InputDfa.h',
+                'agent/InputDfa.cc',
                 'agent/InputMap.h',
                 'agent/InputMap.cc',
+                'agent/InputMapDebug.cc',
                 'agent/LargeConsoleRead.h',
                 'agent/LargeConsoleRead.cc',
+                'agent/LatencyHistogram.h',
                 'agent/NamedPipe.h',
+                'agent/OutputBackpressure.h',
                 'agent/NamedPipe.cc',
+                'agent/PlainTextDecoder.h',
+                'agent/PlainTextDecoder.cc',
                 'agent/Scraper.h',
                 'agent/Scraper.cc',
+                'agent/ScrollbackHistory.h',
+                'agent/ScrollbackHistory.cc',
                 'agent/SimplePool.h',
                 'agent/SmallRect.h',
                 'agent/Terminal.h',
                 'agent/Terminal.cc',
+                'agent/TimerQueue.cc',
+                'agent/TimerQueue.h',
                 'agent/UnicodeEncoding.h',
+                'agent/VirtualKeys.h',
                 'agent/Win32Console.cc',
                 'agent/Win32Console.h',
                 'agent/Win32ConsoleBuffer.cc',
@@ -98,6 +135,12 @@
                 'shared/OsModule.h',
                 'shared/OwnedHandle.h',
                 'shared/OwnedHandle.cc',
+                'shared/ScreenSnapshot.h',
+                'shared/ScreenSnapshot.cc',
+                'shared/SpscRing.h',
+                'shared/SpscRing.cc',
+                'shared/StartupTimeline.h',
+                'shared/StartupTimeline.cc',
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
@@ -112,9 +155,40 @@
                 'shared/WinptyException.cc',
                 'shared/WinptyVersion.h',
                 'shared/WinptyVersion.cc',
+                'shared/WireFormat.h',
+                'shared/WireFormat.cc',
                 'shared/winpty_snprintf.h',
             ],
         },
+        {
+            # Generates the default input tables for winpty-agent.  It runs
+            # on the build machine.
+            'target_name' : 'winpty-gen-input-tables',
+            'type' : 'executable',
+            'defines' : [
+                'WINPTY_AGENT_ASSERT',
+            ],
+            'msvs_settings': {
+                # Specify this setting here to override a setting from somewhere
+                # else, such as node's common.gypi.
+                'VCCLCompilerTool': {
+                    'ExceptionHandling': '1', # /EHsc
+                },
+            },
+            'sources' : [
+                'agent/DefaultInputMap.h',
+                'agent/DefaultInputMap.cc',
+                'agent/GenInputTables.cc',
+                'agent/InputDfa.h',
+                'agent/InputDfa.cc',
+                'agent/InputMap.h',
+                'agent/InputMap.cc',
+                'agent/SimplePool.h',
+                'agent/VirtualKeys.h',
+                'shared/StringBuilder.h',
+                'shared/WinptyAssert.h',
+            ],
+        },
         {
             'target_name' : 'winpty',
             'type' : 'shared_library',
@@ -139,6 +213,8 @@
                 'include/winpty.h',
                 'libwinpty/AgentLocation.cc',
                 'libwinpty/AgentLocation.h',
+                'libwinpty/AgentPool.cc',
+                'libwinpty/AgentPool.h',
                 'libwinpty/winpty.cc',
                 'shared/AgentMsg.h',
                 'shared/BackgroundDesktop.h',
@@ -152,6 +228,10 @@
                 'shared/OsModule.h',
                 'shared/OwnedHandle.h',
                 'shared/OwnedHandle.cc',
+                'shared/SpscRing.h',
+                'shared/SpscRing.cc',
+                'shared/StartupTimeline.h',
+                'shared/StartupTimeline.cc',
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
@@ -165,6 +245,8 @@
                 'shared/WinptyException.cc',
                 'shared/WinptyVersion.h',
                 'shared/WinptyVersion.cc',
+                'shared/WireFormat.h',
+                'shared/WireFormat.cc',
                 'shared/winpty_snprintf.h',
             ],
         },